@@ -1,21 +1,167 @@
 #include "buffer.h"
+
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cstddef>
 #include <cstring>
 
-Buffer::Buffer(int initBuffSize) : buffer_(initBuffSize), read_pos_(0), write_pos_(0){};
+struct Buffer::Slab {
+  // 引用该块的段数，加上作为写入块的一次
+  int refs;
+  size_t cap;
+  auto Data() -> char * { return reinterpret_cast<char *>(this + 1); }
+};
+
+// 每个线程保留少量空闲块，取用与归还都不加锁。块可以在一个线程取得、在另一个线程归还
+class Buffer::SlabCache {
+ public:
+  SlabCache() { free_.reserve(MAX_CACHED); }
+  ~SlabCache() {
+    for (Slab *slab : free_) {
+      operator delete(slab);
+    }
+    destroyed = true;
+  }
+
+  // 当前线程的缓存，线程退出、缓存已析构后返回 nullptr
+  static auto Local() -> SlabCache * {
+    if (destroyed) {
+      return nullptr;
+    }
+    thread_local SlabCache cache;
+    return &cache;
+  }
+
+  auto Get() -> Slab * {
+    if (free_.empty()) {
+      return nullptr;
+    }
+    Slab *slab = free_.back();
+    free_.pop_back();
+    return slab;
+  }
+
+  auto Put(Slab *slab) -> bool {
+    if (free_.size() >= MAX_CACHED) {
+      return false;
+    }
+    free_.push_back(slab);
+    return true;
+  }
 
-auto Buffer::ReadableBytes() const -> size_t { return write_pos_ - read_pos_; }
+ private:
+  // 每个线程最多保留的空闲块数
+  static constexpr size_t MAX_CACHED = 64;
+  static thread_local bool destroyed;
 
-auto Buffer::WritableBytes() const -> size_t { return buffer_.size() - write_pos_; }
+  std::vector<Slab *> free_;
+};
 
-auto Buffer::PrependableBytes() const -> size_t { return read_pos_; }
+thread_local bool Buffer::SlabCache::destroyed = false;
+
+Buffer::Buffer() : head_(0), write_slab_(nullptr), write_pos_(nullptr), readable_(0), consumed_(0) {}
+
+Buffer::~Buffer() { RetrieveAll(); }
+
+auto Buffer::NewSlab(size_t cap) -> Slab * {
+  Slab *slab = nullptr;
+  if (cap <= SLAB_SIZE) {
+    cap = SLAB_SIZE;
+    SlabCache *cache = SlabCache::Local();
+    if (cache != nullptr) {
+      slab = cache->Get();
+    }
+  }
+  if (slab == nullptr) {
+    slab = static_cast<Slab *>(operator new(sizeof(Slab) + cap));
+  }
+  slab->refs = 0;
+  slab->cap = cap;
+  return slab;
+}
+
+void Buffer::FreeSlab(Slab *slab) {
+  if (slab->cap == SLAB_SIZE) {
+    SlabCache *cache = SlabCache::Local();
+    if (cache != nullptr && cache->Put(slab)) {
+      return;
+    }
+  }
+  operator delete(slab);
+}
+
+void Buffer::Unref(Slab *slab) {
+  if (--slab->refs == 0) {
+    FreeSlab(slab);
+  }
+}
+
+void Buffer::SetWriteSlab(Slab *slab) {
+  slab->refs++;
+  if (write_slab_ != nullptr) {
+    Unref(write_slab_);
+  }
+  write_slab_ = slab;
+  write_pos_ = slab->Data();
+}
+
+void Buffer::ReleaseConsumed() {
+  if (head_ == 0) {
+    return;
+  }
+  for (size_t i = 0; i < head_; i++) {
+    if (nodes_[i].slab != nullptr) {
+      Unref(nodes_[i].slab);
+    }
+  }
+  nodes_.erase(nodes_.begin(), nodes_.begin() + head_);
+  head_ = 0;
+  consumed_ = 0;
+}
+
+auto Buffer::WritableBytes() const -> size_t {
+  return write_slab_ != nullptr ? write_slab_->Data() + write_slab_->cap - write_pos_ : 0;
+}
+
+auto Buffer::Peek() -> const char * {
+  if (readable_ == 0) {
+    return write_pos_ != nullptr ? write_pos_ : "";
+  }
+  if (static_cast<size_t>(nodes_[head_].end - nodes_[head_].begin) < readable_) {
+    Linearize();
+  }
+  return nodes_[head_].begin;
+}
 
-auto Buffer::Peek() const -> const char * { return BeginPtr() + read_pos_; }
+void Buffer::Linearize() {
+  // 合并后的块留出同样多的空间，较大的请求体分多次到达时不会反复合并
+  Slab *slab = NewSlab(std::max(SLAB_SIZE, readable_ * 2));
+  char *dst = slab->Data();
+  for (size_t i = head_; i < nodes_.size(); i++) {
+    size_t size = nodes_[i].end - nodes_[i].begin;
+    memcpy(dst, nodes_[i].begin, size);
+    dst += size;
+  }
+  size_t readable = readable_;
+  RetrieveAll();
+  SetWriteSlab(slab);
+  HasWritten(readable);
+}
 
 void Buffer::Retrieve(size_t len) {
   assert(len <= ReadableBytes());
-  read_pos_ += len;
+  readable_ -= len;
+  consumed_ += len;
+  while (len > 0) {
+    Node &node = nodes_[head_];
+    size_t n = std::min(len, static_cast<size_t>(node.end - node.begin));
+    node.begin += n;
+    len -= n;
+    if (node.begin == node.end) {
+      head_++;
+    }
+  }
 }
 
 void Buffer::RetrieveUntil(const char *end) {
@@ -24,27 +170,62 @@ void Buffer::RetrieveUntil(const char *end) {
 }
 
 void Buffer::RetrieveAll() {
-  buffer_.assign(buffer_.size(), 0);
-  read_pos_ = 0;
-  write_pos_ = 0;
+  for (Node &node : nodes_) {
+    if (node.slab != nullptr) {
+      Unref(node.slab);
+    }
+  }
+  nodes_.clear();
+  head_ = 0;
+  if (write_slab_ != nullptr) {
+    Unref(write_slab_);
+    write_slab_ = nullptr;
+    write_pos_ = nullptr;
+  }
+  readable_ = 0;
+  consumed_ = 0;
 }
 
 auto Buffer::RetrieveAllToStr() -> std::string {
-  std::string str(Peek(), ReadableBytes());
+  std::string str;
+  str.reserve(readable_);
+  for (size_t i = head_; i < nodes_.size(); i++) {
+    str.append(nodes_[i].begin, nodes_[i].end);
+  }
   RetrieveAll();
   return str;
 }
 
-auto Buffer::BeginWriteConst() const -> const char * { return BeginPtr() + write_pos_; }
+void Buffer::Shrink() {
+  ReleaseConsumed();
+  if (readable_ == 0 && write_slab_ != nullptr) {
+    Unref(write_slab_);
+    write_slab_ = nullptr;
+    write_pos_ = nullptr;
+  }
+}
+
+auto Buffer::BeginWriteConst() const -> const char * { return write_pos_; }
 
-auto Buffer::BeginWrite() -> char * { return BeginPtr() + write_pos_; }
+auto Buffer::BeginWrite() -> char * { return write_pos_; }
 
 void Buffer::HasWritten(size_t len) {
   assert(len <= WritableBytes());
+  if (len == 0) {
+    return;
+  }
+  // 紧接在上一段之后写入时延长该段，否则新建一段
+  if (head_ < nodes_.size() && nodes_.back().slab == write_slab_ && nodes_.back().end == write_pos_) {
+    nodes_.back().end += len;
+  } else {
+    write_slab_->refs++;
+    nodes_.push_back({write_pos_, write_pos_ + len, write_slab_, nullptr});
+  }
   write_pos_ += len;
+  readable_ += len;
 }
 
-void Buffer::Append(const std::string &str) { Append(str.data(), str.size()); }
+void Buffer::Append(std::string_view str) { Append(str.data(), str.size()); }
 
 void Buffer::Append(const void *data, size_t len) {
   assert(data);
@@ -53,72 +234,103 @@ void Buffer::Append(const void *data, size_t len) {
 
 void Buffer::Append(const char *str, size_t len) {
   assert(str);
-  EnsureWriteable(len);
-  std::copy(str, str + len, BeginWrite());
-  HasWritten(len);
+  ReleaseConsumed();
+  while (len > 0) {
+    if (WritableBytes() == 0) {
+      SetWriteSlab(NewSlab(SLAB_SIZE));
+    }
+    size_t n = std::min(len, WritableBytes());
+    memcpy(write_pos_, str, n);
+    HasWritten(n);
+    str += n;
+    len -= n;
+  }
 }
 
-void Buffer::Append(const Buffer &buff) { Append(buff.Peek(), buff.ReadableBytes()); }
+void Buffer::Append(const Buffer &buff) {
+  for (size_t i = buff.head_; i < buff.nodes_.size(); i++) {
+    Append(buff.nodes_[i].begin, buff.nodes_[i].end - buff.nodes_[i].begin);
+  }
+}
+
+void Buffer::AddExternal(std::shared_ptr<const void> owner, const char *data, size_t len) {
+  ReleaseConsumed();
+  nodes_.push_back({data, data + len, nullptr, std::move(owner)});
+  readable_ += len;
+}
 
 void Buffer::EnsureWriteable(size_t len) {
+  ReleaseConsumed();
   if (WritableBytes() < len) {
-    AllocateSpace(len);
+    SetWriteSlab(NewSlab(len));
   }
   assert(WritableBytes() >= len);
 }
 
-auto Buffer::ReadFd(int fd, int *saveErrno) -> ssize_t {
-  char buff[65535];
-  // 64KB也是TCP协议中单个IP数据包的最大理论大小（尽管实际上因为各种
-  // 原因，如MTU限制，实际使用的大小通常会小很多）。选择这个大小作为读取操作的缓冲区可以在单次系统调
-  // 用中读取尽可能多的数据，减少系统调用的次数，提高I/O效率。
+auto Buffer::Gather(size_t offset, size_t len, struct iovec *iov, int max) const -> int {
+  int cnt = 0;
+  for (size_t i = head_; i < nodes_.size() && len > 0 && cnt < max; i++) {
+    size_t size = nodes_[i].end - nodes_[i].begin;
+    if (offset >= size) {
+      offset -= size;
+      continue;
+    }
+    size_t n = std::min(size - offset, len);
+    iov[cnt].iov_base = const_cast<char *>(nodes_[i].begin + offset);
+    iov[cnt].iov_len = n;
+    cnt++;
+    len -= n;
+    offset = 0;
+  }
+  return cnt;
+}
 
-  struct iovec iov[2];
+auto Buffer::ReadFd(int fd, int *saveErrno) -> ssize_t {
+  ReleaseConsumed();
+  // 依次读入当前块的剩余空间与新取得的块，合计不少于 READ_MAX，数据直接落在链中
+  struct iovec iov[READ_SLABS + 1];
+  Slab *fresh[READ_SLABS];
+  int cnt = 0;
+  int slabs = 0;
   const size_t writable = WritableBytes();
+  if (writable > 0) {
+    iov[cnt++] = {write_pos_, writable};
+  }
+  for (size_t room = writable; room < READ_MAX; room += SLAB_SIZE) {
+    fresh[slabs] = NewSlab(SLAB_SIZE);
+    iov[cnt++] = {fresh[slabs]->Data(), SLAB_SIZE};
+    slabs++;
+  }
 
-  iov[0].iov_base = BeginPtr() + write_pos_;  // 指向数据的指针
-  iov[0].iov_len = writable;                  // 数据的长度
-  iov[1].iov_base = buff;
-  iov[1].iov_len = sizeof(buff);
-
-  /* 分散读， 保证数据全部读完 */
-  const ssize_t len = readv(fd, iov, 2);
+  const ssize_t len = readv(fd, iov, cnt);
   if (len < 0) {
     *saveErrno = errno;
-  } else if (static_cast<size_t>(len) <= writable) {
-    write_pos_ += len;  // 数据被直接读取到Buffer的当前可写空间中，即iov[0]所指向的空间。
-    // 因为数据完全位于Buffer的预分配空间内，所以不需要使用Append方法来追加数据。
-    // 直接通过增加write_pos_的值来更新Buffer的写指针，反映新追加的数据长度。
-  } else {
-    write_pos_ = buffer_.size();
-    Append(buff, len - writable);
+  }
+  size_t left = len > 0 ? len : 0;
+  size_t n = std::min(left, writable);
+  HasWritten(n);
+  left -= n;
+  for (int i = 0; i < slabs; i++) {
+    if (left == 0) {
+      FreeSlab(fresh[i]);
+      continue;
+    }
+    SetWriteSlab(fresh[i]);
+    n = std::min(left, SLAB_SIZE);
+    HasWritten(n);
+    left -= n;
   }
   return len;
 }
 
 auto Buffer::WriteFd(int fd, int *saveErrno) -> ssize_t {
-  size_t read_size = ReadableBytes();
-  ssize_t len = write(fd, Peek(), read_size);
+  struct iovec iov[WRITE_IOV];
+  int cnt = Gather(0, readable_, iov, WRITE_IOV);
+  ssize_t len = writev(fd, iov, cnt);
   if (len < 0) {
     *saveErrno = errno;
     return len;
   }
-  read_pos_ += len;
+  Retrieve(len);
   return len;
 }
-
-auto Buffer::BeginPtr() -> char * { return buffer_.data(); }
-
-auto Buffer::BeginPtr() const -> const char * { return buffer_.data(); }
-
-void Buffer::AllocateSpace(size_t len) {
-  if (WritableBytes() + PrependableBytes() < len) {
-    buffer_.resize(write_pos_ + len + 1);
-  } else {
-    size_t readable = ReadableBytes();
-    std::copy(BeginPtr() + read_pos_, BeginPtr() + write_pos_, BeginPtr());
-    read_pos_ = 0;
-    write_pos_ = read_pos_ + readable;
-    assert(readable == ReadableBytes());
-  }
-}
\ No newline at end of file
@@ -4,65 +4,127 @@
 #include <sys/uio.h>
 #include <unistd.h>
 
-#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstring>
-#include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// 链式缓冲区：数据保存在一串定长的块中，块来自每个线程各自的缓存，用完归还，不随连接常驻。
+// 链中除了自己的块，还可以引用外部数据(如缓存中的文件内容)：外部数据以共享指针保持有效，
+// 发送时直接作为 iovec 交给 writev，不复制。
+// 读写接口与连续缓冲区相同：Peek() 总是返回连续的可读数据，数据跨块时先合并到一个块中，
+// 请求解析器不需要关心块的边界。同一时刻只能由一个线程使用
 class Buffer {
  public:
-  explicit Buffer(int initBuffSize = 1024);
-  ~Buffer() = default;
-  // 缓存区中可以写入的字节数
+  // 块的大小。读请求时一次最多读入 READ_MAX 字节，超出一个块时直接读入新的块
+  static constexpr size_t SLAB_SIZE = 16 * 1024;
+  // 短于该长度的外部数据直接复制，多一个 iovec 与引用计数的开销不如复制
+  static constexpr size_t EXTERNAL_MIN = 1024;
+
+  Buffer();
+  ~Buffer();
+  Buffer(const Buffer &) = delete;
+  auto operator=(const Buffer &) -> Buffer & = delete;
+
+  // 当前块中可以连续写入的字节数
   auto WritableBytes() const -> size_t;
   // 缓存区中可以读取的字节数
-  auto ReadableBytes() const -> size_t;
-  // 返回缓冲区前部（即读指针之前的部分）的空间大小，通常用于回退读指针。
-  auto PrependableBytes() const -> size_t;
-  // 返回一个指向当前读指针位置的常量指针，可以用来查看或读取缓冲区内容，但不移动读指针。
-  auto Peek() const -> const char *;
-  // 保证将数据写入缓冲区
+  auto ReadableBytes() const -> size_t { return readable_; }
+  // 上次释放读完的块以来读取的字节数
+  auto PrependableBytes() const -> size_t { return consumed_; }
+  // 返回指向可读数据起点的指针，其后 ReadableBytes() 字节连续。
+  // 数据分布在多个块中时先合并，因此不是 const；不移动读指针
+  auto Peek() -> const char *;
+  // 保证当前块中至少有 len 字节可以连续写入
   void EnsureWriteable(size_t len);
   // 更新写指针位置，用于表示已经向缓冲区成功写入了len字节的数据。
   void HasWritten(size_t len);
   // 移动读指针，用于表示已经处理了len字节的数据。
+  // 读完的块在下次写入缓冲区时才释放，此前读出的数据保持不变
   void Retrieve(size_t len);
   // 移动读指针直到end指定的位置，用于处理直到某个指定结束点的数据。
   void RetrieveUntil(const char *end);
-  // 清空缓冲区，将读写指针都重置为0，并将缓冲区内容清零。
+  // 清空缓冲区，立即释放所有块与外部数据的引用
   void RetrieveAll();
   // 将缓冲区中可读的数据转换为std::string，然后清空缓冲区。
   auto RetrieveAllToStr() -> std::string;
+  // 释放已读完的块；缓冲区为空时写入位置所在的块也一并归还，空闲的连接不占用块
+  void Shrink();
 
   // 返回一个指向当前写指针位置的指针，用于开始向缓冲区写入数据。
   auto BeginWriteConst() const -> const char *;
   auto BeginWrite() -> char *;
 
   // 将数据写入到缓冲区
-  // 向缓冲区追加数据，支持多种数据类型和来源。如果空间不足，会自动调整缓冲区大小以适应新增数据。
-  void Append(const std::string &str);
+  // 向缓冲区追加数据，当前块写满后继续写入新的块，数据可以跨块
+  void Append(std::string_view str);
   void Append(const char *str, size_t len);
   void Append(const void *data, size_t len);
   void Append(const Buffer &buff);
+  // 追加外部数据 [data, data + len)：不复制，由 owner 保证数据在缓冲区释放它之前有效
+  template <typename T>
+  void AppendExternal(const std::shared_ptr<T> &owner, const char *data, size_t len) {
+    if (len < EXTERNAL_MIN) {
+      Append(data, len);
+    } else {
+      AddExternal(owner, data, len);
+    }
+  }
+
+  // 从第 offset 个可读字节开始的 len 字节对应的 iovec，最多 max 个，返回个数
+  auto Gather(size_t offset, size_t len, struct iovec *iov, int max) const -> int;
+  // 可读数据分布在多少段(块或外部数据)中
+  auto SegmentCount() const -> int { return static_cast<int>(nodes_.size() - head_); }
 
   // IO操作的读与写接口
-  // 从文件描述符fd读取数据直接存入缓冲区，利用readv系统调用优化读取性能。如果读取的数据超出当前缓冲区可写空间，会自动扩展缓冲区并存储额外数据。
+  // 从文件描述符fd读取数据：用 readv 直接读入当前块的剩余空间与新取得的块，没用到的块立即归还
   auto ReadFd(int fd, int *Errno) -> ssize_t;
-  // 将缓冲区中的数据写入到文件描述符fd，更新读指针表示数据已经被发送。
+  // 将缓冲区中的数据用 writev 写入到文件描述符fd，更新读指针表示数据已经被发送。
   auto WriteFd(int fd, int *Errno) -> ssize_t;
 
  private:
-  // 返回指向缓冲区初始位置的指针
-  auto BeginPtr() -> char *;
-  auto BeginPtr() const -> const char *;
-  // 在需要写入更多数据时，如果当前可写空间不足，该方法用于扩展缓冲区或通过移动数据来释放足够的空间。
-  void AllocateSpace(size_t len);
+  // 块的头部，数据紧随其后
+  struct Slab;
+  // 每个线程缓存的空闲块
+  class SlabCache;
+
+  // 链中的一段可读数据：位于某个块中，或者是由 owner 持有的外部数据
+  struct Node {
+    const char *begin;
+    const char *end;
+    Slab *slab;
+    std::shared_ptr<const void> owner;
+  };
+
+  // 一次 readv 最多读入的字节数
+  static constexpr size_t READ_MAX = 64 * 1024;
+  static constexpr int READ_SLABS = READ_MAX / SLAB_SIZE;
+  // WriteFd 一次最多写出的段数
+  static constexpr int WRITE_IOV = 64;
+
+  // 从当前线程的缓存取得一个 SLAB_SIZE 的块，cap 更大时直接分配
+  static auto NewSlab(size_t cap) -> Slab *;
+  static void FreeSlab(Slab *slab);
+
+  void AddExternal(std::shared_ptr<const void> owner, const char *data, size_t len);
+  // 以 slab 作为新的写入块，释放对原写入块的引用
+  void SetWriteSlab(Slab *slab);
+  // 释放 head_ 之前已读完的段
+  void ReleaseConsumed();
+  void Unref(Slab *slab);
+  // 把所有可读数据复制到一个块中
+  void Linearize();
 
-  std::vector<char> buffer_;            // buffer的实体
-  std::atomic<std::size_t> read_pos_;   // 用于指示读指针
-  std::atomic<std::size_t> write_pos_;  // 用于指示写指针
+  // nodes_[head_] 起为未读完的段，之前的已读完、等待释放
+  std::vector<Node> nodes_;
+  size_t head_;
+  // 当前写入的块与其中的写入位置
+  Slab *write_slab_;
+  char *write_pos_;
+  size_t readable_;
+  size_t consumed_;
 };
-#endif  // BUFFER_H
\ No newline at end of file
+#endif  // BUFFER_H
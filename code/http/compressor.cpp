@@ -0,0 +1,172 @@
+#include "compressor.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "httpresponse.h"
+
+namespace {
+// 现存压缩结果的总大小。压缩结果可能在 Compressor 析构之后才随 FileCache 释放，因此不作为成员
+std::atomic<size_t> variant_bytes{0};
+}  // namespace
+
+auto Compressor::Instance() -> Compressor * {
+  static Compressor compressor;
+  return &compressor;
+}
+
+Compressor::Compressor() : stop_(false), budget_(DEFAULT_BUDGET) {
+  worker_ = std::thread([this] { Loop(); });
+}
+
+Compressor::~Compressor() {
+  {
+    std::lock_guard<std::mutex> locker(mtx_);
+    stop_ = true;
+  }
+  cond_.notify_one();
+  worker_.join();
+}
+
+auto Compressor::Gzip(const FileCache::EntryPtr &entry) -> FileCache::EntryPtr {
+  int state = entry->gzip_state.load(std::memory_order_acquire);
+  if (state == STATE_DONE) {
+    return std::atomic_load(&entry->gzip);
+  }
+  if (state != STATE_NONE || variant_bytes.load(std::memory_order_relaxed) >= budget_) {
+    return nullptr;
+  }
+  // 同一文件只提交一次
+  if (!entry->gzip_state.compare_exchange_strong(state, STATE_PENDING)) {
+    return nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> locker(mtx_);
+    if (queue_.size() < MAX_QUEUED) {
+      queue_.push_back(entry);
+      state = STATE_PENDING;
+    }
+  }
+  if (state == STATE_PENDING) {
+    cond_.notify_one();
+  } else {
+    entry->gzip_state.store(STATE_NONE, std::memory_order_release);
+  }
+  return nullptr;
+}
+
+void Compressor::Loop() {
+  std::string data;
+  while (true) {
+    FileCache::EntryPtr entry;
+    {
+      std::unique_lock<std::mutex> locker(mtx_);
+      cond_.wait(locker, [this] { return stop_ || !queue_.empty(); });
+      if (stop_) {
+        break;
+      }
+      entry = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    if (variant_bytes.load(std::memory_order_relaxed) >= budget_) {
+      // 预算已用完，等旧的压缩结果释放后再试
+      entry->gzip_state.store(STATE_NONE, std::memory_order_release);
+      continue;
+    }
+    FileCache::EntryPtr variant;
+    if (Deflate(*entry, &data)) {
+      variant = MakeVariant(*entry, data);
+    }
+    if (!variant) {
+      entry->gzip_state.store(STATE_SKIPPED, std::memory_order_release);
+      continue;
+    }
+    std::atomic_store(&entry->gzip, variant);
+    entry->gzip_state.store(STATE_DONE, std::memory_order_release);
+    LOG_DEBUG("gzip %zu -> %zu bytes", static_cast<size_t>(entry->st.st_size), data.size());
+  }
+}
+
+auto Compressor::Deflate(const FileCache::Entry &source, std::string *out) -> bool {
+  size_t size = source.st.st_size;
+  std::string buf;
+  const char *input = source.content.data();
+  if (source.map != nullptr) {
+    input = source.map;
+  } else if (source.fd >= 0) {
+    // sendfile 使用的 fd 由多个连接共用，用 pread 读取不影响其偏移
+    buf.resize(size);
+    size_t done = 0;
+    while (done < size) {
+      ssize_t len = pread(source.fd, &buf[done], size - done, done);
+      if (len <= 0) {
+        return false;
+      }
+      done += len;
+    }
+    input = buf.data();
+  }
+
+  z_stream stream = {};
+  // windowBits 加 16 生成 gzip 格式
+  if (deflateInit2(&stream, LEVEL, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  out->resize(deflateBound(&stream, size));
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input));
+  stream.avail_in = size;
+  stream.next_out = reinterpret_cast<Bytef *>(&(*out)[0]);
+  stream.avail_out = out->size();
+  int ret = deflate(&stream, Z_FINISH);
+  out->resize(stream.total_out);
+  deflateEnd(&stream);
+  return ret == Z_STREAM_END && out->size() < size * 9 / 10;
+}
+
+auto Compressor::MakeVariant(const FileCache::Entry &source, const std::string &data) -> FileCache::EntryPtr {
+  // 释放时从总大小中扣除
+  std::shared_ptr<FileCache::Entry> variant(new FileCache::Entry, [](FileCache::Entry *entry) {
+    variant_bytes.fetch_sub(entry->charge, std::memory_order_relaxed);
+    delete entry;
+  });
+  if (data.size() <= HttpResponse::INLINE_FILE_MAX) {
+    variant->content = data;
+  } else {
+    // 大的压缩结果放入 memfd，与磁盘上的大文件一样通过 sendfile 或内存映射发送
+    int fd = memfd_create("gzip", MFD_CLOEXEC);
+    if (fd < 0) {
+      return nullptr;
+    }
+    size_t done = 0;
+    while (done < data.size()) {
+      ssize_t len = write(fd, data.data() + done, data.size() - done);
+      if (len <= 0) {
+        close(fd);
+        return nullptr;
+      }
+      done += len;
+    }
+    if (HttpResponse::use_sendfile) {
+      variant->fd = fd;
+    } else {
+      void *mm_ret = mmap(nullptr, data.size(), PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (mm_ret == MAP_FAILED) {
+        return nullptr;
+      }
+      variant->map = static_cast<char *>(mm_ret);
+    }
+  }
+  variant->st = source.st;
+  variant->st.st_size = data.size();
+  variant->readable = true;
+  variant->type = source.type;
+  variant->last_modified = source.last_modified;
+  // 强 ETag 必须区分同一文件的不同编码
+  variant->etag = source.etag.substr(0, source.etag.size() - 1) + "-gzip\"";
+  variant->validators = "ETag: " + variant->etag + "\r\nLast-Modified: " + variant->last_modified + "\r\n";
+  variant->charge = sizeof(FileCache::Entry) + data.size();
+  variant_bytes.fetch_add(variant->charge, std::memory_order_relaxed);
+  return variant;
+}
@@ -0,0 +1,62 @@
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../log/log.h"
+#include "filecache.h"
+
+// 后台 gzip 压缩：没有预压缩文件的文本类文件在第一次被请求时提交到后台线程压缩一次，
+// 结果挂在 FileCache 的缓存项上，之后的请求直接发送压缩版本；压缩完成前仍发送原文件。
+// 压缩结果与原文件一样，小的保存在内存中，大的保存在 memfd 中，通过 sendfile 或内存映射发送。
+// 所有压缩结果的总大小不超过预算，超出时不再压缩新的文件，直到旧的随缓存项释放。
+class Compressor {
+ public:
+  static auto Instance() -> Compressor *;
+
+  // 返回 entry 的 gzip 版本。还没有时提交后台压缩并返回 nullptr，可在任意线程调用
+  auto Gzip(const FileCache::EntryPtr &entry) -> FileCache::EntryPtr;
+
+  // 调整所有压缩结果的总字节预算
+  void SetBudget(size_t bytes) { budget_ = bytes; }
+
+ private:
+  // FileCache::Entry::gzip_state 的取值
+  enum State {
+    STATE_NONE = 0,
+    // 已提交，等待压缩
+    STATE_PENDING,
+    // gzip 中为压缩结果
+    STATE_DONE,
+    // 压缩后没有明显变小或压缩失败，不再尝试
+    STATE_SKIPPED,
+  };
+
+  static constexpr size_t DEFAULT_BUDGET = 16 * 1024 * 1024;
+  // 等待压缩的文件数上限，超出时本次不提交，下次请求时再试
+  static constexpr size_t MAX_QUEUED = 256;
+  static constexpr int LEVEL = 6;
+
+  Compressor();
+  ~Compressor();
+
+  void Loop();
+  // 压缩 source 的内容，压缩后不小于原大小的 90% 时返回 false
+  static auto Deflate(const FileCache::Entry &source, std::string *out) -> bool;
+  // 由压缩结果生成缓存项：ETag 在原文件的基础上区分压缩版本，其余元数据与原文件相同
+  auto MakeVariant(const FileCache::Entry &source, const std::string &data) -> FileCache::EntryPtr;
+
+  std::mutex mtx_;
+  std::condition_variable cond_;
+  std::deque<FileCache::EntryPtr> queue_;
+  bool stop_;
+  std::atomic<size_t> budget_;
+  std::thread worker_;
+};
+
+#endif  // COMPRESSOR_H
@@ -0,0 +1,169 @@
+#ifndef CONST_TABLE_H
+#define CONST_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+template <typename K, typename V>
+struct ConstEntry {
+  K key{};
+  V value{};
+};
+
+// 编译期生成的完美哈希表，用于启动后不再变化的小型查找表(MIME 类型、状态行、默认页面等)。
+// 两级哈希：键的哈希先决定所在的桶，每个桶有一个位移，与哈希一起决定最终的槽位。
+// 构造时从键最多的桶开始，为每个桶找一个使桶内各键都落在空闲槽中的位移，
+// 查找只需计算一次键的哈希、读一个位移与一个槽、比较一次键，没有冲突链，也不分配内存。
+// 键为 std::string_view 或整数；值与键都只保存视图，须指向常量。
+// 构造失败(如有重复的键)或有键查不回自己时 Valid() 为 false，定义处用 static_assert 在编译时报错
+template <typename K, typename V, size_t N>
+class ConstTable {
+  // 槽中保存表项下标加 1
+  static_assert(N > 0 && N <= 255, "ConstTable holds at most 255 entries (uint8_t slots)");
+
+ public:
+  constexpr explicit ConstTable(const ConstEntry<K, V> (&entries)[N])
+      : entries_(), displace_(), slots_(), valid_(false), min_len_(SIZE_MAX), max_len_(0) {
+    uint64_t hashes[N] = {};
+    for (size_t i = 0; i < N; i++) {
+      entries_[i] = entries[i];
+      hashes[i] = Hash(entries[i].key);
+      if constexpr (std::is_same_v<K, std::string_view>) {
+        min_len_ = entries[i].key.size() < min_len_ ? entries[i].key.size() : min_len_;
+        max_len_ = entries[i].key.size() > max_len_ ? entries[i].key.size() : max_len_;
+      }
+    }
+    valid_ = Build(hashes) && RoundTrips();
+  }
+
+  constexpr auto Valid() const -> bool { return valid_; }
+  static constexpr auto Size() -> size_t { return N; }
+
+  // 返回 key 对应的值，不存在时返回 nullptr
+  constexpr auto Find(K key) const -> const V * {
+    if constexpr (std::is_same_v<K, std::string_view>) {
+      // 长度不在键的范围内时不必计算哈希，长路径也只需一次比较
+      if (key.size() < min_len_ || key.size() > max_len_) {
+        return nullptr;
+      }
+    }
+    uint64_t hash = Hash(key);
+    uint8_t index = slots_[Slot(hash, displace_[Bucket(hash)])];
+    if (index == 0 || !(entries_[index - 1].key == key)) {
+      return nullptr;
+    }
+    return &entries_[index - 1].value;
+  }
+
+ private:
+  static constexpr auto Bits(size_t n) -> size_t {
+    size_t bits = 1;
+    while ((size_t(1) << bits) < n) {
+      bits++;
+    }
+    return bits;
+  }
+  // 平均每桶约两个键；槽数不小于 2N，最后放置的桶也只需试几次
+  static constexpr size_t BUCKET_BITS = Bits((N + 1) / 2);
+  static constexpr size_t BUCKETS = size_t(1) << BUCKET_BITS;
+  static constexpr size_t SLOT_BITS = Bits(2 * N);
+  static constexpr size_t SLOTS = size_t(1) << SLOT_BITS;
+  static constexpr uint32_t MAX_DISPLACE = UINT16_MAX;
+  static constexpr uint64_t GOLDEN = 0x9E3779B97F4A7C15ULL;
+
+  // FNV-1a，表中的键都很短，逐字节处理即可。乘法把各字节的影响扩散到高位，桶号取高位
+  static constexpr auto Hash(std::string_view key) -> uint64_t {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char ch : key) {
+      hash ^= static_cast<unsigned char>(ch);
+      hash *= 1099511628211ULL;
+    }
+    return hash * GOLDEN;
+  }
+  static constexpr auto Hash(int64_t key) -> uint64_t { return static_cast<uint64_t>(key) * GOLDEN; }
+
+  static constexpr auto Bucket(uint64_t hash) -> size_t { return hash >> (64 - BUCKET_BITS); }
+  // 位移扰动哈希后再做一次乘法哈希。先把高位折叠到低位，只在高位不同的两个键也能被分开
+  static constexpr auto Slot(uint64_t hash, uint16_t displace) -> size_t {
+    uint64_t x = hash ^ (displace * GOLDEN);
+    x ^= x >> 29;
+    return (x * 0xBF58476D1CE4E5B9ULL) >> (64 - SLOT_BITS);
+  }
+
+  constexpr auto Build(const uint64_t (&hashes)[N]) -> bool {
+    size_t count[BUCKETS] = {};
+    size_t largest = 0;
+    for (size_t i = 0; i < N; i++) {
+      size_t bucket = Bucket(hashes[i]);
+      count[bucket]++;
+      largest = count[bucket] > largest ? count[bucket] : largest;
+    }
+    // 键多的桶约束多，先放
+    for (size_t size = largest; size > 0; size--) {
+      for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+        if (count[bucket] == size && !Place(hashes, bucket)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // 为桶找一个位移，使桶内各键落在互不相同的空闲槽中
+  constexpr auto Place(const uint64_t (&hashes)[N], size_t bucket) -> bool {
+    size_t keys[N] = {};
+    size_t size = 0;
+    for (size_t i = 0; i < N; i++) {
+      if (Bucket(hashes[i]) == bucket) {
+        keys[size++] = i;
+      }
+    }
+    for (uint32_t displace = 0; displace <= MAX_DISPLACE; displace++) {
+      size_t slots[N] = {};
+      bool fits = true;
+      for (size_t i = 0; i < size && fits; i++) {
+        slots[i] = Slot(hashes[keys[i]], static_cast<uint16_t>(displace));
+        fits = slots_[slots[i]] == 0;
+        for (size_t j = 0; j < i && fits; j++) {
+          fits = slots[j] != slots[i];
+        }
+      }
+      if (fits) {
+        displace_[bucket] = static_cast<uint16_t>(displace);
+        for (size_t i = 0; i < size; i++) {
+          slots_[slots[i]] = static_cast<uint8_t>(keys[i] + 1);
+        }
+        return true;
+      }
+    }
+    // 哈希完全相同的键(如重复的键)无法分开
+    return false;
+  }
+
+  constexpr auto RoundTrips() const -> bool {
+    for (size_t i = 0; i < N; i++) {
+      if (Find(entries_[i].key) != &entries_[i].value) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  ConstEntry<K, V> entries_[N];
+  uint16_t displace_[BUCKETS];
+  // 槽中保存 entries_ 的下标加 1，0 表示空
+  uint8_t slots_[SLOTS];
+  bool valid_;
+  size_t min_len_;
+  size_t max_len_;
+};
+
+// 由初始化列表生成表，表项数由列表推导：MakeConstTable<std::string_view, int>({{"a", 1}, {"b", 2}})
+template <typename K, typename V, size_t N>
+constexpr auto MakeConstTable(const ConstEntry<K, V> (&entries)[N]) -> ConstTable<K, V, N> {
+  return ConstTable<K, V, N>(entries);
+}
+
+#endif  // CONST_TABLE_H
@@ -0,0 +1,364 @@
+#include "filecache.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <ctime>
+#include <iterator>
+#include <vector>
+
+#include "httpresponse.h"
+
+FileCache::Entry::~Entry() {
+  if (map != nullptr) {
+    munmap(map, st.st_size);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+FileCache::FileCache() : shard_budget_(DEFAULT_BUDGET / SHARD_NUM), seq_(0) {
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (inotify_fd_ >= 0 && stop_fd_ >= 0) {
+    watcher_ = std::thread([this] { WatchLoop(); });
+  }
+  // 无法使用 inotify 时缓存仍然可用，只是文件改动后要等缓存项被淘汰才会生效
+}
+
+FileCache::~FileCache() {
+  if (watcher_.joinable()) {
+    uint64_t one = 1;
+    write(stop_fd_, &one, sizeof(one));
+    watcher_.join();
+  }
+  if (inotify_fd_ >= 0) {
+    close(inotify_fd_);
+  }
+  if (stop_fd_ >= 0) {
+    close(stop_fd_);
+  }
+}
+
+auto FileCache::Instance() -> FileCache * {
+  static FileCache cache;
+  return &cache;
+}
+
+auto FileCache::GetShard(const std::string &path) -> Shard & {
+  return shards_[std::hash<std::string>{}(path) % SHARD_NUM];
+}
+
+namespace {
+// 表示文件不存在的缓存项对调用方而言就是 nullptr
+auto Visible(FileCache::EntryPtr entry) -> FileCache::EntryPtr { return entry && entry->missing ? nullptr : entry; }
+}  // namespace
+
+auto FileCache::Get(const std::string &path) -> EntryPtr {
+  Shard &shard = GetShard(path);
+  std::unique_lock<std::mutex> locker(shard.mtx);
+  auto missing = shard.missing.find(path);
+  if (missing != shard.missing.end()) {
+    if (missing->second.expires > Clock::now()) {
+      return nullptr;
+    }
+    // 不存在的记录已过期，重新检查文件
+    EraseMissing(shard, missing);
+  }
+  auto it = shard.nodes.find(path);
+  if (it != shard.nodes.end()) {
+    Node &node = it->second;
+    if (node.entry) {
+      // 命中，移到 LRU 链表头部
+      shard.lru.splice(shard.lru.begin(), shard.lru, node.lru_it);
+      return Visible(node.entry);
+    }
+    // 其它线程正在加载同一文件，等待其结果
+    std::shared_future<EntryPtr> pending = node.pending;
+    locker.unlock();
+    return Visible(pending.get());
+  }
+
+  // 未命中：先占位，之后的并发请求会等待这次加载
+  std::promise<EntryPtr> promise;
+  uint64_t seq = ++seq_;
+  Node &node = shard.nodes[path];
+  node.pending = promise.get_future().share();
+  node.seq = seq;
+  locker.unlock();
+
+  // 先监视再加载，加载期间发生的改动也会使这次的结果失效
+  int wd = Watch(path);
+  EntryPtr entry = Load(path);
+  promise.set_value(entry);
+
+  locker.lock();
+  it = shard.nodes.find(path);
+  if (it == shard.nodes.end() || it->second.seq != seq) {
+    // 加载期间已被失效，结果只给本次请求使用
+    locker.unlock();
+    Unwatch(wd, path);
+    return Visible(entry);
+  }
+  if (!entry || entry->missing || entry->charge > shard_budget_) {
+    // 无法打开的文件与超出预算的文件不缓存，不存在的文件只记入不存在表
+    shard.nodes.erase(it);
+    if (entry) {
+      AddMissing(shard, path);
+    }
+    locker.unlock();
+    Unwatch(wd, path);
+    return Visible(entry);
+  }
+  it->second.entry = entry;
+  it->second.wd = wd;
+  it->second.pending = std::shared_future<EntryPtr>();
+  shard.lru.push_front(path);
+  it->second.lru_it = shard.lru.begin();
+  shard.bytes += entry->charge;
+  if (entry->fd >= 0) {
+    shard.fds++;
+  }
+  Evict(shard);
+  return Visible(entry);
+}
+
+void FileCache::Invalidate(const std::string &path) {
+  Shard &shard = GetShard(path);
+  std::lock_guard<std::mutex> locker(shard.mtx);
+  auto it = shard.nodes.find(path);
+  if (it != shard.nodes.end()) {
+    EraseLocked(shard, it);
+  }
+  auto missing = shard.missing.find(path);
+  if (missing != shard.missing.end()) {
+    EraseMissing(shard, missing);
+  }
+}
+
+void FileCache::SetBudget(size_t bytes) {
+  shard_budget_ = bytes / SHARD_NUM;
+  for (Shard &shard : shards_) {
+    std::lock_guard<std::mutex> locker(shard.mtx);
+    Evict(shard);
+  }
+}
+
+void FileCache::Evict(Shard &shard) {
+  while (shard.bytes > shard_budget_ && !shard.lru.empty()) {
+    EraseLocked(shard, shard.nodes.find(shard.lru.back()));
+  }
+  // fd 超出上限时从链表尾部找最久未使用的大文件，小文件不受影响
+  auto lru_it = shard.lru.end();
+  while (shard.fds > FD_MAX && lru_it != shard.lru.begin()) {
+    --lru_it;
+    auto it = shard.nodes.find(*lru_it);
+    if (it->second.entry->fd >= 0) {
+      lru_it = std::next(lru_it);
+      EraseLocked(shard, it);
+    }
+  }
+}
+
+void FileCache::EraseLocked(Shard &shard, std::unordered_map<std::string, Node>::iterator it) {
+  assert(it != shard.nodes.end());
+  // 仍在加载的节点直接删除，加载完成后发现序号不符便不会写回
+  if (it->second.entry) {
+    shard.bytes -= it->second.entry->charge;
+    if (it->second.entry->fd >= 0) {
+      shard.fds--;
+    }
+    shard.lru.erase(it->second.lru_it);
+    Unwatch(it->second.wd, it->first);
+  }
+  shard.nodes.erase(it);
+}
+
+void FileCache::AddMissing(Shard &shard, const std::string &path) {
+  auto now = Clock::now();
+  while (!shard.missing_order.empty()) {
+    auto oldest = shard.missing.find(shard.missing_order.front());
+    if (oldest->second.expires > now && shard.missing.size() < MISSING_MAX) {
+      break;
+    }
+    EraseMissing(shard, oldest);
+  }
+  // 同一路径的并发加载可能都走到这里，只保留一条
+  auto [it, inserted] = shard.missing.try_emplace(path);
+  if (!inserted) {
+    shard.missing_order.erase(it->second.order_it);
+  }
+  it->second.expires = now + MISSING_TTL;
+  it->second.order_it = shard.missing_order.insert(shard.missing_order.end(), path);
+}
+
+void FileCache::EraseMissing(Shard &shard, std::unordered_map<std::string, Missing>::iterator it) {
+  shard.missing_order.erase(it->second.order_it);
+  shard.missing.erase(it);
+}
+
+auto FileCache::Load(const std::string &path) -> EntryPtr {
+  auto entry = std::make_shared<Entry>();
+  entry->charge = sizeof(Entry) + path.size();
+  if (stat(path.data(), &entry->st) < 0) {
+    if (errno != ENOENT && errno != ENOTDIR) {
+      return nullptr;
+    }
+    entry->missing = true;
+    return entry;
+  }
+  // 目录与不可读的文件只缓存 stat 结果，由 HttpResponse 返回 404/403
+  if (!S_ISREG(entry->st.st_mode) || (entry->st.st_mode & S_IROTH) == 0U) {
+    return entry;
+  }
+  int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  size_t size = entry->st.st_size;
+  if (size <= HttpResponse::INLINE_FILE_MAX) {
+    // 小文件读入内存，之后每次响应只需一次拷贝
+    entry->content.resize(size);
+    size_t done = 0;
+    while (done < size) {
+      ssize_t len = pread(fd, &entry->content[done], size - done, done);
+      if (len <= 0) {
+        break;
+      }
+      done += len;
+    }
+    close(fd);
+    if (done != size) {
+      return nullptr;
+    }
+  } else if (HttpResponse::use_sendfile) {
+    // 大文件保持打开。sendfile 使用各自的偏移量，多个连接可以共用同一个 fd
+    entry->fd = fd;
+  } else {
+    void *mm_ret = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mm_ret == MAP_FAILED) {
+      return nullptr;
+    }
+    entry->map = static_cast<char *>(mm_ret);
+  }
+  entry->readable = true;
+  entry->type = HttpResponse::GetFileType(path);
+  // 文件被替换或修改后三者至少有一个改变，修改时间精确到纳秒
+  char buf[64];
+  uint64_t mtime_ns = entry->st.st_mtim.tv_sec * 1000000000ULL + entry->st.st_mtim.tv_nsec;
+  entry->etag.assign(buf, snprintf(buf, sizeof(buf), "\"%llx-%llx-%llx\"",
+                                   static_cast<unsigned long long>(entry->st.st_ino),
+                                   static_cast<unsigned long long>(size), static_cast<unsigned long long>(mtime_ns)));
+  struct tm tm {};
+  gmtime_r(&entry->st.st_mtime, &tm);
+  entry->last_modified.assign(buf, strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm));
+  entry->validators = "ETag: " + entry->etag + "\r\nLast-Modified: " + entry->last_modified + "\r\n";
+  entry->header = "Accept-Ranges: bytes\r\nContent-type: " + entry->type + "\r\n" +
+                  "Content-length: " + std::to_string(size) + "\r\n\r\n";
+  entry->compressible = size >= HttpResponse::COMPRESS_MIN && HttpResponse::IsCompressible(entry->type);
+  if (entry->compressible) {
+    entry->br_path = Sibling(path, entry->st, ".br");
+    entry->gz_path = Sibling(path, entry->st, ".gz");
+  }
+  // 只计入占用的内存：sendfile 的文件内容留在页缓存中，不占预算，打开的 fd 数另有上限
+  entry->charge += entry->content.size() + entry->header.size() + entry->validators.size() + entry->etag.size() +
+                   entry->last_modified.size() + entry->type.size() + entry->br_path.size() + entry->gz_path.size();
+  if (entry->map != nullptr) {
+    entry->charge += size;
+  }
+  return entry;
+}
+
+auto FileCache::Sibling(const std::string &path, const struct stat &st, const char *suffix) -> std::string {
+  std::string sibling = path + suffix;
+  struct stat sibling_st {};
+  if (stat(sibling.data(), &sibling_st) < 0 || !S_ISREG(sibling_st.st_mode) || sibling_st.st_mtime < st.st_mtime) {
+    return std::string();
+  }
+  return sibling;
+}
+
+auto FileCache::Watch(const std::string &path) -> int {
+  if (!watcher_.joinable()) {
+    return -1;
+  }
+  // 同一 inode 重复添加时返回相同的监视描述符。加锁后再添加，避免与 Unwatch 移除同一个监视交错
+  std::lock_guard<std::mutex> locker(watch_mtx_);
+  int wd = inotify_add_watch(inotify_fd_, path.data(),
+                             IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF);
+  if (wd >= 0) {
+    watches_[wd][path]++;
+  }
+  return wd;
+}
+
+void FileCache::Unwatch(int wd, const std::string &path) {
+  if (wd < 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> locker(watch_mtx_);
+  // 文件删除或移走后监视已由 WatchLoop 移除
+  auto it = watches_.find(wd);
+  if (it == watches_.end()) {
+    return;
+  }
+  auto path_it = it->second.find(path);
+  if (path_it != it->second.end() && --path_it->second == 0) {
+    it->second.erase(path_it);
+  }
+  if (it->second.empty()) {
+    inotify_rm_watch(inotify_fd_, wd);
+    watches_.erase(it);
+  }
+}
+
+void FileCache::WatchLoop() {
+  alignas(struct inotify_event) char buf[4096];
+  struct pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+  std::vector<std::string> paths;
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if ((fds[1].revents & POLLIN) != 0) {
+      break;
+    }
+    ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+    for (ssize_t off = 0; off < len;) {
+      const auto *event = reinterpret_cast<const struct inotify_event *>(buf + off);
+      off += sizeof(struct inotify_event) + event->len;
+      paths.clear();
+      {
+        std::lock_guard<std::mutex> locker(watch_mtx_);
+        auto it = watches_.find(event->wd);
+        if (it == watches_.end()) {
+          continue;
+        }
+        for (const auto &watched : it->second) {
+          paths.push_back(watched.first);
+        }
+        if ((event->mask & (IN_IGNORED | IN_MOVE_SELF)) != 0U) {
+          // 文件已删除或移走，监视随之结束；下次加载时为新文件重新添加
+          if ((event->mask & IN_MOVE_SELF) != 0U) {
+            inotify_rm_watch(inotify_fd_, event->wd);
+          }
+          watches_.erase(it);
+        }
+      }
+      for (const std::string &path : paths) {
+        Invalidate(path);
+      }
+    }
+  }
+}
@@ -0,0 +1,156 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// 进程级的静态文件缓存，以完整路径为键，所有 Reactor 与工作线程共享。
+// 缓存项保存 stat 结果、预先生成的 Content-type/Content-length 响应头，以及文件内容：
+// 小文件直接保存内容，大文件保存打开的 fd(sendfile) 或内存映射。
+// 缓存项通过 shared_ptr 引用计数，被淘汰或失效后，正在发送它的响应仍可安全使用。
+// 按哈希分片加锁，每个分片独立做按字节预算的 LRU 淘汰，保持打开的大文件另有数量上限；
+// 同一文件的并发未命中只由一个线程加载，其它线程等待结果；
+// 后台线程通过 inotify 监视已缓存的文件，文件被修改、删除或移动时使对应缓存项失效。
+// 不存在的路径另记在每个分片的小表中，只保留 MISSING_TTL，条数有上限，
+// 大量随机路径的 404 请求只会互相替换，不会淘汰已缓存的文件。
+class FileCache {
+ public:
+  struct Entry {
+    Entry() = default;
+    ~Entry();
+    Entry(const Entry &) = delete;
+    auto operator=(const Entry &) -> Entry & = delete;
+
+    struct stat st {};
+    // 文件不存在。加载结果只记入分片的不存在表，不进入 LRU，也不占字节预算
+    bool missing = false;
+    // 普通文件且其他用户可读时为 true，此时才有响应头与内容
+    bool readable = false;
+    // 完整响应(200)的 Accept-Ranges、Content-type、Content-length 与结束响应头的空行
+    std::string header;
+    // 200、206 与 304 响应共用的 ETag 与 Last-Modified 头部(压缩版本的 Vary 由 HttpResponse 添加)
+    std::string validators;
+    // 由 inode、大小与修改时间生成的强 ETag(含引号)，以及 HTTP 日期格式的修改时间
+    std::string etag;
+    std::string last_modified;
+    // MIME 类型，生成部分响应(206)的头部时使用
+    std::string type;
+    // 不超过 HttpResponse::INLINE_FILE_MAX 的文件内容
+    std::string content;
+    // 大文件：sendfile 使用的 fd，或映射到内存的地址
+    int fd = -1;
+    char *map = nullptr;
+    // 计入字节预算的大小：缓存项本身与其持有的内存(文件内容或映射)，不含 sendfile 的文件大小
+    size_t charge = 0;
+
+    // 文本类文件值得压缩，此时响应按 Accept-Encoding 选择版本
+    bool compressible = false;
+    // 加载时已存在的预压缩文件(同名加 .br、.gz 后缀)的完整路径，不存在时为空。
+    // 之后新增的预压缩文件要等本缓存项失效后才会被发现
+    std::string br_path;
+    std::string gz_path;
+    // 没有 .gz 文件时由 Compressor 在后台生成的 gzip 版本，随本缓存项一起释放
+    mutable std::atomic<int> gzip_state{0};
+    mutable std::shared_ptr<const Entry> gzip;
+  };
+  using EntryPtr = std::shared_ptr<const Entry>;
+
+  static auto Instance() -> FileCache *;
+
+  // 查找文件，未命中时加载。文件不存在或无法打开时返回 nullptr
+  auto Get(const std::string &path) -> EntryPtr;
+  // 使缓存项失效，下次访问时重新加载
+  void Invalidate(const std::string &path);
+
+  // 调整字节预算(所有分片之和)，超出部分立即淘汰
+  void SetBudget(size_t bytes);
+
+ private:
+  static constexpr int SHARD_NUM = 16;
+  static constexpr size_t DEFAULT_BUDGET = 64 * 1024 * 1024;
+  // 每个分片最多保持打开的大文件(sendfile)数
+  static constexpr size_t FD_MAX = 32;
+  // 不存在的文件无法用 inotify 监视，记录过期后才能发现新建的文件
+  static constexpr std::chrono::seconds MISSING_TTL{1};
+  // 每个分片最多记录的不存在路径数
+  static constexpr size_t MISSING_MAX = 256;
+
+  using Clock = std::chrono::steady_clock;
+
+  struct Node {
+    // 加载完成前 entry 为空，其它线程等待 pending
+    EntryPtr entry;
+    std::shared_future<EntryPtr> pending;
+    // 区分同一路径先后发起的加载，加载期间被失效的结果不会写回
+    uint64_t seq;
+    std::list<std::string>::iterator lru_it;
+    // 缓存项持有的 inotify 监视，没有时为 -1
+    int wd = -1;
+  };
+
+  struct Missing {
+    Clock::time_point expires;
+    std::list<std::string>::iterator order_it;
+  };
+
+  struct Shard {
+    std::mutex mtx;
+    std::unordered_map<std::string, Node> nodes;
+    // 最近使用的在前，只包含已加载完成的缓存项
+    std::list<std::string> lru;
+    size_t bytes = 0;
+    // 缓存项中打开的 fd 数
+    size_t fds = 0;
+    // 不存在的路径。TTL 相同，按加入顺序排列即按过期时间排列
+    std::unordered_map<std::string, Missing> missing;
+    std::list<std::string> missing_order;
+  };
+
+  FileCache();
+  ~FileCache();
+
+  auto GetShard(const std::string &path) -> Shard &;
+  // 从磁盘加载文件，不持有任何锁
+  static auto Load(const std::string &path) -> EntryPtr;
+  // 淘汰最久未使用的缓存项直到不超过预算，调用方持有分片锁
+  void Evict(Shard &shard);
+  void EraseLocked(Shard &shard, std::unordered_map<std::string, Node>::iterator it);
+  // 记录不存在的路径，先清除过期的记录，已满时替换最早的记录。调用方持有分片锁
+  static void AddMissing(Shard &shard, const std::string &path);
+  static void EraseMissing(Shard &shard, std::unordered_map<std::string, Missing>::iterator it);
+
+  // 预压缩文件存在且不比原文件旧时返回其路径
+  static auto Sibling(const std::string &path, const struct stat &st, const char *suffix) -> std::string;
+
+  // 为文件添加 inotify 监视并登记一次引用，返回监视描述符，失败时返回 -1
+  auto Watch(const std::string &path) -> int;
+  // 释放一次引用，监视描述符不再对应任何路径时移除监视
+  void Unwatch(int wd, const std::string &path);
+  // 后台线程：读取 inotify 事件并使对应缓存项失效
+  void WatchLoop();
+
+  Shard shards_[SHARD_NUM];
+  std::atomic<size_t> shard_budget_;
+  std::atomic<uint64_t> seq_;
+
+  int inotify_fd_;
+  // 用于通知后台线程退出
+  int stop_fd_;
+  std::mutex watch_mtx_;
+  // inotify 监视描述符到路径及其引用数的映射，同一 inode 的不同路径共用一个监视描述符。
+  // 引用由正在加载的线程持有，缓存后转交给缓存项，缓存项删除时释放
+  std::unordered_map<int, std::unordered_map<std::string, int>> watches_;
+  std::thread watcher_;
+};
+
+#endif  // FILE_CACHE_H
@@ -1,13 +1,33 @@
 #include "httpconn.h"
 
+#include <chrono>
+
 const char *HttpConn::src_dir;
 std::atomic<int> HttpConn::user_count;
+std::atomic<int> HttpConn::request_count;
 bool HttpConn::is_et;
+HttpConn::Deadlines HttpConn::deadlines = {10000, 60000, 10000, 30000, 10000, 1024, 10000};
+
+namespace {
+auto NowMs() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+}  // namespace
 
 HttpConn::HttpConn() {
   fd_ = -1;
   addr_ = {0};
   is_close_ = true;
+  iov_cnt_ = iov_idx_ = resp_cnt_ = 0;
+  to_write_ = 0;
+  waiting_ = waiting_keep_alive_ = false;
+  inflight_ = 0;
+  phase_ = PHASE_CONNECT;
+  phase_start_ms_ = progress_ms_ = 0;
+  phase_bytes_ = 0;
+  workers_ = 0;
+  close_pending_ = false;
 };
 
 HttpConn::~HttpConn() { Close(); };
@@ -19,19 +39,29 @@ void HttpConn::Init(int fd, const sockaddr_in &addr) {
   fd_ = fd;
   write_buff_.RetrieveAll();
   read_buff_.RetrieveAll();
+  request_.Init();
+  iov_cnt_ = iov_idx_ = 0;
+  to_write_ = 0;
+  waiting_ = false;
+  SetPhase(PHASE_CONNECT, NowMs());
   is_close_ = false;
-  // LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(),
-  // (int)userCount);
+  LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), user_count.load());
 }
 
 void HttpConn::Close() {
-  response_.UnmapFile();
+  for (int i = 0; i < resp_cnt_; i++) {
+    responses_[i].ReleaseFile();
+  }
+  resp_cnt_ = 0;
+  SetInflight(0);
+  // 连接槽位会被复用，关闭时就归还缓冲区的块
+  read_buff_.RetrieveAll();
+  write_buff_.RetrieveAll();
   if (!is_close_) {
     is_close_ = true;
     user_count--;
     close(fd_);
-    // LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(),
-    // (int)userCount);
+    LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), user_count.load());
   }
 }
 
@@ -64,66 +94,283 @@ auto HttpConn::Read(int *saveErrno) -> ssize_t {
     if (len <= 0) {
       break;
     }
-  } while (is_et);
+    AddProgress(len);
+    // 未处理的数据已够一个最大的请求，其余留在内核中，处理后再读
+  } while (is_et && read_buff_.ReadableBytes() < HttpRequest::MaxRequestSize());
   return len;
 }
 
 auto HttpConn::Write(int *saveErrno) -> ssize_t {
   ssize_t len = -1;
   do {
-    len = writev(fd_, iov_, iov_cnt_);
-    // 将 iov_ 数组中的数据写入到文件描述符 fd_ 中
+    if (file_fd_[iov_idx_] >= 0) {
+      // 文件块：由内核直接从页缓存发送到套接字
+      len = sendfile(fd_, file_fd_[iov_idx_], &file_off_[iov_idx_], iov_[iov_idx_].iov_len);
+    } else {
+      // 内存块：到下一个文件块为止的所有内存块一次性写入。后面紧跟文件块时带上 MSG_MORE，
+      // 让响应头与文件开头合并到同一个报文中
+      int end = iov_idx_;
+      while (end < iov_cnt_ && file_fd_[end] < 0) {
+        end++;
+      }
+      struct msghdr msg = {};
+      msg.msg_iov = iov_ + iov_idx_;
+      msg.msg_iovlen = end - iov_idx_;
+      len = sendmsg(fd_, &msg, end < iov_cnt_ ? MSG_MORE : 0);
+    }
     if (len <= 0) {
       *saveErrno = errno;
       break;
     }
 
-    // 以下为更新缓冲区及IOVEC
-    if (iov_[0].iov_len + iov_[1].iov_len == 0) {
+    // 以下为更新IOVEC
+    Consume(len);
+    if (ToWriteBytes() == 0) {
       break;
     } /* 传输结束 */
-    if (static_cast<size_t>(len) > iov_[0].iov_len) {
-      iov_[1].iov_base =
-          static_cast<uint8_t *>(iov_[1].iov_base) + (len - iov_[0].iov_len);
-      iov_[1].iov_len -= (len - iov_[0].iov_len);
-      if (iov_[0].iov_len != 0U) {
-        write_buff_.RetrieveAll();
-        iov_[0].iov_len = 0;
-      }
-    } else {
-      iov_[0].iov_base = static_cast<uint8_t *>(iov_[0].iov_base) + len;
-      iov_[0].iov_len -= len;
-      write_buff_.Retrieve(len);
-    }
   } while (is_et || ToWriteBytes() > 10240);
   return len;
 }
 
+void HttpConn::AppendRead(const char *data, size_t len) {
+  read_buff_.Append(data, len);
+  AddProgress(len);
+}
+
+void HttpConn::Consume(size_t len) {
+  // write_buff_ 在整批发送完时才清空，这里只推进 iov
+  assert(len <= to_write_);
+  to_write_ -= len;
+  AddProgress(len);
+  while (len > 0) {
+    struct iovec &iov = iov_[iov_idx_];
+    size_t n = std::min(len, iov.iov_len);
+    // 文件块的偏移已由 sendfile 推进
+    if (file_fd_[iov_idx_] < 0) {
+      iov.iov_base = static_cast<uint8_t *>(iov.iov_base) + n;
+    }
+    iov.iov_len -= n;
+    len -= n;
+    if (iov.iov_len == 0) {
+      iov_idx_++;
+    }
+  }
+  if (to_write_ == 0) {
+    // 本批响应发送完毕，归还写缓冲区的块，等待下一个请求
+    write_buff_.RetrieveAll();
+    SetPhase(PHASE_IDLE, NowMs());
+    SetInflight(0);
+  }
+}
+
 auto HttpConn::Process() -> bool {
-  request_.Init();
+  assert(ToWriteBytes() == 0 && !waiting_);
   if (read_buff_.ReadableBytes() <= 0) {
     return false;
   }
-  if (request_.Parse(read_buff_)) {
-    // LOG_DEBUG("%s", request_.Path().c_str());
-    response_.Init(src_dir, request_.Path(), request_.IsKeepAlive(), 200);
-  } else {
-    response_.Init(src_dir, request_.Path(), false, 400);
+  // 上一批响应已全部发出，释放其缓存文件与响应头
+  for (int i = 0; i < resp_cnt_; i++) {
+    responses_[i].ReleaseFile();
+  }
+  resp_cnt_ = 0;
+  write_buff_.RetrieveAll();
+  bool ready = ProcessBatch();
+  // 本批请求已处理完，读完的块不再被引用
+  read_buff_.Shrink();
+  UpdatePhase();
+  SetInflight(resp_cnt_ + (waiting_ ? 1 : 0));
+  return ready;
+}
+
+auto HttpConn::Resume(bool verified, int code) -> bool {
+  assert(waiting_);
+  waiting_ = false;
+  request_.SetVerified(verified);
+  HttpResponse &response = responses_[resp_cnt_];
+  response.Init(src_dir, request_.Path(), waiting_keep_alive_, code);
+  size_t before = write_buff_.ReadableBytes();
+  response.MakeResponse(write_buff_);
+  header_len_[resp_cnt_++] = write_buff_.ReadableBytes() - before;
+  bool ready = response.IsKeepAlive() ? ProcessBatch() : BuildIov();
+  read_buff_.Shrink();
+  UpdatePhase();
+  SetInflight(resp_cnt_ + (waiting_ ? 1 : 0));
+  return ready;
+}
+
+auto HttpConn::ProcessBatch() -> bool {
+  // 依次处理读缓冲区中所有完整的请求，响应头连续追加到 write_buff_
+  while (resp_cnt_ < MAX_PIPELINE && IovBound() + MAX_RESPONSE_IOV <= MAX_IOV) {
+    HttpRequest::HttpCode code = request_.Parse(read_buff_);
+    if (code == HttpRequest::NO_REQUEST) {
+      // 请求还不完整，解析状态保留在 request_ 中，等待后续数据
+      break;
+    }
+    if (code == HttpRequest::GET_REQUEST && request_.GetVerify() != HttpRequest::VERIFY_NONE) {
+      // 需要查询数据库，本批暂停在这里；之前的响应等查询完成后一起发送，保证响应顺序。
+      // 头部指向读缓冲区，等待期间可能失效，是否保持连接现在就要确定
+      waiting_ = true;
+      waiting_keep_alive_ = request_.IsKeepAlive();
+      return false;
+    }
+    HttpResponse &response = responses_[resp_cnt_];
+    if (code == HttpRequest::GET_REQUEST) {
+      LOG_DEBUG("%s", request_.Path().c_str());
+      response.Init(src_dir, request_.Path(), request_.IsKeepAlive(), 200);
+      if (request_.Method() == "GET") {
+        response.SetConditions({request_.GetHeader("If-None-Match"), request_.GetHeader("If-Modified-Since"),
+                                request_.GetHeader("Range"), request_.GetHeader("If-Range"),
+                                request_.GetHeader("Accept-Encoding")});
+      }
+    } else {
+      response.Init(src_dir, request_.Path(), false, request_.ErrorCode());
+    }
+    size_t before = write_buff_.ReadableBytes();
+    response.MakeResponse(write_buff_);
+    header_len_[resp_cnt_++] = write_buff_.ReadableBytes() - before;
+    if (!response.IsKeepAlive()) {
+      // 发送完这个响应后连接就会关闭，后面的请求不再处理
+      break;
+    }
   }
+  return BuildIov();
+}
 
-  response_.MakeResponse(write_buff_);
-  // 状态行+响应头 在缓冲区中
-  iov_[0].iov_base = const_cast<char *>(write_buff_.Peek());
-  iov_[0].iov_len = write_buff_.ReadableBytes();
-  iov_cnt_ = 1;
+auto HttpConn::BuildIov() -> bool {
+  if (resp_cnt_ == 0) {
+    return false;
+  }
 
-  // 映射到内存中的文件
-  if (response_.FileLen() > 0 && (response_.File() != nullptr)) {
-    iov_[1].iov_base = response_.File();
-    iov_[1].iov_len = response_.FileLen();
-    iov_cnt_ = 2;
+  // 所有响应生成后再按顺序建立 iov：每个响应在写缓冲区中的部分(状态行、响应头，内存中的文件内容)
+  // 被 sendfile 发送的文件段分隔开；写缓冲区中的部分又可能分布在多个块与外部数据中
+  iov_cnt_ = iov_idx_ = 0;
+  to_write_ = 0;
+  size_t base = 0;
+  for (int i = 0; i < resp_cnt_; i++) {
+    HttpResponse &response = responses_[i];
+    size_t done = 0;
+    for (int j = 0; j <= response.SegmentCount(); j++) {
+      size_t at = j < response.SegmentCount() ? response.GetSegment(j).at : header_len_[i];
+      if (at > done) {
+        AddBuffered(base + done, at - done);
+        done = at;
+      }
+      if (j < response.SegmentCount()) {
+        const HttpResponse::Segment &segment = response.GetSegment(j);
+        AddIov(nullptr, segment.len, response.FileFd(), segment.offset);
+      }
+    }
+    base += header_len_[i];
   }
-  // LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iov_cnt_,
-  // ToWriteBytes());
+  LOG_DEBUG("responses:%d, iov:%d, to write:%zu", resp_cnt_, iov_cnt_, to_write_);
   return true;
 }
+
+auto HttpConn::IovBound() const -> int {
+  // 每个文件段占一块，并可能把写缓冲区中的一段分成两块
+  int bound = write_buff_.SegmentCount() + resp_cnt_;
+  for (int i = 0; i < resp_cnt_; i++) {
+    bound += 2 * responses_[i].SegmentCount();
+  }
+  return bound;
+}
+
+void HttpConn::AddBuffered(size_t offset, size_t len) {
+  int cnt = write_buff_.Gather(offset, len, iov_ + iov_cnt_, MAX_IOV - iov_cnt_);
+  for (int i = iov_cnt_; i < iov_cnt_ + cnt; i++) {
+    file_fd_[i] = -1;
+    file_off_[i] = 0;
+    to_write_ += iov_[i].iov_len;
+    len -= iov_[i].iov_len;
+  }
+  iov_cnt_ += cnt;
+  assert(len == 0);
+}
+
+void HttpConn::AddIov(char *data, size_t len, int fd, off_t offset) {
+  assert(iov_cnt_ < MAX_IOV);
+  iov_[iov_cnt_].iov_base = data;
+  iov_[iov_cnt_].iov_len = len;
+  file_fd_[iov_cnt_] = fd;
+  file_off_[iov_cnt_] = offset;
+  iov_cnt_++;
+  to_write_ += len;
+}
+
+void HttpConn::SetPhase(Phase phase, int64_t now) {
+  phase_bytes_.store(0, std::memory_order_relaxed);
+  phase_start_ms_.store(now, std::memory_order_relaxed);
+  progress_ms_.store(now, std::memory_order_relaxed);
+  phase_.store(phase, std::memory_order_relaxed);
+}
+
+void HttpConn::AddProgress(size_t len) {
+  phase_bytes_.fetch_add(len, std::memory_order_relaxed);
+  progress_ms_.store(NowMs(), std::memory_order_relaxed);
+}
+
+void HttpConn::SetInflight(int inflight) {
+  if (inflight != inflight_) {
+    request_count.fetch_add(inflight - inflight_, std::memory_order_relaxed);
+    inflight_ = inflight;
+  }
+}
+
+void HttpConn::UpdatePhase() {
+  Phase phase = PHASE_IDLE;
+  if (to_write_ > 0) {
+    phase = PHASE_WRITE;
+  } else if (waiting_) {
+    phase = PHASE_WAIT;
+  } else if (request_.State() == HttpRequest::BODY) {
+    phase = PHASE_BODY;
+  } else if (read_buff_.ReadableBytes() > 0) {
+    // 请求的一部分已经到达
+    phase = PHASE_HEADER;
+  } else if (phase_.load(std::memory_order_relaxed) == PHASE_CONNECT) {
+    phase = PHASE_CONNECT;
+  }
+  // 同一阶段内不重新计时，一点点发送数据不能延长期限
+  if (phase != phase_.load(std::memory_order_relaxed)) {
+    SetPhase(phase, NowMs());
+  }
+}
+
+auto HttpConn::CheckDeadline() const -> int {
+  int64_t now = NowMs();
+  Phase phase = phase_.load(std::memory_order_relaxed);
+  int64_t start = phase_start_ms_.load(std::memory_order_relaxed);
+  int64_t deadline = 0;
+  switch (phase) {
+    case PHASE_CONNECT:
+      deadline = start + deadlines.first_byte_ms;
+      break;
+    case PHASE_IDLE:
+    case PHASE_WAIT:
+      deadline = start + deadlines.idle_ms;
+      break;
+    case PHASE_HEADER:
+      deadline = start + deadlines.header_ms;
+      break;
+    case PHASE_BODY:
+      deadline = start + deadlines.body_ms;
+      break;
+    case PHASE_WRITE:
+      deadline = progress_ms_.load(std::memory_order_relaxed) + deadlines.write_stall_ms;
+      break;
+  }
+  if ((phase == PHASE_BODY || phase == PHASE_WRITE) && deadlines.min_rate > 0) {
+    int64_t elapsed = now - start;
+    if (elapsed >= deadlines.min_rate_grace_ms) {
+      if (phase_bytes_.load(std::memory_order_relaxed) * 1000 < deadlines.min_rate * static_cast<uint64_t>(elapsed)) {
+        return -1;
+      }
+    } else {
+      deadline = std::min(deadline, start + deadlines.min_rate_grace_ms);
+    }
+  }
+  if (deadline <= now) {
+    return -1;
+  }
+  return static_cast<int>(deadline - now);
+}
@@ -2,20 +2,65 @@
 #define HTTP_CONN_H
 
 #include <arpa/inet.h>  // sockaddr_in
+#include <sys/sendfile.h>
 #include <sys/types.h>
 #include <sys/uio.h>  // readv/writev
 
+#include <array>
+#include <atomic>
 #include <cerrno>
+#include <cstdint>
 #include <cstdlib>  // atoi()
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
-#include "../pool/sqlconnRAII.h"
 #include "httprequest.h"
 #include "httpresponse.h"
 
 class HttpConn {
  public:
+  // 一次最多处理的流水线请求数量，其余请求留在读缓冲区，待本批响应发送完毕后再处理
+  static constexpr int MAX_PIPELINE = 16;
+  // 一个响应最多占用的数据块：多个范围时每个范围占用分隔头部与内容两块，另有响应头、结尾，
+  // 以及写缓冲区换块时多出的一块
+  static constexpr int MAX_RESPONSE_IOV = 2 * HttpResponse::MAX_RANGES + 4;
+  // 本批响应最多占用的数据块。普通响应通常占用响应头与文件内容两块，
+  // 剩余的块不够再容纳一个响应时，之后的请求留到下一批
+  static constexpr int MAX_IOV = 3 * MAX_PIPELINE + MAX_RESPONSE_IOV;
+
+  // 连接所处的阶段，每个阶段有各自的期限
+  enum Phase {
+    // 新连接等待第一个字节
+    PHASE_CONNECT = 0,
+    // 持久连接等待下一个请求
+    PHASE_IDLE,
+    // 接收请求行与头部
+    PHASE_HEADER,
+    // 接收请求体
+    PHASE_BODY,
+    // 等待数据库的验证结果
+    PHASE_WAIT,
+    // 发送响应
+    PHASE_WRITE,
+  };
+
+  // 各阶段的期限(毫秒)，均须大于 0
+  struct Deadlines {
+    // 新连接收到第一个字节
+    int first_byte_ms;
+    // 持久连接上两个请求之间的空闲，以及等待数据库的最长时间
+    int idle_ms;
+    // 从请求的第一个字节到头部接收完整
+    int header_ms;
+    // 从头部接收完整到请求体接收完整
+    int body_ms;
+    // 发送响应时没有任何进展
+    int write_stall_ms;
+    // 接收请求体与发送响应超过 min_rate_grace_ms 后，平均速率不得低于 min_rate(字节/秒)，为 0 时不限制
+    uint64_t min_rate;
+    int min_rate_grace_ms;
+  };
+
   HttpConn();
 
   ~HttpConn();
@@ -25,6 +70,13 @@ class HttpConn {
   auto Read(int *saveErrno) -> ssize_t;
   // 从缓冲区写入套接字
   auto Write(int *saveErrno) -> ssize_t;
+  // 追加已由外部(如 io_uring)接收到的数据
+  void AppendRead(const char *data, size_t len);
+  // 记录已发送 len 字节，更新 iov_
+  void Consume(size_t len);
+  // 尚未发送完的数据块，供外部 I/O 后端直接提交
+  auto GetIov() const -> const struct iovec * { return iov_ + iov_idx_; }
+  auto GetIovCnt() const -> int { return iov_cnt_ - iov_idx_; }
 
   void Close();
   // 获取套接字文件描述符
@@ -35,18 +87,50 @@ class HttpConn {
   auto GetIP() const -> const char *;
   // 获取客户端地址
   auto GetAddr() const -> sockaddr_in;
-  // 处理请求，生成响应
+  // 处理读缓冲区中所有完整的请求(最多 MAX_PIPELINE 个)，按顺序生成响应，
+  // 之后由一次 writev 统一发送。须在上一批响应发送完毕后调用
   auto Process() -> bool;
+  // 遇到登录、注册请求时处理暂停：Process 返回 false 且 IsWaiting() 为 true，
+  // 调用方按 GetRequest() 中的用户信息查询数据库后调用 Resume 继续处理，返回值含义与 Process 相同。
+  // code 不为 200 时(如数据库繁忙时的 503)以该状态码响应被暂停的请求
+  auto IsWaiting() const -> bool { return waiting_; }
+  auto GetRequest() const -> const HttpRequest & { return request_; }
+  auto Resume(bool verified, int code = 200) -> bool;
   // 返回需要写入套接字的字节数，用于检查是否需要继续写入数据
-  auto ToWriteBytes() -> int { return iov_[0].iov_len + iov_[1].iov_len; }
-  // 指示当前连接是否为持久连接
-  auto IsKeepAlive() const -> bool { return request_.IsKeepAlive(); }
+  auto ToWriteBytes() const -> size_t { return to_write_; }
+  // 发送响应期间收到的未处理数据超过一个请求的上限(只有外部 I/O 后端会持续接收)
+  auto ReadOverflow() const -> bool { return read_buff_.ReadableBytes() > HttpRequest::MaxRequestSize(); }
+  // 按所处阶段检查期限与最低速率：已超过时返回 -1，否则返回距离下一次需要检查还有多少毫秒。
+  // 由连接所属 Reactor 的定时器调用，可与处理连接的线程并发执行
+  auto CheckDeadline() const -> int;
+  auto GetPhase() const -> Phase { return phase_.load(std::memory_order_relaxed); }
+  // 指示当前连接是否为持久连接(以本批最后一个响应为准，请求字段在发送期间可能已失效)
+  auto IsKeepAlive() const -> bool { return resp_cnt_ > 0 && responses_[resp_cnt_ - 1].IsKeepAlive(); }
+  // 线程池模式下工作线程处理连接期间，Reactor 线程(定时器、对端关闭)不能释放连接的缓冲区与文件引用。
+  // 工作线程处理前后调用 EnterWorker/LeaveWorker；关闭连接时先让句柄失效，再调用 RequestClose。
+  // 返回 true 的一方调用 Close：没有工作线程在处理时是请求关闭的一方，否则是最后离开的工作线程。
+  // 两处栅栏保证：工作线程登记后仍看到有效的句柄时，让句柄失效的一方一定能看到它的登记
+  void EnterWorker() {
+    workers_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+  auto LeaveWorker() -> bool { return workers_.fetch_sub(1) == 1 && close_pending_.exchange(false); }
+  auto RequestClose() -> bool {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    close_pending_.store(true);
+    return workers_.load() == 0 && close_pending_.exchange(false);
+  }
   // 边缘触发
   static bool is_et;
   // 保存服务器资源目录的路径
   static const char *src_dir;
   // 记录连接到服务器的用户数量
   static std::atomic<int> user_count;
+  // 处理中的请求数：从请求被解析(或因查询数据库而暂停)到其响应发送完毕或连接关闭，
+  // 包括在数据库执行器中排队的请求，不包括空闲的持久连接
+  static std::atomic<int> request_count;
+  // 各阶段的期限
+  static Deadlines deadlines;
 
  private:
   int fd_;
@@ -56,14 +140,62 @@ class HttpConn {
   bool is_close_;
 
   int iov_cnt_;
-  // 用于向客户端（fd_）发送数据
-  struct iovec iov_[2];
+  // 第一个尚未发送完的数据块
+  int iov_idx_;
+  size_t to_write_;
+  // 用于向客户端（fd_）发送数据，依次为写缓冲区中的各段(响应头、内存中的文件内容)与 sendfile 发送的文件段
+  struct iovec iov_[MAX_IOV];
+  // 与 iov_ 一一对应：file_fd_[i] >= 0 表示第 i 块通过 sendfile 从该文件的 file_off_[i] 处发送，
+  // 此时 iov_[i] 只有 iov_len 有意义，表示剩余字节数
+  int file_fd_[MAX_IOV];
+  off_t file_off_[MAX_IOV];
 
   Buffer read_buff_;
+  // 本批所有响应的状态行、响应头与内存中的文件内容(以引用的形式)依次存放在这里，发送完即释放
   Buffer write_buff_;
 
   HttpRequest request_;
-  HttpResponse response_;
+  // 本批的响应，每个响应持有对各自缓存文件的引用
+  std::array<HttpResponse, MAX_PIPELINE> responses_;
+  int resp_cnt_;
+  // 每个响应在 write_buff_ 中的长度(状态行、响应头以及写入缓冲区的内容)
+  size_t header_len_[MAX_PIPELINE];
+  // 是否在等待数据库的验证结果，以及被暂停的请求是否保持连接
+  bool waiting_;
+  bool waiting_keep_alive_;
+  // 本连接计入 request_count 的请求数
+  int inflight_;
+
+  // 所处阶段、进入阶段的时刻、最近一次有进展的时刻(毫秒)，以及本阶段传输的字节数。
+  // 定时器在 Reactor 线程中读取，处理连接的线程写入
+  std::atomic<Phase> phase_;
+  std::atomic<int64_t> phase_start_ms_;
+  std::atomic<int64_t> progress_ms_;
+  std::atomic<uint64_t> phase_bytes_;
+
+  // 正在处理本连接的工作线程数，以及是否有尚未完成的关闭。
+  // Init 不重置：fd 被新连接复用时，上一个连接的工作线程可能还没有离开
+  std::atomic<int> workers_;
+  std::atomic<bool> close_pending_;
+
+  // 处理完读缓冲区或发送完响应后，按连接的状态确定所处阶段
+  void UpdatePhase();
+  // 更新本连接计入 request_count 的请求数
+  void SetInflight(int inflight);
+  void SetPhase(Phase phase, int64_t now);
+  // 记录本阶段传输了 len 字节
+  void AddProgress(size_t len);
+
+  // 继续解析读缓冲区中的请求并生成响应
+  auto ProcessBatch() -> bool;
+  // 按本批响应建立 iov_，没有响应时返回 false
+  auto BuildIov() -> bool;
+  // 已生成的响应最多占用的数据块
+  auto IovBound() const -> int;
+  // 添加写缓冲区中从 offset 开始的 len 字节，可能跨多个段
+  void AddBuffered(size_t offset, size_t len);
+  // 添加一个数据块，fd >= 0 时从该文件的 offset 处 sendfile
+  void AddIov(char *data, size_t len, int fd, off_t offset);
 };
 
 #endif  // HTTP_CONN_H
\ No newline at end of file
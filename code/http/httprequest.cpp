@@ -1,129 +1,310 @@
 #include "httprequest.h"
 
-const std::unordered_set<std::string> HttpRequest::DEFAULT_HTML{
-    "/index", "/register", "/login", "/welcome", "/video", "/picture",
-};
+#include <strings.h>
 
-const std::unordered_map<std::string, int> HttpRequest::DEFAULT_HTML_TAG{
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <cstring>
+
+#include "consttable.h"
+#include "httpscan.h"
+
+size_t HttpRequest::max_line = 8192;
+size_t HttpRequest::max_header = 16384;
+// 只接受表单提交，请求体很小
+size_t HttpRequest::max_body = 65536;
+
+namespace {
+// 不带后缀访问的页面，补全为对应的 .html 文件
+constexpr auto DEFAULT_HTML = MakeConstTable<std::string_view, std::string_view>({
+    {"/", "/index.html"},
+    {"/index", "/index.html"},
+    {"/register", "/register.html"},
+    {"/login", "/login.html"},
+    {"/welcome", "/welcome.html"},
+    {"/video", "/video.html"},
+    {"/picture", "/picture.html"},
+});
+static_assert(DEFAULT_HTML.Valid(), "DEFAULT_HTML has no perfect hash");
+
+// HTML 标签映射：需要验证用户的表单页面，0 为注册，1 为登录
+constexpr auto DEFAULT_HTML_TAG = MakeConstTable<std::string_view, int>({
     {"/register.html", 0},
     {"/login.html", 1},
-};
+});
+static_assert(DEFAULT_HTML_TAG.Valid(), "DEFAULT_HTML_TAG has no perfect hash");
+
+// 就地规范化请求路径('?' 之前的部分)：合并连续的 '/'，去掉 "." 段，".." 退回上一级且不超出根目录。
+// 同一文件的不同写法因此对应同一个缓存键，也不会访问资源目录之外的文件
+void NormalizePath(std::string &path) {
+  size_t end = std::min(path.find('?'), path.size());
+  std::string_view raw(path.data(), end);
+  if (raw.empty() || raw[0] != '/' || (raw.find("//") == std::string_view::npos &&
+                                       raw.find("/.") == std::string_view::npos)) {
+    return;
+  }
+  // [0, out) 为已规范化的部分，不含结尾的 '/'
+  size_t out = 0;
+  bool dir = false;
+  for (size_t i = 0; i < end;) {
+    size_t seg = i + 1;
+    size_t next = std::min(path.find('/', seg), end);
+    size_t len = next - seg;
+    if (len == 0 || (len == 1 && path[seg] == '.')) {
+      dir = true;
+    } else if (len == 2 && path[seg] == '.' && path[seg + 1] == '.') {
+      while (out > 0 && path[--out] != '/') {
+      }
+      dir = true;
+    } else {
+      path[out++] = '/';
+      memmove(&path[out], &path[seg], len);
+      out += len;
+      dir = false;
+    }
+    i = next;
+  }
+  if (dir || out == 0) {
+    path[out++] = '/';
+  }
+  path.erase(out, end - out);
+}
+
+// 不区分大小写比较，用于头部名称与 keep-alive、close 等取值
+auto EqualsIgnoreCase(std::string_view a, std::string_view b) -> bool {
+  return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+auto IsSpace(char ch) -> bool { return ch == ' ' || ch == '\t'; }
+}  // namespace
 
 void HttpRequest::Init() {
-  method_ = path_ = version_ = body_ = "";
+  path_.clear();
+  body_.clear();
   state_ = REQUEST_LINE;
-  header_.clear();
+  pos_ = scan_ = content_length_ = 0;
+  error_code_ = 400;
+  method_span_ = target_span_ = version_span_ = body_span_ = Span{0, 0};
+  base_ = "";
+  header_cnt_ = 0;
   post_.clear();
+  verify_ = VERIFY_NONE;
+}
+
+void HttpRequest::SetLimits(size_t maxLine, size_t maxHeader, size_t maxBody) {
+  assert(maxLine > 0 && maxHeader >= maxLine);
+  max_line = maxLine;
+  max_header = maxHeader;
+  max_body = maxBody;
 }
 
 auto HttpRequest::IsKeepAlive() const -> bool {
-  if (header_.count("Connection") == 1) {
-    return header_.find("Connection")->second == "keep-alive" &&
-           version_ == "1.1";
+  // HTTP/1.1 默认保持连接，HTTP/1.0 需要显式声明
+  std::string_view connection = GetHeader("Connection");
+  if (Version() == "1.1") {
+    return !EqualsIgnoreCase(connection, "close");
   }
-  return false;
+  return EqualsIgnoreCase(connection, "keep-alive");
 }
 
-auto HttpRequest::Parse(Buffer &buff) -> bool {
-  constexpr char crlf[] = "\r\n";
-  if (buff.ReadableBytes() <= 0) {
-    return false;
+auto HttpRequest::Parse(Buffer &buff) -> HttpCode {
+  if (state_ == FINISH) {
+    Init();
   }
-  while ((buff.ReadableBytes() != 0U) && state_ != FINISH) {
-    const char *line_end =
-        std::search(buff.Peek(), buff.BeginWriteConst(), crlf, crlf + 2);
-    std::string line(buff.Peek(), line_end);
+  if (state_ == REQUEST_LINE && pos_ == 0) {
+    // 忽略请求之间多余的空行
+    while (buff.ReadableBytes() > 0 && (*buff.Peek() == '\r' || *buff.Peek() == '\n')) {
+      buff.Retrieve(1);
+    }
+  }
+  // 缓冲区可能在两次调用之间扩容或搬移，字段一律以偏移保存，这里重新取起点
+  const char *begin = buff.Peek();
+  size_t size = buff.ReadableBytes();
+  base_ = begin;
+  Span line{};
+  while (state_ != FINISH) {
     switch (state_) {
       case REQUEST_LINE:
-        if (!ParseRequestLine(line)) {
-          return false;
+        if (!NextLine(begin, size, &line)) {
+          return size - pos_ > max_line ? Fail(buff, 414) : NO_REQUEST;
+        }
+        if (line.len > max_line) {
+          return Fail(buff, 414);
         }
-        ParsePath();
+        if (!ParseRequestLine(begin, line)) {
+          return Fail(buff, 400);
+        }
+        state_ = HEADERS;
         break;
-      case HEADERS:
-        ParseHeader(line);
-        if (buff.ReadableBytes() <= 2) {
-          state_ = FINISH;
+      case HEADERS: {
+        if (!NextLine(begin, size, &line)) {
+          return size > max_header || size - pos_ > max_line ? Fail(buff, 431) : NO_REQUEST;
+        }
+        if (pos_ > max_header) {
+          return Fail(buff, 431);
+        }
+        if (line.len == 0) {
+          // 空行，头部结束
+          if (!ParseContentLength()) {
+            return Fail(buff, 400);
+          }
+          // 在接收请求体之前拒绝，过大的请求体不会进入缓冲区
+          if (content_length_ > max_body) {
+            return Fail(buff, 413);
+          }
+          state_ = content_length_ > 0 ? BODY : FINISH;
+          break;
+        }
+        int code = ParseHeader(begin, line);
+        if (code != 0) {
+          return Fail(buff, code);
         }
         break;
+      }
       case BODY:
-        ParseBody(line);
+        if (size - pos_ < content_length_) {
+          return NO_REQUEST;
+        }
+        body_span_ = Span{static_cast<uint32_t>(pos_), static_cast<uint32_t>(content_length_)};
+        pos_ += content_length_;
+        state_ = FINISH;
         break;
       default:
         break;
     }
-    if (line_end == buff.BeginWrite()) {
-      break;
-    }
-    buff.RetrieveUntil(line_end + 2);  // 过滤\r\n
   }
-  // LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(),
-  // version_.c_str());
+  Finish(buff);
+  LOG_DEBUG("[%.*s], [%s], [%.*s]", static_cast<int>(Method().size()), Method().data(), path_.c_str(),
+            static_cast<int>(Version().size()), Version().data());
+  return GET_REQUEST;
+}
+
+auto HttpRequest::NextLine(const char *begin, size_t size, Span *line) -> bool {
+  // 只扫描上次之后新到达的数据
+  const char *lf = HttpScan::FindLf(begin + scan_, begin + size);
+  if (lf == begin + size) {
+    scan_ = size;
+    return false;
+  }
+  size_t end = lf - begin;
+  size_t len = end - pos_;
+  // 行尾为 \r\n，同时容忍单独的 \n
+  if (len > 0 && begin[end - 1] == '\r') {
+    len--;
+  }
+  *line = Span{static_cast<uint32_t>(pos_), static_cast<uint32_t>(len)};
+  pos_ = scan_ = end + 1;
   return true;
 }
 
+void HttpRequest::Finish(Buffer &buff) {
+  path_.assign(View(target_span_));
+  ParsePath();
+  if (body_span_.len > 0) {
+    body_.assign(View(body_span_));
+    ParsePost();
+  }
+  // 只移动读指针，请求的内存在下次写入缓冲区前保持不变
+  buff.Retrieve(pos_);
+}
+
+auto HttpRequest::Fail(Buffer &buff, int code) -> HttpCode {
+  LOG_WARN("Bad request: %d", code);
+  error_code_ = code;
+  state_ = FINISH;
+  buff.RetrieveAll();
+  return BAD_REQUEST;
+}
+
 void HttpRequest::ParsePath() {
-  if (path_ == "/") {
-    path_ = "/index.html";  // 默认访问
-  } else {
-    for (auto &item : DEFAULT_HTML) {
-      if (item == path_) {
-        path_ += ".html";
-        break;
-      }
-    }
+  NormalizePath(path_);
+  // "/" 默认访问 /index.html
+  if (const std::string_view *html = DEFAULT_HTML.Find(path_)) {
+    path_.assign(*html);
   }
 }
 
-auto HttpRequest:: ParseRequestLine(const std::string &line) -> bool {
-  std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-  //^ 表示匹配行的开头；
-  //([^ ]*)
-  // 表示匹配零个或多个非空格字符，用于捕获请求方法、请求路径和HTTP协议版本；
-  // HTTP/ 表示匹配字符串 "HTTP/"；
-  //([^ ]*)$ 表示匹配零个或多个非空格字符，并且匹配行的结尾。
-  // 类似GET /index.html HTTP/1.1
-
-  // std::smatch 对象可以存储多个匹配结果，并且提供了一些方法来访问这些匹配结果
-  // 使用 sub_match 对象的 operator[] 或 at() 方法来访问匹配结果的特定部分。
-  // 由(  )分隔子结果
-  // 分组是按照括号出现的顺序编号的，从1开始（整个正则表达式匹配的文本作为第0个分组）
-  std::smatch sub_match{};
-  if (regex_match(line, sub_match, patten)) {
-    method_ = sub_match[1];
-    path_ = sub_match[2];
-    version_ = sub_match[3];
-    state_ = HEADERS;
-    return true;
+auto HttpRequest::ParseRequestLine(const char *begin, Span line) -> bool {
+  // 类似GET /index.html HTTP/1.1，三部分以单个空格分隔
+  std::string_view text(begin + line.off, line.len);
+  const char *line_end = text.data() + text.size();
+  // 方法名必须由 token 字符组成，并紧跟一个空格
+  size_t method_end = HttpScan::SkipToken(text.data(), line_end) - text.data();
+  if (method_end == 0 || method_end == text.size() || text[method_end] != ' ') {
+    return false;
+  }
+  // 请求目标中允许出现 ':'，跳过后继续查找空格；遇到行内的 \r 视为非法
+  const char *target = HttpScan::FindDelim(text.data() + method_end + 1, line_end);
+  while (target < line_end && *target == ':') {
+    target = HttpScan::FindDelim(target + 1, line_end);
   }
-  // LOG_ERROR("RequestLine Error");
-  return false;
+  size_t target_end = target - text.data();
+  if (target == line_end || *target != ' ' || target_end == method_end + 1) {
+    return false;
+  }
+  std::string_view version = text.substr(target_end + 1);
+  constexpr std::string_view prefix = "HTTP/";
+  if (version.size() <= prefix.size() || version.substr(0, prefix.size()) != prefix ||
+      version.find(' ') != std::string_view::npos) {
+    return false;
+  }
+  method_span_ = Span{line.off, static_cast<uint32_t>(method_end)};
+  target_span_ = Span{static_cast<uint32_t>(line.off + method_end + 1),
+                      static_cast<uint32_t>(target_end - method_end - 1)};
+  version_span_ = Span{static_cast<uint32_t>(line.off + target_end + 1 + prefix.size()),
+                       static_cast<uint32_t>(version.size() - prefix.size())};
+  return true;
 }
 
-void HttpRequest::ParseHeader(const std::string &line) {
-  std::regex patten("^([^:]*): ?(.*)$");
-  std::smatch sub_match;
+auto HttpRequest::ParseHeader(const char *begin, Span line) -> int {
   // eg:Content-Type: application/json
-  if (regex_match(line, sub_match, patten)) {
-    header_[sub_match[1]] = sub_match[2];
-  } else {
-    state_ = BODY;
+  std::string_view text(begin + line.off, line.len);
+  // 名称由 token 字符组成且紧跟冒号，一次扫描同时完成校验与切分；
+  // 名称为空、名称与冒号之间有空白、以空白开头的折叠行都会在这里被拒绝
+  size_t colon = HttpScan::SkipToken(text.data(), text.data() + text.size()) - text.data();
+  if (colon == 0 || colon == text.size() || text[colon] != ':') {
+    return 400;
   }
-  // size_t pos = line.find(':');
-  // if (pos != std::string::npos) {
-  //   std::string key = line.substr(0, pos);
-  //   std::string value = line.substr(pos + 2);  // Skip ': ' after colon
-  //   header_[std::move(key)] = std::move(value);
-  // } else {
-  //   state_ = BODY;
-  // }
+  if (header_cnt_ == MAX_HEADERS) {
+    return 431;
+  }
+  size_t value_begin = colon + 1;
+  size_t value_end = text.size();
+  while (value_begin < value_end && IsSpace(text[value_begin])) {
+    value_begin++;
+  }
+  while (value_end > value_begin && IsSpace(text[value_end - 1])) {
+    value_end--;
+  }
+  headers_[header_cnt_++] = Header{Span{line.off, static_cast<uint32_t>(colon)},
+                                   Span{static_cast<uint32_t>(line.off + value_begin),
+                                        static_cast<uint32_t>(value_end - value_begin)}};
+  return 0;
 }
 
-void HttpRequest::ParseBody(const std::string &line) {
-  body_ = line;
-  ParsePost();
-  state_ = FINISH;
-  // LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+auto HttpRequest::ParseContentLength() -> bool {
+  content_length_ = 0;
+  // 不支持分块传输，拒绝以免与 Content-Length 的解释产生歧义
+  if (!GetHeader("Transfer-Encoding").empty()) {
+    return false;
+  }
+  std::string_view value = GetHeader("Content-Length");
+  if (value.empty()) {
+    return true;
+  }
+  const char *end = value.data() + value.size();
+  auto [ptr, ec] = std::from_chars(value.data(), end, content_length_);
+  return ec == std::errc() && ptr == end && content_length_ <= UINT32_MAX;
+}
+
+auto HttpRequest::GetHeader(std::string_view key) const -> std::string_view {
+  for (int i = 0; i < header_cnt_; i++) {
+    if (EqualsIgnoreCase(View(headers_[i].key), key)) {
+      return View(headers_[i].value);
+    }
+  }
+  return {};
 }
 
 auto HttpRequest::ConverHex(char ch) -> int {
@@ -143,19 +324,20 @@ void HttpRequest::ParsePost() {
   // multipart/form-data
   // 类型的请求，请求体内容通常是上传的文件数据，也需要进行相应的处理。
   // 此处只实现了 application/x-www-form-urlencoded  即注册和登录
-  if (method_ == "POST" &&
-      header_["Content-Type"] == "application/x-www-form-urlencoded") {
+  constexpr std::string_view urlencoded = "application/x-www-form-urlencoded";
+  if (Method() == "POST" && GetHeader("Content-Type").substr(0, urlencoded.size()) == urlencoded) {
     ParseFromUrlencoded();
-    if (DEFAULT_HTML_TAG.count(path_) != 0U) {
-      int tag = DEFAULT_HTML_TAG.find(path_)->second;
-      // LOG_DEBUG("Tag:%d", tag);
+    if (const int *found = DEFAULT_HTML_TAG.Find(path_)) {
+      int tag = *found;
+      LOG_DEBUG("Tag:%d", tag);
       if (tag == 0 || tag == 1) {
-        bool is_login = (tag == 1);
-        if (UserVerify(post_["username"], post_["password"], is_login)) {
-          path_ = "/welcome.html";
-          // 登陆（注册）成功，将路径重定向到欢迎页面（"/welcome.html"）
-        } else {
-          path_ = "/error.html";  // 登陆失败
+        // 这里不访问数据库，由事件循环异步查询后调用 SetVerified 给出结果。
+        // 用户名与密码拷贝出来，等待查询期间读缓冲区可能被改写
+        verify_user_ = post_["username"];
+        verify_password_ = post_["password"];
+        verify_ = tag == 1 ? VERIFY_LOGIN : VERIFY_REGISTER;
+        if (verify_user_.empty() || verify_password_.empty()) {
+          SetVerified(false);
         }
       }
     }
@@ -195,7 +377,6 @@ void HttpRequest::ParseFromUrlencoded() {
         value = body_.substr(j, i - j);
         j = i + 1;
         post_[key] = value;
-        // LOG_DEBUG("%s = %s", key.c_str(), value.c_str());
         break;
       default:
         break;
@@ -209,83 +390,19 @@ void HttpRequest::ParseFromUrlencoded() {
   }
 }
 
-auto HttpRequest::UserVerify(const std::string_view name,
-                             const std::string_view pwd,
-                             const bool isLogin) -> bool {
-  if (name.empty() || pwd.empty()) {
-    return false;
-  }
-  // LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-  MYSQL *sql;
-  SqlConnRAII sql_conn_raii(&sql, SqlConnPool::Instance());
-  assert(sql);
-
-  bool flag = false;
-  char order[256] = {};      // 存储查询语句
-  MYSQL_RES *res = nullptr;  // 查询结果集
-  [[maybe_unused]] unsigned int j = 0;
-  [[maybe_unused]] MYSQL_FIELD *fields = nullptr;  // 结果集中的字段
-
-  if (!isLogin) {
-    flag = true;
-  }
-  // 查询用户及密码
-  snprintf(order, 256,
-           "SELECT username, password FROM user WHERE username='%s' LIMIT 1",
-           name.data());
-  // snprintf将查询语句写入到order中
-  // LOG_DEBUG("%s", order);
-
-  if (mysql_query(sql, order) != 0) {
-    mysql_free_result(res);  // 查询失败则释放结果集并返回false
-    return false;
-  }
-  res = mysql_store_result(sql);     // 结果集--行
-  j = mysql_num_fields(res);         // 列数
-  fields = mysql_fetch_fields(res);  // (列)
-
-  while (MYSQL_ROW row = mysql_fetch_row(res)) {
-    // LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-    std::string_view password(row[1]);
-    // 登录
-    if (isLogin) {
-      flag = (pwd == password);
-      // if (!flag) {
-      //   // LOG_DEBUG("pwd error!");
-      // }
-      break;
-    }
-    flag = true;
-    // flag=false;
-    break;
-    //  LOG_DEBUG("user used!");
-  }
-  mysql_free_result(res);  // 释放结果集
-
-  // 注册行为 且 用户名未被使用
-  if (!isLogin && flag) {
-    // LOG_DEBUG("regirster!");
-    memset(order, 0, 256);
-    snprintf(order, 256,
-             "INSERT INTO user(username, password) VALUES('%s','%s')",
-             name.data(), pwd.data());
-    // LOG_DEBUG("%s", order);
-    if (mysql_query(sql, order) != 0) {
-      // LOG_DEBUG("Insert error!");
-      flag = false;
-    }
-  }
-  // SqlConnPool::Instance()->FreeConn(sql);  //RAII  通过sql_conn_raii释放
-  // LOG_DEBUG("UserVerify success!!");
-  return flag;
-}  // 注册or登录成功都返回true
+void HttpRequest::SetVerified(bool ok) {
+  assert(verify_ != VERIFY_NONE);
+  verify_ = VERIFY_NONE;
+  // 登陆（注册）成功，将路径重定向到欢迎页面，否则返回错误页面
+  path_ = ok ? "/welcome.html" : "/error.html";
+}
 
 auto HttpRequest::Path() const -> std::string { return path_; }
 
 auto HttpRequest::Path() -> std::string & { return path_; }
-auto HttpRequest::Method() const -> std::string { return method_; }
+auto HttpRequest::Method() const -> std::string_view { return View(method_span_); }
 
-auto HttpRequest::Version() const -> std::string { return version_; }
+auto HttpRequest::Version() const -> std::string_view { return View(version_span_); }
 
 auto HttpRequest::GetPost(const std::string &key) const -> std::string {
   assert(!key.empty());
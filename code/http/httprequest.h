@@ -1,19 +1,19 @@
 #ifndef HTTP_REQUEST_H
 #define HTTP_REQUEST_H
 
-#include <mysql/mysql.h>  //mysql
-
+#include <array>
 #include <cerrno>
-#include <regex>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
-#include "../pool/sqlconnRAII.h"
-#include "../pool/sqlconnpool.h"
 
+// 手写的 HTTP/1.1 请求解析状态机。
+// 解析过程中只记录各字段相对于请求起点的偏移，数据不足时保留状态，下次读到数据后从断点继续；
+// 请求完整后才把偏移转换成指向读缓冲区的 string_view，整个过程不拷贝、不分配内存。
 class HttpRequest {
  public:
   enum ParseState {
@@ -46,26 +46,60 @@ class HttpRequest {
     CLOSED_CONNECTION,
   };
 
+  // 请求是否需要查询数据库验证用户
+  enum VerifyKind {
+    VERIFY_NONE = 0,
+    // 注册
+    VERIFY_REGISTER,
+    // 登录
+    VERIFY_LOGIN,
+  };
+
+  // 单个请求最多保存的头部数量
+  static constexpr int MAX_HEADERS = 64;
+
   HttpRequest() { Init(); }
   ~HttpRequest() = default;
 
   void Init();
 
-  // 解析请求
-  auto Parse(Buffer &buff) -> bool;
+  // 解析请求。返回 NO_REQUEST 表示数据不完整，需要继续读取；
+  // GET_REQUEST 表示一个完整请求已解析完毕，其字节已从 buff 中取走；
+  // BAD_REQUEST 表示请求非法，具体状态码见 ErrorCode()。
+  // 头部、方法等 string_view 指向 buff 的内存，在下次向 buff 写入数据前有效。
+  auto Parse(Buffer &buff) -> HttpCode;
+
+  // 设置请求行长度上限、请求行加头部的总长度上限与请求体长度上限
+  static void SetLimits(size_t maxLine, size_t maxHeader, size_t maxBody);
+  // 单个请求的最大长度，读缓冲区中未处理的数据超过它时不再读取
+  static auto MaxRequestSize() -> size_t { return max_header + max_body; }
+
+  // 当前的解析状态，数据不完整时表示停在请求的哪一部分
+  auto State() const -> ParseState { return state_; }
 
   // 获取请求路径
   auto Path() const -> std::string;
   auto Path() -> std::string &;
   // 获取请求方法
-  auto Method() const -> std::string;
+  auto Method() const -> std::string_view;
   // HTTP版本
-  auto Version() const -> std::string;
+  auto Version() const -> std::string_view;
+  // 按名称查找请求头(不区分大小写)，不存在时返回空
+  auto GetHeader(std::string_view key) const -> std::string_view;
   // 获取POST请求参数值
   auto GetPost(const std::string &key) const -> std::string;
   auto GetPost(const char *key) const -> std::string;
   // 是否保留连接
   auto IsKeepAlive() const -> bool;
+  // 解析失败时应返回的状态码：400、413(请求体过大)、414(请求行过长)或 431(头部过大)
+  auto ErrorCode() const -> int { return error_code_; }
+
+  // 登录、注册请求解析完成后，需要先由调用方查询数据库，再通过 SetVerified 设置结果，
+  // 之后 Path() 才是最终要返回的页面
+  auto GetVerify() const -> VerifyKind { return verify_; }
+  auto VerifyUser() const -> const std::string & { return verify_user_; }
+  auto VerifyPassword() const -> const std::string & { return verify_password_; }
+  void SetVerified(bool ok);
 
   /*
     todo
@@ -74,12 +108,30 @@ class HttpRequest {
     */
 
  private:
+  // 请求中的一段数据，off 为相对请求起点的偏移
+  struct Span {
+    uint32_t off;
+    uint32_t len;
+  };
+  struct Header {
+    Span key;
+    Span value;
+  };
+
+  // 从 pos_ 开始查找一行，找到时通过 line 返回该行(不含行尾)并将 pos_ 移到下一行，
+  // 数据不足时返回 false
+  auto NextLine(const char *begin, size_t size, Span *line) -> bool;
   // 解析请求行
-  auto ParseRequestLine(const std::string &line) -> bool;
-  // 解析请求头部信息
-  void ParseHeader(const std::string &line);
-  // 解析请求体
-  void ParseBody(const std::string &line);
+  auto ParseRequestLine(const char *begin, Span line) -> bool;
+  // 解析请求头部信息，成功返回 0，否则返回应答的错误状态码
+  auto ParseHeader(const char *begin, Span line) -> int;
+  // 头部解析完毕，根据 Content-Length 决定是否需要读取请求体
+  auto ParseContentLength() -> bool;
+  // 请求完整：生成路径、处理请求体并从缓冲区取走请求
+  void Finish(Buffer &buff);
+  // 解析失败：记录状态码并丢弃缓冲区中的数据
+  auto Fail(Buffer &buff, int code) -> HttpCode;
+  auto View(Span span) const -> std::string_view { return {base_ + span.off, span.len}; }
   // 解析请求路径
   void ParsePath();
   // 解析POST请求内容
@@ -87,19 +139,33 @@ class HttpRequest {
   // 解析 application/x-www-form-urlencoded 格式的数据，并将解析结果保存到
   // post_ 成员变量中。
   void ParseFromUrlencoded();
-  // 验证用户信息，根据参数 isLogin 的值来区分是登录验证还是注册验证。
-  static auto UserVerify(std::string_view name, std::string_view pwd,
-                         bool isLogin) -> bool;
 
   ParseState state_;
-  std::string method_, path_, version_, body_;
-  // 保存请求头部和 POST 请求的键值对信息
-  std::unordered_map<std::string, std::string> header_;
+  // 已解析到的位置(相对请求起点)，数据不足时下次从这里继续
+  size_t pos_;
+  // 上次查找行尾停下的位置，避免重复扫描半行数据
+  size_t scan_;
+  size_t content_length_;
+  int error_code_;
+  Span method_span_, target_span_, version_span_, body_span_;
+  // 指向读缓冲区中的请求起点，每次调用 Parse 时更新
+  const char *base_;
+
+  // path_ 会被改写(补全 .html、登录跳转)，因此单独保存；其容量在请求间复用
+  std::string path_, body_;
+  // 头部保存在定长数组中，按顺序线性查找，头部数量很少时比哈希表更快
+  std::array<Header, MAX_HEADERS> headers_;
+  int header_cnt_;
+  // 保存 POST 请求的键值对信息
   std::unordered_map<std::string, std::string> post_;
+  // 待验证的用户信息
+  VerifyKind verify_;
+  std::string verify_user_, verify_password_;
+
+  static size_t max_line;
+  static size_t max_header;
+  static size_t max_body;
 
-  static const std::unordered_set<std::string> DEFAULT_HTML;
-  // HTML 标签映射
-  static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
   // 将十六进制字符转换为整数
   static auto ConverHex(char ch) -> int;
 };
@@ -1,115 +1,334 @@
 #include "httpresponse.h"
 
-const std::unordered_map<std::string, std::string> HttpResponse::SUFFIX_TYPE = {
+#include <strings.h>
+
+#include <algorithm>
+#include <charconv>
+#include <ctime>
+#include <random>
+
+#include "compressor.h"
+#include "consttable.h"
+
+bool HttpResponse::use_sendfile = true;
+std::vector<std::pair<std::string, std::string>> HttpResponse::cache_control;
+
+const std::string HttpResponse::BOUNDARY = [] {
+  std::random_device rd;
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%08x%08x", rd(), rd());
+  return std::string(buf);
+}();
+
+namespace {
+// 以十进制写入 value，不经过临时字符串
+void AppendNumber(Buffer &buff, uint64_t value) {
+  char buf[20];
+  auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+  buff.Append(buf, end - buf);
+}
+
+// value 的十进制位数，用于预先计算响应体长度
+auto NumberLength(uint64_t value) -> size_t {
+  size_t len = 1;
+  while (value >= 10) {
+    value /= 10;
+    len++;
+  }
+  return len;
+}
+
+// 当前时间的 Date 头部(含行尾)。每个线程每秒只格式化一次
+auto DateHeader() -> std::string_view {
+  thread_local time_t cached = -1;
+  thread_local char line[64];
+  thread_local size_t len = 0;
+  time_t now = time(nullptr);
+  if (now != cached) {
+    struct tm tm {};
+    gmtime_r(&now, &tm);
+    len = strftime(line, sizeof(line), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+    cached = now;
+  }
+  return {line, len};
+}
+
+// 状态行 "HTTP/1.1 200 OK\r\n" 中的原因短语
+auto Reason(std::string_view line) -> std::string_view { return line.substr(13, line.size() - 15); }
+
+// 解析整个字符串为十进制非负整数，溢出或包含其它字符时返回 false
+auto ParseNumber(std::string_view str, uint64_t *value) -> bool {
+  if (str.empty()) {
+    return false;
+  }
+  auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), *value);
+  return ec == std::errc() && ptr == str.data() + str.size();
+}
+
+// 去掉两端的空格与制表符
+auto TrimSpace(std::string_view str) -> std::string_view {
+  while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+// If-None-Match 中的实体标签是否包含 etag，使用弱比较(忽略 W/ 前缀)
+auto MatchEtag(std::string_view list, std::string_view etag) -> bool {
+  while (!list.empty()) {
+    size_t comma = list.find(',');
+    std::string_view tag = TrimSpace(list.substr(0, comma));
+    list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    if (tag == "*") {
+      return true;
+    }
+    if (tag.size() > 2 && tag[0] == 'W' && tag[1] == '/') {
+      tag.remove_prefix(2);
+    }
+    if (tag == etag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Accept-Encoding 是否接受 coding：按名称查找(不区分大小写)，q=0 表示不接受
+auto AcceptsEncoding(std::string_view list, std::string_view coding) -> bool {
+  while (!list.empty()) {
+    size_t comma = list.find(',');
+    std::string_view item = list.substr(0, comma);
+    list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    size_t semi = item.find(';');
+    std::string_view name = TrimSpace(item.substr(0, semi));
+    if (name.size() != coding.size() || strncasecmp(name.data(), coding.data(), name.size()) != 0) {
+      continue;
+    }
+    if (semi == std::string_view::npos) {
+      return true;
+    }
+    std::string_view param = TrimSpace(item.substr(semi + 1));
+    if (param.size() < 2 || (param[0] != 'q' && param[0] != 'Q') || param[1] != '=') {
+      return true;
+    }
+    // q=0、q=0.0 等
+    return param.find_first_not_of("0.", 2) != std::string_view::npos;
+  }
+  return false;
+}
+
+// 解析 IMF-fixdate 格式的 HTTP 日期，失败时返回 -1
+auto ParseHttpDate(std::string_view date) -> time_t {
+  char buf[64];
+  if (date.size() >= sizeof(buf)) {
+    return -1;
+  }
+  date.copy(buf, date.size());
+  buf[date.size()] = '\0';
+  struct tm tm {};
+  const char *end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  if (end == nullptr || *end != '\0') {
+    return -1;
+  }
+  return timegm(&tm);
+}
+
+constexpr std::string_view CONTENT_RANGE = "Content-Range: bytes ";
+
+// 写入 Content-Range 头部
+void AppendContentRange(Buffer &buff, uint64_t offset, uint64_t len, uint64_t size) {
+  buff.Append(CONTENT_RANGE);
+  AppendNumber(buff, offset);
+  buff.Append("-");
+  AppendNumber(buff, offset + len - 1);
+  buff.Append("/");
+  AppendNumber(buff, size);
+  buff.Append("\r\n");
+}
+
+auto ContentRangeLength(uint64_t offset, uint64_t len, uint64_t size) -> size_t {
+  return CONTENT_RANGE.size() + NumberLength(offset) + 1 + NumberLength(offset + len - 1) + 1 + NumberLength(size) + 2;
+}
+
+// 文件后缀名到MIME类型的映射，用于在HTTP响应中指定正确的Content-Type。
+// 以下几个表都是编译期生成的完美哈希表，查找时只计算一次哈希
+constexpr auto SUFFIX_TYPE = MakeConstTable<std::string_view, std::string_view>({
     {".html", "text/html"},
+    {".htm", "text/html"},
     {".xml", "text/xml"},
     {".xhtml", "application/xhtml+xml"},
     {".txt", "text/plain"},
+    {".md", "text/markdown"},
+    {".csv", "text/csv"},
+    {".css", "text/css"},
+    {".js", "text/javascript"},
+    {".mjs", "text/javascript"},
+    {".json", "application/json"},
+    {".map", "application/json"},
+    {".wasm", "application/wasm"},
     {".rtf", "application/rtf"},
     {".pdf", "application/pdf"},
-    {".word", "application/nsword"},
+    {".word", "application/msword"},
+    {".doc", "application/msword"},
     {".png", "image/png"},
     {".gif", "image/gif"},
     {".jpg", "image/jpeg"},
     {".jpeg", "image/jpeg"},
+    {".bmp", "image/bmp"},
+    {".webp", "image/webp"},
+    {".avif", "image/avif"},
+    {".svg", "image/svg+xml"},
+    {".ico", "image/x-icon"},
+    {".woff", "font/woff"},
+    {".woff2", "font/woff2"},
+    {".ttf", "font/ttf"},
+    {".otf", "font/otf"},
+    {".eot", "application/vnd.ms-fontobject"},
     {".au", "audio/basic"},
+    {".mp3", "audio/mpeg"},
+    {".wav", "audio/wav"},
+    {".oga", "audio/ogg"},
     {".mpeg", "video/mpeg"},
     {".mpg", "video/mpeg"},
     {".avi", "video/x-msvideo"},
+    {".mp4", "video/mp4"},
+    {".webm", "video/webm"},
+    {".ogv", "video/ogg"},
     {".gz", "application/x-gzip"},
     {".tar", "application/x-tar"},
-    {".css", "text/css "},
-    {".js", "text/javascript "},
-};
+    {".zip", "application/zip"},
+});
+static_assert(SUFFIX_TYPE.Valid(), "SUFFIX_TYPE has no perfect hash");
 
-const std::unordered_map<int, std::string> HttpResponse::CODE_STATUS = {
-    {200, "OK"},
-    {400, "Bad Request"},
-    {403, "Forbidden"},
-    {404, "Not Found"},
-};
+// HTTP状态码到完整状态行(含行尾)的映射，原因短语从中截取
+constexpr auto CODE_STATUS = MakeConstTable<int, std::string_view>({
+    {200, "HTTP/1.1 200 OK\r\n"},
+    {206, "HTTP/1.1 206 Partial Content\r\n"},
+    {304, "HTTP/1.1 304 Not Modified\r\n"},
+    {400, "HTTP/1.1 400 Bad Request\r\n"},
+    {403, "HTTP/1.1 403 Forbidden\r\n"},
+    {404, "HTTP/1.1 404 Not Found\r\n"},
+    {413, "HTTP/1.1 413 Payload Too Large\r\n"},
+    {414, "HTTP/1.1 414 URI Too Long\r\n"},
+    {416, "HTTP/1.1 416 Range Not Satisfiable\r\n"},
+    {431, "HTTP/1.1 431 Request Header Fields Too Large\r\n"},
+    {503, "HTTP/1.1 503 Service Unavailable\r\n"},
+});
+static_assert(CODE_STATUS.Valid(), "CODE_STATUS has no perfect hash");
 
-const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
+// 特定状态码对应的错误页面路径的映射
+constexpr auto CODE_PATH = MakeConstTable<int, std::string_view>({
     {400, "/400.html"},
     {403, "/403.html"},
     {404, "/404.html"},
-};
+    {413, "/400.html"},
+    {414, "/400.html"},
+    {431, "/400.html"},
+});
+static_assert(CODE_PATH.Valid(), "CODE_PATH has no perfect hash");
+}  // namespace
 
 HttpResponse::HttpResponse() {
   code_ = -1;
   path_ = src_dir_ = "";
   is_keep_alive_ = false;
-  mm_file_ = nullptr;
-  mm_file_stat_ = {0};
+  vary_ = false;
+  encoding_ = nullptr;
+  start_ = 0;
+  range_cnt_ = segment_cnt_ = 0;
 };
 
-HttpResponse::~HttpResponse() { UnmapFile(); }
+HttpResponse::~HttpResponse() { ReleaseFile(); }
 
-void HttpResponse::Init(const std::string &srcDir, std::string &path,
-                        bool isKeepAlive, int code) {
+void HttpResponse::Init(std::string_view srcDir, std::string_view path, bool isKeepAlive, int code) {
   assert(!srcDir.empty());
-  if (mm_file_ != nullptr) {
-    UnmapFile();
-  }
+  ReleaseFile();
   code_ = code;
   is_keep_alive_ = isKeepAlive;
-  path_ = path;
-  src_dir_ = srcDir;
-  mm_file_ = nullptr;
-  mm_file_stat_ = {0};
+  // 容量在请求之间复用
+  path_.assign(path);
+  src_dir_.assign(srcDir);
+  conditions_ = Conditions();
 }
 
-void HttpResponse::MakeResponse(Buffer &buff) {
-  // extern int stat(const char *__restrict __file, struct stat *__restrict
-  // __buf) noexcept(true) 用于获取文件或文件系统状态信息的系统调用
-  // 这个函数接受两个参数：一个是文件路径名
-  // const char *__restrict
-  // __file:表示要查询状态的文件的路径名。通常这个参数是一个字符串，指向要获取状态信息的文件路径
-  // 另一个是用于存储状态信息的结构体指针
-  // struct stat *__restrict __buf: 是一个指向 struct stat
-  // 类型的指针，用于存储获取到的文件状态信息
-  // 函数会把文件或文件系统的相关信息填充到传入的结构体中。
-  // 调用成功，返回值是 0，否则返回 -1
+void HttpResponse::SetConditions(const Conditions &conditions) { conditions_ = conditions; }
+
+void HttpResponse::AddCacheControl(const std::string &prefix, const std::string &value) {
+  cache_control.emplace_back(prefix, "Cache-Control: " + value + "\r\n");
+  std::stable_sort(cache_control.begin(), cache_control.end(),
+                   [](const auto &a, const auto &b) { return a.first.size() > b.first.size(); });
+}
 
+void HttpResponse::MakeResponse(Buffer &buff) {
+  start_ = buff.ReadableBytes();
+  range_cnt_ = segment_cnt_ = 0;
+  vary_ = false;
+  encoding_ = nullptr;
   /* 判断请求的资源文件 */
-  if (stat((src_dir_ + path_).data(), &mm_file_stat_) < 0 ||
-      S_ISDIR(mm_file_stat_.st_mode)) {
-    code_ = 404;  // 如果 stat 函数执行失败（返回值小于 0）或者文件是一个目录
-  } else if ((mm_file_stat_.st_mode & S_IROTH) == 0U) {
-    // S_IROTH 表示其他用户（非文件所有者和文件所在组）的读取权限。
-    code_ = 403;  // 文件存在但不可读
-  } else if (code_ == -1) {
-    code_ = 200;  // 在调用 MakeResponse 之前没有设置响应码 默认200
+  // 文件的 stat 结果来自 FileCache，命中时不需要任何系统调用
+  // 状态码 >= 400 是请求解析阶段已确定的错误，直接返回对应的错误页面
+  if (code_ < 400) {
+    LoadFile();
+    if (!file_ || S_ISDIR(file_->st.st_mode)) {
+      code_ = 404;  // 如果文件不存在或者文件是一个目录
+    } else if ((file_->st.st_mode & S_IROTH) == 0U) {
+      // S_IROTH 表示其他用户（非文件所有者和文件所在组）的读取权限。
+      code_ = 403;  // 文件存在但不可读
+    } else if (code_ == -1) {
+      code_ = 200;  // 在调用 MakeResponse 之前没有设置响应码 默认200
+    }
+  }
+  // 先选择编码，再判断客户端缓存的该编码版本是否有效，最后处理范围。
+  // 范围请求总是针对原文件
+  if (code_ == 200) {
+    vary_ = file_->compressible;
+    if (conditions_.range.empty()) {
+      SelectEncoding();
+    }
   }
+  if (code_ == 200 && NotModified()) {
+    code_ = 304;
+  } else if (code_ == 200 && !conditions_.range.empty()) {
+    ParseRange();
+  }
+  conditions_ = Conditions();
   ErrorHtml();
   AddStateLine(buff);
   AddHeader(buff);
-  AddContent(buff);
+  if (code_ == 206) {
+    AddRangeContent(buff);
+  } else {
+    AddContent(buff);
+  }
 }
 
-auto HttpResponse::File() -> char * { return mm_file_; }
+auto HttpResponse::FileLen() const -> size_t { return file_ ? file_->st.st_size : 0; }
 
-auto HttpResponse::FileLen() const -> size_t { return mm_file_stat_.st_size; }
+void HttpResponse::LoadFile() {
+  file_path_.assign(src_dir_).append(path_);
+  file_ = FileCache::Instance()->Get(file_path_);
+}
 
 void HttpResponse::ErrorHtml() {
-  if (CODE_PATH.count(code_) == 1) {
-    path_ = CODE_PATH.find(code_)->second;
-    stat((src_dir_ + path_).data(), &mm_file_stat_);
+  if (const std::string_view *path = CODE_PATH.Find(code_)) {
+    path_.assign(*path);
+    LoadFile();
   }
 }
 
 void HttpResponse::AddStateLine(Buffer &buff) {
-  std::string status;
-  if (CODE_STATUS.count(code_) == 1) {
-    status = CODE_STATUS.find(code_)->second;
-  } else {
+  const std::string_view *line = CODE_STATUS.Find(code_);
+  if (line == nullptr) {
     code_ = 400;
-    status = CODE_STATUS.find(400)->second;
+    line = CODE_STATUS.Find(400);
   }
-  buff.Append("HTTP/1.1 " + std::to_string(code_) + " " + status + "\r\n");
+  buff.Append(*line);
 }
 
 void HttpResponse::AddHeader(Buffer &buff) {
+  buff.Append(DateHeader());
   buff.Append("Connection: ");
   if (is_keep_alive_) {
     buff.Append("keep-alive\r\n");
@@ -121,70 +340,281 @@ void HttpResponse::AddHeader(Buffer &buff) {
   } else {
     buff.Append("close\r\n");
   }
-  buff.Append("Content-type: " + GetFileType() + "\r\n");
 }
 
 void HttpResponse::AddContent(Buffer &buff) {
-  int src_fd = open((src_dir_ + path_).data(), O_RDONLY);  // readonly
-  if (src_fd < 0) {
-    ErrorContent(buff, "File NotFound!");
+  if (code_ == 416) {
+    // 告知客户端文件的实际长度，文件本身不发送
+    buff.Append("Content-Range: bytes */");
+    AppendNumber(buff, FileLen());
+    buff.Append("\r\n");
+    ReleaseFile();
+  }
+  if (!file_ || !file_->readable) {
+    buff.Append("Content-type: text/html\r\n");
+    const char *message = "File NotFound!";
+    if (code_ == 503) {
+      message = "Server busy, please try again later.";
+    } else if (code_ == 416) {
+      message = "Requested range not satisfiable.";
+    }
+    ErrorContent(buff, message);
+    return;
+  }
+  if (code_ == 200 || code_ == 304) {
+    // 错误页面不参与客户端缓存
+    AddValidators(buff);
+  }
+  if (code_ == 304) {
+    // 只有响应头
+    buff.Append("\r\n");
     return;
   }
+  // Content-type 与 Content-length 已在缓存中生成好。
+  // 小文件的内容紧跟在响应头之后，一次写操作即可发出；
+  // 大文件由 HttpConn 通过 sendfile 或内存映射发送
+  if (encoding_ == nullptr) {
+    buff.Append(file_->header);
+  } else {
+    buff.Append("Content-type: ");
+    buff.Append(content_type_);
+    buff.Append("\r\nContent-Encoding: ");
+    buff.Append(encoding_);
+    buff.Append("\r\nContent-length: ");
+    AppendNumber(buff, FileLen());
+    buff.Append("\r\n\r\n");
+  }
+  AddFileRange(buff, 0, FileLen());
+}
 
-  /* 将文件映射到内存提高文件的访问速度
-      MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
-  // LOG_DEBUG("file path %s", (src_dir_ + path_).data());
-  int *mm_ret = static_cast<int *>(
-      mmap(nullptr, mm_file_stat_.st_size, PROT_READ, MAP_PRIVATE, src_fd, 0));
-  // 返回映射区域的起始地址  失败则返回MAP_FAILED “-1”
-  // addr 设置为nullptr 由系统自动选择合适的地址
-  // prot 映射区域的保护模式 这里表示可读
-  // flags 指定映射的类型和特性
-  // 这里表示私有映射，映射的对象只能被当前进程访问，对映射区域的修改不会反映到底层对象上，而是在进程内部进行的私有拷贝。
-  if (*mm_ret == -1) {
-    ErrorContent(buff, "File NotFound!");
+void HttpResponse::SelectEncoding() {
+  if (!file_->readable || !file_->compressible) {
+    return;
+  }
+  std::string_view accept = conditions_.accept_encoding;
+  FileCache::EntryPtr variant;
+  const char *encoding = nullptr;
+  if (!file_->br_path.empty() && AcceptsEncoding(accept, "br")) {
+    variant = FileCache::Instance()->Get(file_->br_path);
+    encoding = "br";
+  }
+  if ((!variant || !variant->readable) && AcceptsEncoding(accept, "gzip")) {
+    // 没有 .gz 文件时使用后台压缩的版本，尚未压缩完成时本次发送原文件
+    variant = file_->gz_path.empty() ? Compressor::Instance()->Gzip(file_)
+                                     : FileCache::Instance()->Get(file_->gz_path);
+    encoding = "gzip";
+  }
+  if (!variant || !variant->readable) {
     return;
   }
-  mm_file_ = reinterpret_cast<char *>(mm_ret);
-  close(src_fd);
-  buff.Append("Content-length: " + std::to_string(mm_file_stat_.st_size) +
-              "\r\n\r\n");
+  content_type_ = file_->type;
+  encoding_ = encoding;
+  file_ = std::move(variant);
+}
+
+auto HttpResponse::NotModified() const -> bool {
+  if (!file_->readable) {
+    return false;
+  }
+  // 两者都有时只看 If-None-Match
+  if (!conditions_.if_none_match.empty()) {
+    return MatchEtag(conditions_.if_none_match, file_->etag);
+  }
+  if (!conditions_.if_modified_since.empty()) {
+    if (conditions_.if_modified_since == file_->last_modified) {
+      return true;
+    }
+    time_t since = ParseHttpDate(conditions_.if_modified_since);
+    return since >= 0 && file_->st.st_mtime <= since;
+  }
+  return false;
 }
 
-void HttpResponse::UnmapFile() {
-  if (mm_file_ != nullptr) {
-    munmap(mm_file_, mm_file_stat_.st_size);
-    mm_file_ = nullptr;
+void HttpResponse::AddValidators(Buffer &buff) {
+  buff.Append(file_->validators);
+  if (vary_) {
+    buff.Append("Vary: Accept-Encoding\r\n");
+  }
+  for (const auto &[prefix, header] : cache_control) {
+    if (path_.compare(0, prefix.size(), prefix) == 0) {
+      buff.Append(header);
+      break;
+    }
   }
 }
 
-auto HttpResponse::GetFileType() -> std::string {
+void HttpResponse::ParseRange() {
+  if (!file_->readable) {
+    return;
+  }
+  // If-Range 与文件当前的 ETag(强比较)、修改时间都不一致时文件已经变了，忽略 Range 返回整个文件
+  std::string_view if_range = conditions_.if_range;
+  if (!if_range.empty() && if_range != file_->etag && if_range != file_->last_modified) {
+    return;
+  }
+  constexpr std::string_view UNIT = "bytes=";
+  std::string_view spec = conditions_.range;
+  if (spec.size() < UNIT.size() || strncasecmp(spec.data(), UNIT.data(), UNIT.size()) != 0) {
+    return;
+  }
+  spec.remove_prefix(UNIT.size());
+  uint64_t size = FileLen();
+  int cnt = 0;
+  bool valid = false;
+  // 逐个解析 first-last、first- 与 -suffix，语法错误时整个 Range 无效；
+  // 起点超出文件长度的范围无法满足，跳过
+  while (!spec.empty()) {
+    size_t comma = spec.find(',');
+    std::string_view item = TrimSpace(spec.substr(0, comma));
+    spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+    if (item.empty()) {
+      continue;
+    }
+    size_t dash = item.find('-');
+    if (dash == std::string_view::npos) {
+      return;
+    }
+    std::string_view first = item.substr(0, dash);
+    std::string_view last = item.substr(dash + 1);
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    if (first.empty()) {
+      // 文件最后 suffix 个字节
+      uint64_t suffix = 0;
+      if (!ParseNumber(last, &suffix)) {
+        return;
+      }
+      valid = true;
+      if (suffix == 0 || size == 0) {
+        continue;
+      }
+      begin = size - std::min(suffix, size);
+      end = size - 1;
+    } else {
+      if (!ParseNumber(first, &begin)) {
+        return;
+      }
+      end = UINT64_MAX;
+      if (!last.empty() && (!ParseNumber(last, &end) || end < begin)) {
+        return;
+      }
+      valid = true;
+      if (begin >= size) {
+        continue;
+      }
+      end = std::min(end, size - 1);
+    }
+    if (cnt == MAX_RANGES) {
+      // 范围过多，不值得逐段发送
+      return;
+    }
+    ranges_[cnt++] = {static_cast<off_t>(begin), end - begin + 1};
+  }
+  if (!valid) {
+    return;
+  }
+  range_cnt_ = cnt;
+  code_ = cnt > 0 ? 206 : 416;
+}
+
+void HttpResponse::AddRangeContent(Buffer &buff) {
+  size_t size = FileLen();
+  AddValidators(buff);
+  buff.Append("Accept-Ranges: bytes\r\n");
+  if (range_cnt_ == 1) {
+    auto [offset, len] = ranges_[0];
+    buff.Append("Content-type: ");
+    buff.Append(file_->type);
+    buff.Append("\r\n");
+    AppendContentRange(buff, offset, len, size);
+    buff.Append("Content-length: ");
+    AppendNumber(buff, len);
+    buff.Append("\r\n\r\n");
+    AddFileRange(buff, offset, len);
+    return;
+  }
+  // 多个范围：每个范围前有分隔符与各自的 Content-type、Content-Range，先算出总长度。
+  // 各部分为 DELIMITER BOUNDARY PART_TYPE type CRLF Content-Range CRLF 数据，最后是 DELIMITER BOUNDARY CLOSE
+  constexpr std::string_view DELIMITER = "\r\n--";
+  constexpr std::string_view PART_TYPE = "\r\nContent-type: ";
+  constexpr std::string_view CLOSE = "--\r\n";
+  size_t total = DELIMITER.size() + BOUNDARY.size() + CLOSE.size();
+  for (int i = 0; i < range_cnt_; i++) {
+    auto [offset, len] = ranges_[i];
+    total += DELIMITER.size() + BOUNDARY.size() + PART_TYPE.size() + file_->type.size() + 2 +
+             ContentRangeLength(offset, len, size) + 2 + len;
+  }
+  buff.Append("Content-type: multipart/byteranges; boundary=");
+  buff.Append(BOUNDARY);
+  buff.Append("\r\nContent-length: ");
+  AppendNumber(buff, total);
+  buff.Append("\r\n\r\n");
+  for (int i = 0; i < range_cnt_; i++) {
+    auto [offset, len] = ranges_[i];
+    buff.Append(DELIMITER);
+    buff.Append(BOUNDARY);
+    buff.Append(PART_TYPE);
+    buff.Append(file_->type);
+    buff.Append("\r\n");
+    AppendContentRange(buff, offset, len, size);
+    buff.Append("\r\n");
+    AddFileRange(buff, offset, len);
+  }
+  buff.Append(DELIMITER);
+  buff.Append(BOUNDARY);
+  buff.Append(CLOSE);
+}
+
+void HttpResponse::AddFileRange(Buffer &buff, off_t offset, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  if (file_->fd < 0) {
+    // 文件内容在内存中(缓存的小文件或映射的大文件)，作为外部数据加入缓冲区，
+    // 缓冲区持有缓存项的引用，发送时直接引用文件内容，不复制
+    const char *data = file_->map != nullptr ? file_->map : file_->content.data();
+    buff.AppendExternal(file_, data + offset, len);
+    return;
+  }
+  // 通过 sendfile 发送的文件只记录位置，由 HttpConn 从 fd 的对应偏移处发送
+  segments_[segment_cnt_++] = {buff.ReadableBytes() - start_, offset, len};
+}
+
+void HttpResponse::ReleaseFile() { file_.reset(); }
+
+auto HttpResponse::GetFileType(std::string_view path) -> std::string_view {
   /* 判断文件类型 */
-  std::string::size_type idx = path_.find_last_of('.');
-  if (idx == std::string::npos) {
+  size_t idx = path.find_last_of('.');
+  if (idx == std::string_view::npos) {
     return "text/plain";
   }
-  std::string suffix = path_.substr(idx);
-  if (SUFFIX_TYPE.count(suffix) == 1) {
-    return SUFFIX_TYPE.find(suffix)->second;
+  if (const std::string_view *type = SUFFIX_TYPE.Find(path.substr(idx))) {
+    return *type;
   }
   return "text/plain";  // 没找到则返回纯文本
 }
 
-void HttpResponse::ErrorContent(Buffer &buff, const std::string &message) {
-  std::string body;
-  std::string status;
-  body += "<html><title>Error</title>";
-  body += "<body bgcolor=\"ffffff\">";
-  if (CODE_STATUS.count(code_) == 1) {
-    status = CODE_STATUS.find(code_)->second;
-  } else {
-    status = "Bad Request";
-  }
-  body += std::to_string(code_) + " : " + status + "\n";
-  body += "<p>" + message + "</p>";
-  body += "<hr><em>WebServer</em></body></html>";
+auto HttpResponse::IsCompressible(const std::string &type) -> bool {
+  return type.compare(0, 5, "text/") == 0 || type.find("javascript") != std::string::npos ||
+         type.find("json") != std::string::npos || type.find("xml") != std::string::npos;
+}
+
+void HttpResponse::ErrorContent(Buffer &buff, std::string_view message) {
+  // 页面为 HEAD code " : " status "\n<p>" message TAIL，先算出长度再依次写入
+  constexpr std::string_view HEAD = "<html><title>Error</title><body bgcolor=\"ffffff\">";
+  constexpr std::string_view TAIL = "</p><hr><em>WebServer</em></body></html>";
+  const std::string_view *line = CODE_STATUS.Find(code_);
+  std::string_view status = line != nullptr ? Reason(*line) : "Bad Request";
+  size_t len = HEAD.size() + NumberLength(code_) + 3 + status.size() + 4 + message.size() + TAIL.size();
 
-  buff.Append("Content-length: " + std::to_string(body.size()) + "\r\n\r\n");
-  buff.Append(body);
+  buff.Append("Content-length: ");
+  AppendNumber(buff, len);
+  buff.Append("\r\n\r\n");
+  buff.Append(HEAD);
+  AppendNumber(buff, code_);
+  buff.Append(" : ");
+  buff.Append(status);
+  buff.Append("\n<p>");
+  buff.Append(message);
+  buff.Append(TAIL);
 }
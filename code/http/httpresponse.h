@@ -6,53 +6,117 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-#include <unordered_map>
+#include <array>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "filecache.h"
 
 class HttpResponse {
  public:
+  // 不超过该大小的文件读入缓存，内容作为外部数据紧跟响应头加入写缓冲区，用一次写操作发出
+  static constexpr size_t INLINE_FILE_MAX = 16 * 1024;
+  // 更大的文件使用 sendfile 发送还是映射到内存，io_uring 后端需要内存中的数据
+  static bool use_sendfile;
+  // 小于该大小的文件压缩的收益不抵开销
+  static constexpr size_t COMPRESS_MIN = 256;
+  // 一个响应最多包含的范围数，Range 中的范围更多时忽略 Range，返回整个文件
+  static constexpr int MAX_RANGES = 8;
+
+  // 响应中需要通过 sendfile 发送的一段：写入缓冲区的内容中，位置 at 之后紧跟文件从 offset 开始的 len 字节
+  struct Segment {
+    size_t at;
+    off_t offset;
+    size_t len;
+  };
+
   HttpResponse();
   ~HttpResponse();
 
-  void Init(const std::string &srcDir, std::string &path,
-            bool isKeepAlive = false, int code = -1);
+  void Init(std::string_view srcDir, std::string_view path, bool isKeepAlive = false, int code = -1);
+
+  // GET 请求中的条件请求与范围请求头部
+  struct Conditions {
+    std::string_view if_none_match;
+    std::string_view if_modified_since;
+    std::string_view range;
+    std::string_view if_range;
+    std::string_view accept_encoding;
+  };
+  // 在 Init 之后调用。各头部指向请求的读缓冲区，只在接下来的 MakeResponse 中使用
+  void SetConditions(const Conditions &conditions);
+
+  // 路径以 prefix 开头的文件响应时带上 Cache-Control: value，多个前缀匹配时取最长的。
+  // 须在启动时、处理请求之前调用
+  static void AddCacheControl(const std::string &prefix, const std::string &value);
 
   // 构建HTTP响应
-  // --检查文件状态，设置正确的状态码，然后分别构建状态行、响应头和响应体
+  // --检查文件状态，设置正确的状态码，然后分别构建状态行、响应头和响应体。
+  // 状态行、响应头直接写入 buff，内存中的文件内容以引用的形式加入 buff。
+  // 线程缓存中有空闲块且文件缓存命中时不分配任何内存
   void MakeResponse(Buffer &buff);
 
-  // 解除文件的内存映射。
-  void UnmapFile();
+  // 释放对缓存文件的引用。文件的映射与 fd 由 FileCache 在最后一个引用释放时回收
+  void ReleaseFile();
 
-  // 返回指向内存映射文件的指针
-  auto File() -> char *;
+  // 返回需要通过 sendfile 发送的文件描述符，没有时为 -1
+  auto FileFd() const -> int { return file_ ? file_->fd : -1; }
 
-  // 返回内存映射文件的长度
+  // 返回文件的长度
   auto FileLen() const -> size_t;
 
+  // 响应体中通过 sendfile 发送的各段，位置相对于本响应写入缓冲区的起点。
+  // 内存中的文件内容(小文件、映射的大文件)已加入缓冲区，没有这样的段；多个范围(multipart/byteranges)时有多段
+  auto SegmentCount() const -> int { return segment_cnt_; }
+  auto GetSegment(int i) const -> const Segment & { return segments_[i]; }
+
+  // 根据文件路径后缀名返回对应的MIME类型。
+  static auto GetFileType(std::string_view path) -> std::string_view;
+  // 该 MIME 类型的文件是否值得压缩
+  static auto IsCompressible(const std::string &type) -> bool;
+
   // 构造错误响应内容
-  void ErrorContent(Buffer &buff, const std::string &message);
+  void ErrorContent(Buffer &buff, std::string_view message);
 
   // 返回响应码
   auto Code() const -> int { return code_; }
 
+  // 响应发送后是否保持连接
+  auto IsKeepAlive() const -> bool { return is_keep_alive_; }
+
  private:
   // 根据响应码code_，构造HTTP状态行并添加到响应缓冲区buff中
   void AddStateLine(Buffer &buff);
 
-  // 添加标准的HTTP响应头，如Connection和Content-Type
+  // 添加标准的HTTP响应头：Connection 与 Date
   void AddHeader(Buffer &buff);
 
-  // 将请求的文件内容添加到响应缓冲区。如果文件存在且可访问，将其映射到内存中以提高效率
+  // 添加缓存中预先生成的 Content-type/Content-length，小文件的内容一并写入响应缓冲区
   void AddContent(Buffer &buff);
 
+  // 按 Accept-Encoding 选择 br、gzip 预压缩文件或后台压缩的 gzip 版本，选中时以其替换 file_
+  void SelectEncoding();
+  // 按 If-None-Match 或 If-Modified-Since 判断客户端缓存的文件是否仍然有效(返回 304)
+  auto NotModified() const -> bool;
+  // 添加文件的 ETag、Last-Modified 与按路径配置的 Cache-Control
+  void AddValidators(Buffer &buff);
+
+  // 按 Range 与 If-Range 确定要返回的范围，结果保存在 ranges_ 中。
+  // 满足条件时返回 206，没有可满足的范围时返回 416，Range 无效或不适用时仍为 200
+  void ParseRange();
+  // 添加部分响应的头部与内容，只有一个范围时直接返回该范围，否则返回 multipart/byteranges
+  void AddRangeContent(Buffer &buff);
+  // 把文件的 [offset, offset + len) 加入响应体：内存中的内容作为外部数据加入缓冲区，通过 sendfile 发送的记录为一段
+  void AddFileRange(Buffer &buff, off_t offset, size_t len);
+
   // 如果响应码对应一个错误状态（如404）则设置path_为该错误的HTML页面路径
   void ErrorHtml();
 
-  // 根据请求的文件路径后缀名返回对应的MIME类型。
-  auto GetFileType() -> std::string;
+  // 从 FileCache 取得 src_dir_ + path_ 对应的文件
+  void LoadFile();
 
   // 状态码
   int code_;
@@ -70,22 +134,34 @@ class HttpResponse {
   // 所有的文件搜索都会在这个目录下进行。
   std::string src_dir_;
 
-  // 指向通过内存映射（mmap）方式映射的文件内容的指针。
-  // 内存映射文件可以提高文件访问效率，
-  // 因为它允许直接在内存中访问文件内容，而不是通过读写操作。
-  char *mm_file_;
-
-  // 存储内存映射文件的状态信息，这些信息用于构建HTTP响应头
-  struct stat mm_file_stat_;
-
-  // 文件后缀名到MIME类型的映射，用于在HTTP响应中指定正确的Content-Type
-  static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
-
-  // HTTP状态码到状态消息的映射
-  static const std::unordered_map<int, std::string> CODE_STATUS;
-
-  // 特定状态码对应的错误页面路径的映射
-  static const std::unordered_map<int, std::string> CODE_PATH;
+  // 拼接出的完整文件路径，容量在请求之间复用
+  std::string file_path_;
+
+  // 缓存中的文件：stat 结果、响应头以及文件内容、映射或 fd。
+  // 响应发送完毕前一直持有引用，期间缓存项即使被淘汰也不会被释放
+  FileCache::EntryPtr file_;
+
+  // 请求的条件与范围，指向请求的读缓冲区
+  Conditions conditions_;
+  // 文件有多种编码时响应带上 Vary: Accept-Encoding
+  bool vary_;
+  // 发送压缩版本时为其编码，以及原文件的 MIME 类型；否则为 nullptr
+  const char *encoding_;
+  std::string content_type_;
+  // 本响应在缓冲区中的起点
+  size_t start_;
+  // 206 时要返回的各个范围(起点，长度)
+  std::array<std::pair<off_t, size_t>, MAX_RANGES> ranges_;
+  int range_cnt_;
+  // 要从文件发送的段
+  std::array<Segment, MAX_RANGES> segments_;
+  int segment_cnt_;
+
+  // multipart/byteranges 各部分之间的分隔符，进程启动时随机生成
+  static const std::string BOUNDARY;
+
+  // 路径前缀与完整的 Cache-Control 头部，按前缀从长到短排列
+  static std::vector<std::pair<std::string, std::string>> cache_control;
 };
 
 #endif  // HTTP_RESPONSE_H
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "httpscan.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86
+#endif
+
+namespace {
+// tchar = "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "." / "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA
+constexpr auto IsTchar(unsigned char ch) -> bool {
+  if ((ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z')) {
+    return true;
+  }
+  for (char symbol : std::string_view("!#$%&'*+-.^_`|~")) {
+    if (ch == static_cast<unsigned char>(symbol)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+constexpr auto MakeTokenTable() -> std::array<bool, 256> {
+  std::array<bool, 256> table{};
+  for (int ch = 0; ch < 256; ch++) {
+    table[ch] = IsTchar(ch);
+  }
+  return table;
+}
+
+constexpr std::array<bool, 256> TOKEN_TABLE = MakeTokenTable();
+
+#ifdef HTTP_SCAN_X86
+// 向量化的字符集判断：用字节的低 4 位查表，得到"高 4 位取哪些值时该字节是 tchar"的位图；
+// 再用高 4 位查表得到对应的位，两者相与非零即为 tchar。tchar 都是 ASCII，
+// 高 4 位只需 0~7 共 8 位，高 4 位为 8~F 的字节查到 0，自然判为非法。
+// 表内容重复两次，供 AVX2 的两个 128 位通道各自使用。
+constexpr auto MakeLowNibbleTable() -> std::array<uint8_t, 32> {
+  std::array<uint8_t, 32> table{};
+  for (int ch = 0; ch < 128; ch++) {
+    if (IsTchar(ch)) {
+      table[ch & 0x0f] |= 1U << (ch >> 4);
+      table[16 + (ch & 0x0f)] |= 1U << (ch >> 4);
+    }
+  }
+  return table;
+}
+
+constexpr auto MakeHighNibbleTable() -> std::array<uint8_t, 32> {
+  std::array<uint8_t, 32> table{};
+  for (int hi = 0; hi < 8; hi++) {
+    table[hi] = table[16 + hi] = 1U << hi;
+  }
+  return table;
+}
+
+alignas(32) constexpr std::array<uint8_t, 32> LOW_NIBBLE = MakeLowNibbleTable();
+alignas(32) constexpr std::array<uint8_t, 32> HIGH_NIBBLE = MakeHighNibbleTable();
+
+__attribute__((target("sse4.2"))) auto FindLfSse42(const char *begin, const char *end) -> const char * {
+  const __m128i lf = _mm_set1_epi8('\n');
+  for (; end - begin >= 16; begin += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, lf));
+    if (mask != 0) {
+      return begin + __builtin_ctz(mask);
+    }
+  }
+  return HttpScan::FindLfScalar(begin, end);
+}
+
+__attribute__((target("sse4.2"))) auto FindDelimSse42(const char *begin, const char *end) -> const char * {
+  // pcmpestri 一条指令完成 16 字节与字符集 {CR, LF, ':', SP} 的比较
+  const __m128i delims = _mm_setr_epi8('\r', '\n', ':', ' ', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  for (; end - begin >= 16; begin += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+    int idx = _mm_cmpestri(delims, 4, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+    if (idx < 16) {
+      return begin + idx;
+    }
+  }
+  return HttpScan::FindDelimScalar(begin, end);
+}
+
+__attribute__((target("sse4.2"))) auto SkipTokenSse42(const char *begin, const char *end) -> const char * {
+  const __m128i low_table = _mm_load_si128(reinterpret_cast<const __m128i *>(LOW_NIBBLE.data()));
+  const __m128i high_table = _mm_load_si128(reinterpret_cast<const __m128i *>(HIGH_NIBBLE.data()));
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  for (; end - begin >= 16; begin += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+    __m128i low = _mm_shuffle_epi8(low_table, _mm_and_si128(chunk, nibble));
+    __m128i high = _mm_shuffle_epi8(high_table, _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble));
+    __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(low, high), _mm_setzero_si128());
+    int mask = _mm_movemask_epi8(invalid);
+    if (mask != 0) {
+      return begin + __builtin_ctz(mask);
+    }
+  }
+  return HttpScan::SkipTokenScalar(begin, end);
+}
+
+// AVX2 版本每次处理 32 字节，剩余不足 32 字节时交给 SSE4.2 版本收尾。
+// SSE4.2 版本是非 VEX 编码的指令，转过去之前须清除 ymm 的高半部分，否则每条 SSE 指令都要合并高位，
+// 编译器不会在尾调用前自动插入 vzeroupper
+__attribute__((target("avx2"))) auto FindLfAvx2(const char *begin, const char *end) -> const char * {
+  const __m256i lf = _mm256_set1_epi8('\n');
+  for (; end - begin >= 32; begin += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, lf)));
+    if (mask != 0) {
+      return begin + __builtin_ctz(mask);
+    }
+  }
+  _mm256_zeroupper();
+  return FindLfSse42(begin, end);
+}
+
+__attribute__((target("avx2"))) auto FindDelimAvx2(const char *begin, const char *end) -> const char * {
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const __m256i colon = _mm256_set1_epi8(':');
+  const __m256i space = _mm256_set1_epi8(' ');
+  for (; end - begin >= 32; begin += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+    __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, cr), _mm256_cmpeq_epi8(chunk, lf)),
+                                  _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, space)));
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+    if (mask != 0) {
+      return begin + __builtin_ctz(mask);
+    }
+  }
+  _mm256_zeroupper();
+  return FindDelimSse42(begin, end);
+}
+
+__attribute__((target("avx2"))) auto SkipTokenAvx2(const char *begin, const char *end) -> const char * {
+  const __m256i low_table = _mm256_load_si256(reinterpret_cast<const __m256i *>(LOW_NIBBLE.data()));
+  const __m256i high_table = _mm256_load_si256(reinterpret_cast<const __m256i *>(HIGH_NIBBLE.data()));
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  for (; end - begin >= 32; begin += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+    __m256i low = _mm256_shuffle_epi8(low_table, _mm256_and_si256(chunk, nibble));
+    __m256i high = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble));
+    __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), _mm256_setzero_si256());
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(invalid));
+    if (mask != 0) {
+      return begin + __builtin_ctz(mask);
+    }
+  }
+  _mm256_zeroupper();
+  return SkipTokenSse42(begin, end);
+}
+#endif  // HTTP_SCAN_X86
+}  // namespace
+
+const HttpScan::Kernels HttpScan::KERNELS = HttpScan::Select();
+
+auto HttpScan::Select() -> Kernels { return Supported().front(); }
+
+auto HttpScan::Supported() -> std::vector<Kernels> {
+  std::vector<Kernels> kernels;
+#ifdef HTTP_SCAN_X86
+  // 在静态初始化阶段调用，需先初始化 CPU 特性信息
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back({FindLfAvx2, FindDelimAvx2, SkipTokenAvx2, "avx2"});
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    kernels.push_back({FindLfSse42, FindDelimSse42, SkipTokenSse42, "sse4.2"});
+  }
+#endif
+  kernels.push_back({FindLfScalar, FindDelimScalar, SkipTokenScalar, "scalar"});
+  return kernels;
+}
+
+auto HttpScan::FindLfScalar(const char *begin, const char *end) -> const char * {
+  const void *lf = memchr(begin, '\n', end - begin);
+  return lf == nullptr ? end : static_cast<const char *>(lf);
+}
+
+auto HttpScan::FindDelimScalar(const char *begin, const char *end) -> const char * {
+  for (; begin < end; begin++) {
+    char ch = *begin;
+    if (ch == '\r' || ch == '\n' || ch == ':' || ch == ' ') {
+      break;
+    }
+  }
+  return begin;
+}
+
+auto HttpScan::SkipTokenScalar(const char *begin, const char *end) -> const char * {
+  while (begin < end && TOKEN_TABLE[static_cast<unsigned char>(*begin)]) {
+    begin++;
+  }
+  return begin;
+}
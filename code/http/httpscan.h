@@ -0,0 +1,50 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <cstddef>
+#include <vector>
+
+// 请求解析使用的字节扫描函数。
+// 每次处理 16/32 字节，程序启动时按 CPU 支持选择 AVX2、SSE4.2 或标量实现，
+// 不需要额外的编译选项；非 x86 平台只有标量实现。
+// 所有函数在 [begin, end) 中查找，未找到时返回 end。
+class HttpScan {
+ public:
+  // 第一个 '\n'
+  static auto FindLf(const char *begin, const char *end) -> const char * { return KERNELS.find_lf(begin, end); }
+  // 第一个 CR、LF、':' 或 SP
+  static auto FindDelim(const char *begin, const char *end) -> const char * {
+    return KERNELS.find_delim(begin, end);
+  }
+  // 第一个不属于 token 字符集(RFC 9110 tchar)的字节，用于批量校验方法名与头部名称
+  static auto SkipToken(const char *begin, const char *end) -> const char * {
+    return KERNELS.skip_token(begin, end);
+  }
+  // 当前使用的实现："avx2"、"sse4.2" 或 "scalar"
+  static auto Isa() -> const char * { return KERNELS.isa; }
+
+  // 标量实现，也是向量实现处理尾部数据与校验结果的基准
+  static auto FindLfScalar(const char *begin, const char *end) -> const char *;
+  static auto FindDelimScalar(const char *begin, const char *end) -> const char *;
+  static auto SkipTokenScalar(const char *begin, const char *end) -> const char *;
+
+  using ScanFunc = const char *(*)(const char *, const char *);
+  // 一组实现
+  struct Kernels {
+    ScanFunc find_lf;
+    ScanFunc find_delim;
+    ScanFunc skip_token;
+    const char *isa;
+  };
+
+  // 当前 CPU 支持的所有实现，从快到慢排列，最后一组为标量实现。供测试与基准逐一比较
+  static auto Supported() -> std::vector<Kernels>;
+
+ private:
+  // 检测 CPU 特性，选出最快的一组实现
+  static auto Select() -> Kernels;
+
+  static const Kernels KERNELS;
+};
+
+#endif  // HTTP_SCAN_H
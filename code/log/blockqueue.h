@@ -0,0 +1,84 @@
+#ifndef BLOCKQUEUE_H
+#define BLOCKQUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+// 单生产者单消费者的有界环形队列，无锁。
+// 日志系统中每个线程独占一个队列作为暂存区，后台写线程是唯一的消费者。
+// 元素原地构造与读取：生产者通过 Back() 取得空槽位直接写入，再 Push() 发布；
+// 消费者通过 Front() 读取，用完后 Pop() 归还。队列满时 Back() 返回 nullptr，
+// 是丢弃还是等待由调用方决定。
+template <class T>
+class BlockQueue {
+ public:
+  // 容量向上取整为 2 的幂
+  explicit BlockQueue(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots_ = std::make_unique<T[]>(size);
+    mask_ = size - 1;
+  }
+
+  BlockQueue(const BlockQueue &) = delete;
+  auto operator=(const BlockQueue &) -> BlockQueue & = delete;
+
+  auto Capacity() const -> size_t { return mask_ + 1; }
+
+  auto Size() const -> size_t {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+  auto Empty() const -> bool { return Size() == 0; }
+
+  // 生产者：下一个可写的槽位，队列满时返回 nullptr
+  auto Back() -> T * {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_) {
+      // 只有看起来已满时才去读消费者的位置
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ > mask_) {
+        return nullptr;
+      }
+    }
+    return &slots_[tail & mask_];
+  }
+
+  // 生产者：发布 Back() 返回的槽位
+  void Push() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  // 消费者：最早的元素，队列空时返回 nullptr
+  auto Front() -> T * {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return nullptr;
+      }
+    }
+    return &slots_[head & mask_];
+  }
+
+  // 消费者：归还 Front() 返回的槽位
+  void Pop() {
+    assert(head_.load(std::memory_order_relaxed) != tail_.load(std::memory_order_relaxed));
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+ private:
+  std::unique_ptr<T[]> slots_;
+  size_t mask_;
+
+  // 生产者与消费者各自修改的位置放在不同的缓存行，避免伪共享；
+  // 各自再缓存一份对方的位置，大多数操作不需要读取对方的缓存行
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t cached_tail_ = 0;
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t cached_head_ = 0;
+};
+
+#endif  // BLOCKQUEUE_H
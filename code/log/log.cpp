@@ -0,0 +1,415 @@
+#include "log.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+std::atomic<int> Log::log_level{Log::CLOSED};
+thread_local std::shared_ptr<Log::Ring> Log::local_ring;
+
+namespace {
+// 写线程在没有被提前唤醒时的刷新间隔
+constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(100);
+// 合并写入的批大小
+constexpr size_t BATCH_SIZE = 64 * 1024;
+
+const char *const LEVEL_TITLE[] = {"[debug]: ", "[info] : ", "[warn] : ", "[error]: "};
+constexpr size_t LEVEL_TITLE_LEN = 9;
+// "YYYY-MM-DD HH:MM:SS"
+constexpr size_t TIME_PREFIX_LEN = 19;
+
+// 无符号整数按 BASE 进制写入 [p, end)，返回写入后的位置，空间不足时截断。
+// 进制是编译期常量，除法由编译器换成乘法
+template <unsigned BASE>
+auto PutUnsigned(char *p, char *end, unsigned long long value) -> char * {
+  char digits[24];
+  int n = 0;
+  do {
+    digits[n++] = "0123456789abcdef"[value % BASE];
+    value /= BASE;
+  } while (value != 0);
+  while (n > 0 && p < end) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+// 日志中常用的转换(%d %i %u %x %c %s %.*s %%，长度修饰 l、ll、z)直接写入记录，
+// 省去 vsnprintf 每次调用的固定开销。遇到其它写法(宽度、标志、浮点等)时返回 -1，由调用方改用 vsnprintf。
+// 返回写入的字节数，超出 size 的部分截断
+auto FormatFast(char *dst, size_t size, const char *format, va_list args) -> int {
+  char *p = dst;
+  char *end = dst + size;
+  for (const char *f = format; *f != '\0'; f++) {
+    // 两个转换之间的普通文字整段拷贝
+    const char *next = strchrnul(f, '%');
+    size_t literal = std::min(static_cast<size_t>(next - f), static_cast<size_t>(end - p));
+    memcpy(p, f, literal);
+    p += literal;
+    f = next;
+    if (*f == '\0') {
+      break;
+    }
+    f++;
+    int precision = -1;
+    if (f[0] == '.' && f[1] == '*') {
+      precision = va_arg(args, int);
+      f += 2;
+    }
+    int longs = 0;
+    bool size_t_arg = false;
+    while (*f == 'l') {
+      longs++;
+      f++;
+    }
+    if (*f == 'z') {
+      size_t_arg = true;
+      f++;
+    }
+    if (longs > 2 || (size_t_arg && longs > 0) || (precision >= 0 && *f != 's')) {
+      return -1;
+    }
+    switch (*f) {
+      case 'd':
+      case 'i': {
+        long long value = size_t_arg  ? static_cast<long long>(va_arg(args, ssize_t))
+                          : longs == 2 ? va_arg(args, long long)
+                          : longs == 1 ? va_arg(args, long)
+                                       : va_arg(args, int);
+        unsigned long long magnitude = static_cast<unsigned long long>(value);
+        if (value < 0) {
+          if (p < end) {
+            *p++ = '-';
+          }
+          magnitude = 0 - magnitude;
+        }
+        p = PutUnsigned<10>(p, end, magnitude);
+        break;
+      }
+      case 'u':
+      case 'x': {
+        unsigned long long value = size_t_arg  ? va_arg(args, size_t)
+                                   : longs == 2 ? va_arg(args, unsigned long long)
+                                   : longs == 1 ? va_arg(args, unsigned long)
+                                                : va_arg(args, unsigned);
+        p = *f == 'u' ? PutUnsigned<10>(p, end, value) : PutUnsigned<16>(p, end, value);
+        break;
+      }
+      case 'c':
+        if (p < end) {
+          *p++ = static_cast<char>(va_arg(args, int));
+        }
+        break;
+      case 's': {
+        const char *str = va_arg(args, const char *);
+        if (str == nullptr) {
+          str = "(null)";
+        }
+        size_t len = precision >= 0 ? strnlen(str, precision) : strlen(str);
+        len = std::min(len, static_cast<size_t>(end - p));
+        memcpy(p, str, len);
+        p += len;
+        break;
+      }
+      case '%':
+        if (p < end) {
+          *p++ = '%';
+        }
+        break;
+      default:
+        return -1;
+    }
+  }
+  return static_cast<int>(p - dst);
+}
+}  // namespace
+
+auto Log::Instance() -> Log * {
+  static Log log;
+  return &log;
+}
+
+void Log::Init(int level, const char *path, const char *suffix, int maxQueueCapacity, bool blockWhenFull,
+               size_t maxFileSize) {
+  assert(maxQueueCapacity > 0);
+  if (is_open_) {
+    SetLevel(level);
+    return;
+  }
+  path_ = path;
+  suffix_ = suffix;
+  queue_capacity_ = maxQueueCapacity;
+  block_when_full_ = blockWhenFull;
+  max_file_size_ = maxFileSize;
+  batch_.reserve(BATCH_SIZE * 2);
+
+  mkdir(path_.data(), 0777);
+  time_t timer = time(nullptr);
+  struct tm now {};
+  localtime_r(&timer, &now);
+  OpenFile(now);
+  if (fd_ < 0) {
+    return;
+  }
+  is_open_ = true;
+  flush_thread_ = std::thread([this] { FlushLoop(); });
+  SetLevel(level);
+}
+
+Log::~Log() {
+  if (flush_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> locker(mtx_);
+      closing_ = true;
+    }
+    cond_.notify_one();
+    space_cond_.notify_all();
+    flush_thread_.join();
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void Log::SetLevel(int level) {
+  // 日志文件打开前保持关闭状态
+  if (is_open_) {
+    log_level.store(level, std::memory_order_relaxed);
+  }
+}
+
+auto Log::LocalRing() -> Ring * {
+  if (!local_ring) {
+    local_ring = std::make_shared<Ring>(queue_capacity_);
+    std::lock_guard<std::mutex> locker(rings_mtx_);
+    rings_.push_back(local_ring);
+  }
+  return local_ring.get();
+}
+
+void Log::Write(int level, const char *format, ...) {
+  Ring *ring = LocalRing();
+  Record *record = ring->queue.Back();
+  if (record == nullptr) {
+    if (!block_when_full_) {
+      ring->dropped.fetch_add(1, std::memory_order_relaxed);
+      Notify();
+      return;
+    }
+    record = WaitForSpace(ring);
+    if (record == nullptr) {
+      return;
+    }
+  }
+
+  struct timeval now = {0, 0};
+  gettimeofday(&now, nullptr);
+  if (now.tv_sec != ring->sec) {
+    struct tm t {};
+    localtime_r(&now.tv_sec, &t);
+    strftime(ring->time_prefix, sizeof(ring->time_prefix), "%Y-%m-%d %H:%M:%S", &t);
+    ring->sec = now.tv_sec;
+  }
+  // 2026-10-17 12:00:00.123456 [info] : message
+  // 前缀直接拷贝，消息本身由 FormatFast 格式化
+  char *p = record->data;
+  memcpy(p, ring->time_prefix, TIME_PREFIX_LEN);
+  p += TIME_PREFIX_LEN;
+  *p++ = '.';
+  long usec = now.tv_usec;
+  for (int i = 5; i >= 0; i--) {
+    p[i] = static_cast<char>('0' + usec % 10);
+    usec /= 10;
+  }
+  p += 6;
+  *p++ = ' ';
+  memcpy(p, LEVEL_TITLE[level < DEBUG || level > ERROR ? INFO : level], LEVEL_TITLE_LEN);
+  p += LEVEL_TITLE_LEN;
+  int len = static_cast<int>(p - record->data);
+  va_list args;
+  va_start(args, format);
+  va_list fallback;
+  va_copy(fallback, args);
+  int msg_len = FormatFast(record->data + len, RECORD_SIZE - len, format, args);
+  if (msg_len < 0) {
+    msg_len = vsnprintf(record->data + len, RECORD_SIZE - len, format, fallback);
+  }
+  va_end(fallback);
+  va_end(args);
+  if (msg_len > 0) {
+    len += msg_len;
+  }
+  // 超长时截断，保证以换行结尾
+  if (len > static_cast<int>(RECORD_SIZE) - 1) {
+    len = RECORD_SIZE - 1;
+  }
+  record->data[len++] = '\n';
+  record->len = len;
+  ring->queue.Push();
+
+  // 队列过半时提前唤醒写线程，避免在刷新间隔内被写满
+  if (ring->queue.Size() * 2 >= ring->queue.Capacity()) {
+    Notify();
+  }
+}
+
+void Log::Notify() {
+  if (!wakeup_.exchange(true, std::memory_order_acq_rel)) {
+    cond_.notify_one();
+  }
+}
+
+auto Log::WaitForSpace(Ring *ring) -> Record * {
+  Record *record = nullptr;
+  Notify();
+  std::unique_lock<std::mutex> locker(mtx_);
+  while ((record = ring->queue.Back()) == nullptr && !closing_) {
+    // 写线程每取完一轮就会通知；带超时以防错过通知
+    space_cond_.wait_for(locker, std::chrono::milliseconds(1));
+    Notify();
+  }
+  return record;
+}
+
+void Log::Flush() {
+  if (!is_open_) {
+    return;
+  }
+  std::lock_guard<std::mutex> locker(flush_mtx_);
+  Drain();
+}
+
+void Log::FlushLoop() {
+  while (true) {
+    bool closing = false;
+    {
+      std::unique_lock<std::mutex> locker(mtx_);
+      cond_.wait_for(locker, FLUSH_INTERVAL,
+                     [this] { return closing_ || wakeup_.load(std::memory_order_acquire); });
+      wakeup_.store(false, std::memory_order_release);
+      closing = closing_;
+    }
+    {
+      std::lock_guard<std::mutex> locker(flush_mtx_);
+      Drain();
+    }
+    space_cond_.notify_all();
+    if (closing) {
+      break;
+    }
+  }
+}
+
+void Log::Drain() {
+  time_t timer = time(nullptr);
+  struct tm now {};
+  localtime_r(&timer, &now);
+  if (now.tm_yday != file_day_) {
+    // 跨天，切换到新日期的文件
+    WriteBatch();
+    file_index_ = 0;
+    OpenFile(now);
+  }
+
+  {
+    std::lock_guard<std::mutex> locker(rings_mtx_);
+    draining_ = rings_;
+  }
+  for (auto &ring : draining_) {
+    uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+      char line[96];
+      int len = snprintf(line, sizeof(line), "[warn] : %llu log records dropped, queue full\n",
+                         static_cast<unsigned long long>(dropped));
+      Append(line, len);
+    }
+    while (Record *record = ring->queue.Front()) {
+      Append(record->data, record->len);
+      ring->queue.Pop();
+    }
+  }
+  WriteBatch();
+
+  // 线程已退出且记录已取完的队列不再需要。先放下本轮的引用，只剩 rings_ 持有的队列才属于已退出的线程；
+  // 本轮取快照之后才注册的队列仍被其线程持有，不会被误删
+  draining_.clear();
+  std::lock_guard<std::mutex> locker(rings_mtx_);
+  for (size_t i = 0; i < rings_.size();) {
+    if (rings_[i].use_count() == 1 && rings_[i]->queue.Empty()) {
+      rings_[i] = rings_.back();
+      rings_.pop_back();
+    } else {
+      i++;
+    }
+  }
+}
+
+void Log::Append(const char *data, size_t len) {
+  batch_.append(data, len);
+  if (batch_.size() >= BATCH_SIZE) {
+    WriteBatch();
+  }
+}
+
+void Log::WriteBatch() {
+  if (batch_.empty() || fd_ < 0) {
+    batch_.clear();
+    return;
+  }
+  size_t done = 0;
+  while (done < batch_.size()) {
+    ssize_t len = write(fd_, batch_.data() + done, batch_.size() - done);
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    done += len;
+  }
+  file_bytes_ += done;
+  batch_.clear();
+  if (file_bytes_ >= max_file_size_) {
+    // 超过大小上限，切换到同一天的下一个文件
+    time_t timer = time(nullptr);
+    struct tm now {};
+    localtime_r(&timer, &now);
+    file_index_++;
+    OpenFile(now);
+  }
+}
+
+void Log::OpenFile(const struct tm &now) {
+  char name[64];
+  if (file_index_ == 0) {
+    snprintf(name, sizeof(name), "/%04d_%02d_%02d", now.tm_year + 1900, now.tm_mon + 1, now.tm_mday);
+  } else {
+    snprintf(name, sizeof(name), "/%04d_%02d_%02d-%d", now.tm_year + 1900, now.tm_mon + 1, now.tm_mday,
+             file_index_);
+  }
+  std::string file_name = path_ + name + suffix_;
+  int fd = open(file_name.data(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    // 打开失败时继续写旧文件
+    return;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = fd;
+  file_day_ = now.tm_yday;
+  struct stat st {};
+  file_bytes_ = fstat(fd_, &st) == 0 ? st.st_size : 0;
+  if (file_bytes_ >= max_file_size_) {
+    // 重启后当天的文件已写满，继续往后找
+    file_index_++;
+    OpenFile(now);
+  }
+}
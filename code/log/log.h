@@ -0,0 +1,138 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <sys/time.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blockqueue.h"
+
+// 异步日志。
+// 每个写日志的线程拥有一个无锁的环形暂存队列，格式化后的日志记录直接写入其中；
+// 后台写线程定期(或某个队列过半时)收集所有队列的记录，合并成大块后一次 write 写入文件。
+// 日志文件按日期命名，跨天或超过大小上限时切换到新文件。
+// 队列满时按策略丢弃(记录丢弃条数)或等待写线程腾出空间。
+class Log {
+ public:
+  enum Level {
+    DEBUG = 0,
+    INFO,
+    WARN,
+    ERROR,
+    // 高于所有级别，日志关闭时使用
+    CLOSED,
+  };
+
+  // 单条日志记录的最大长度(含换行)，更长的内容被截断
+  static constexpr size_t RECORD_SIZE = 512;
+
+  static auto Instance() -> Log *;
+
+  // level 为最低输出级别，日志写入 path 目录下的 YYYY_MM_DD[-N]suffix 文件。
+  // maxQueueCapacity 为每个线程暂存队列可容纳的记录数；blockWhenFull 为 true 时队列满则等待，否则丢弃；
+  // 单个文件超过 maxFileSize 字节后切换到新文件
+  void Init(int level, const char *path = "./log", const char *suffix = ".log", int maxQueueCapacity = 1024,
+            bool blockWhenFull = false, size_t maxFileSize = 64 * 1024 * 1024);
+
+  // 级别过滤：日志关闭或级别不足时只有这一次比较
+  static auto IsEnabled(int level) -> bool { return level >= log_level.load(std::memory_order_relaxed); }
+
+  // 格式化一条日志写入当前线程的暂存队列
+  void Write(int level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+  // 立即把所有暂存的记录写入文件
+  void Flush();
+
+  auto IsOpen() const -> bool { return is_open_; }
+  auto GetLevel() const -> int { return log_level.load(std::memory_order_relaxed); }
+  void SetLevel(int level);
+
+ private:
+  // 一条格式化好的日志
+  struct Record {
+    uint32_t len;
+    char data[RECORD_SIZE];
+  };
+
+  // 线程的暂存队列，线程退出后由写线程取完剩余记录再释放
+  struct Ring {
+    explicit Ring(size_t capacity) : queue(capacity) {}
+    BlockQueue<Record> queue;
+    std::atomic<uint64_t> dropped{0};
+    // 缓存当前秒的时间前缀，同一秒内不必重新格式化
+    time_t sec = -1;
+    char time_prefix[32] = {};
+  };
+
+  Log() = default;
+  ~Log();
+
+  // 当前线程的暂存队列，首次使用时创建并登记
+  auto LocalRing() -> Ring *;
+  // 队列满且策略为等待时，等待写线程腾出空间
+  auto WaitForSpace(Ring *ring) -> Record *;
+  // 唤醒写线程
+  void Notify();
+
+  // 写线程主循环
+  void FlushLoop();
+  // 收集所有队列中的记录并写入文件，调用方持有 flush_mtx_
+  void Drain();
+  void Append(const char *data, size_t len);
+  void WriteBatch();
+  // 按日期与序号打开日志文件，跨天时序号归零
+  void OpenFile(const struct tm &now);
+
+  static std::atomic<int> log_level;
+  static thread_local std::shared_ptr<Ring> local_ring;
+
+  bool is_open_ = false;
+  bool block_when_full_ = false;
+  size_t queue_capacity_ = 0;
+  size_t max_file_size_ = 0;
+  std::string path_;
+  std::string suffix_;
+
+  // 所有线程的暂存队列
+  std::mutex rings_mtx_;
+  std::vector<std::shared_ptr<Ring>> rings_;
+
+  // 以下只由持有 flush_mtx_ 的线程访问
+  std::mutex flush_mtx_;
+  std::vector<std::shared_ptr<Ring>> draining_;
+  std::string batch_;
+  int fd_ = -1;
+  int file_day_ = -1;
+  int file_index_ = 0;
+  size_t file_bytes_ = 0;
+
+  // 写线程的唤醒与退出
+  std::mutex mtx_;
+  std::condition_variable cond_;
+  std::condition_variable space_cond_;
+  std::atomic<bool> wakeup_{false};
+  bool closing_ = false;
+  std::thread flush_thread_;
+};
+
+#define LOG_BASE(level, format, ...)                          \
+  do {                                                        \
+    if (Log::IsEnabled(level)) {                              \
+      Log::Instance()->Write(level, format, ##__VA_ARGS__);   \
+    }                                                         \
+  } while (0)
+
+#define LOG_DEBUG(format, ...) LOG_BASE(Log::DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_BASE(Log::INFO, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_BASE(Log::WARN, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_BASE(Log::ERROR, format, ##__VA_ARGS__)
+
+#endif  // LOG_H
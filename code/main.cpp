@@ -9,7 +9,9 @@ auto main() -> int {
   WebServer server(
       9006, 3, 60000, false, /* 端口 ET模式 timeoutMs 优雅退出  */
       3306, "root", "password", "webserver", /* Mysql配置 */
-      12, 6, false, 1,
-      1024); /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+      12, 6, true, 1,
+      1024, /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+      0,    /* Reactor数量: 0为单Reactor+线程池, N>0为N个Reactor(每线程一个事件循环) */
+      0);   /* IO后端: 0为epoll, 1为io_uring(内核不支持时回退到epoll) */
   server.Start();
 }
@@ -0,0 +1,398 @@
+#include "asyncsql.h"
+
+#include <mysql/errmsg.h>
+#include <mysql/mysqld_error.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <string_view>
+#include <unordered_set>
+
+namespace {
+// 内部 epoll 中唤醒用 eventfd 与定时器的标记，其余事件的 data 为查询槽位下标
+constexpr uint64_t WAKE_DATA = UINT64_MAX;
+constexpr uint64_t TIMER_DATA = UINT64_MAX - 1;
+constexpr int MAX_EVENTS = 64;
+}  // namespace
+
+AsyncSql::AsyncSql(SqlConnPool *pool, UserCache *cache, size_t batchMax, int batchDelayUs, int maxQueued)
+    : pool_(pool),
+      cache_(cache),
+      batch_max_(std::max<size_t>(batchMax, 1)),
+      batch_delay_(batchDelayUs),
+      notify_registered_(false),
+      max_queued_(maxQueued) {
+  assert(pool_);
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  assert(epoll_fd_ >= 0 && wake_fd_ >= 0 && timer_fd_ >= 0);
+  epoll_event ev = {0};
+  ev.events = EPOLLIN;
+  ev.data.u64 = WAKE_DATA;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+  ev.data.u64 = TIMER_DATA;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &ev);
+}
+
+AsyncSql::~AsyncSql() {
+  pool_->CancelNotify(this);
+  for (Op &op : ops_) {
+    if (op.conn != nullptr) {
+      pool_->FreeConn(op.conn);
+    }
+  }
+  close(timer_fd_);
+  close(wake_fd_);
+  close(epoll_fd_);
+}
+
+void AsyncSql::Verify(std::string user, std::string password, bool isLogin, Callback cb) {
+  if (cache_ != nullptr) {
+    UserCache::Answer answer = cache_->Lookup(user, password, isLogin);
+    if (answer != UserCache::ANSWER_UNKNOWN) {
+      cb(answer == UserCache::ANSWER_OK ? RESULT_OK : RESULT_FAILED);
+      return;
+    }
+  }
+  if (queued_.fetch_add(1, std::memory_order_relaxed) >= max_queued_) {
+    // 数据库跟不上时快速失败，不让请求无限积压
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    cb(RESULT_UNAVAILABLE);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> locker(mtx_);
+    submitted_.push_back(
+        Request{std::move(user), std::move(password), isLogin, std::move(cb), std::chrono::steady_clock::now()});
+  }
+  Wake();
+}
+
+auto AsyncSql::GetStats() const -> Stats {
+  Stats stats;
+  stats.queued = queued_.load(std::memory_order_relaxed);
+  stats.running = running_.load(std::memory_order_relaxed);
+  stats.started = started_.load(std::memory_order_relaxed);
+  stats.wait_us_total = wait_us_total_.load(std::memory_order_relaxed);
+  stats.wait_us_max = wait_us_max_.load(std::memory_order_relaxed);
+  stats.rejected = rejected_.load(std::memory_order_relaxed);
+  stats.expired = expired_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void AsyncSql::OnDequeued(const Job &job, bool started) {
+  auto n = job.reqs.size();
+  queued_.fetch_sub(static_cast<int>(n), std::memory_order_relaxed);
+  if (!started) {
+    expired_.fetch_add(n, std::memory_order_relaxed);
+    return;
+  }
+  running_.fetch_add(1, std::memory_order_relaxed);
+  started_.fetch_add(n, std::memory_order_relaxed);
+  // 只在 Reactor 线程中写入，读-改-写不会相互覆盖
+  auto now = std::chrono::steady_clock::now();
+  for (const Request &req : job.reqs) {
+    auto wait =
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - req.submit_time).count());
+    wait_us_total_.fetch_add(wait, std::memory_order_relaxed);
+    if (wait > wait_us_max_.load(std::memory_order_relaxed)) {
+      wait_us_max_.store(wait, std::memory_order_relaxed);
+    }
+  }
+}
+
+void AsyncSql::Wake() {
+  uint64_t one = 1;
+  ssize_t ret = write(wake_fd_, &one, sizeof(one));
+  (void)ret;
+}
+
+void AsyncSql::OnReady() {
+  epoll_event events[MAX_EVENTS];
+  int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, 0);
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.u64 == WAKE_DATA || events[i].data.u64 == TIMER_DATA) {
+      uint64_t count;
+      ssize_t ret = read(events[i].data.u64 == WAKE_DATA ? wake_fd_ : timer_fd_, &count, sizeof(count));
+      (void)ret;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> locker(mtx_);
+    for (Request &req : submitted_) {
+      if (req.is_login) {
+        auto time = req.submit_time;
+        waiting_.push_back(Job{true, {}, time});
+        waiting_.back().reqs.push_back(std::move(req));
+      } else {
+        batch_.push_back(std::move(req));
+      }
+    }
+    submitted_.clear();
+  }
+  // 进行中的查询很少，每次全部推进一遍，不依赖具体哪个连接可读
+  for (size_t i = 0; i < ops_.size(); i++) {
+    bool ok = false;
+    if (ops_[i].conn != nullptr && Drive(ops_[i], &ok)) {
+      Finish(i, ok);
+    }
+  }
+  FlushBatch();
+  StartWaiting();
+  ExpireWaiting();
+}
+
+void AsyncSql::FlushBatch() {
+  auto now = std::chrono::steady_clock::now();
+  size_t begin = 0;
+  while (begin < batch_.size()) {
+    size_t count = std::min(batch_.size() - begin, batch_max_);
+    // 攒够一批立即提交；不足一批时，没有注册在进行或最早的请求已等待够久才提交
+    if (count < batch_max_ && register_jobs_ > 0 && batch_[begin].submit_time + batch_delay_ > now) {
+      break;
+    }
+    Job job{false, {}, batch_[begin].submit_time};
+    job.reqs.reserve(count);
+    for (size_t i = begin; i < begin + count; i++) {
+      job.reqs.push_back(std::move(batch_[i]));
+    }
+    waiting_.push_back(std::move(job));
+    register_jobs_++;
+    begin += count;
+  }
+  batch_.erase(batch_.begin(), batch_.begin() + begin);
+}
+
+void AsyncSql::Abort(Job &job, Result result) {
+  if (!job.is_login) {
+    register_jobs_--;
+  }
+  for (Request &req : job.reqs) {
+    req.cb(result);
+  }
+}
+
+void AsyncSql::ExpireWaiting() {
+  auto now = std::chrono::steady_clock::now();
+  auto timeout = std::chrono::milliseconds(pool_->AcquireTimeout());
+  // 查询按排队顺序等待，队首的期限最早
+  while (!waiting_.empty() && waiting_.front().submit_time + timeout <= now) {
+    Job job = std::move(waiting_.front());
+    waiting_.pop_front();
+    pool_->RecordWait(std::chrono::duration_cast<std::chrono::microseconds>(now - job.submit_time).count(), true);
+    LOG_WARN("SqlConnPool busy, verify name:%s%s timeout", job.reqs.front().user.c_str(),
+             job.reqs.size() > 1 ? " ..." : "");
+    OnDequeued(job, false);
+    Abort(job, RESULT_UNAVAILABLE);
+  }
+  std::chrono::steady_clock::duration left = std::chrono::steady_clock::duration::max();
+  if (!waiting_.empty()) {
+    left = waiting_.front().submit_time + timeout - now;
+  }
+  if (!batch_.empty()) {
+    left = std::min<std::chrono::steady_clock::duration>(left, batch_.front().submit_time + batch_delay_ - now);
+  }
+  itimerspec spec = {};
+  if (left != std::chrono::steady_clock::duration::max()) {
+    // 至少 1 纳秒，全为 0 会停止定时器
+    auto ns = std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(left).count(), 1);
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+  }
+  // 全为 0 时停止定时器
+  timerfd_settime(timer_fd_, 0, &spec, nullptr);
+}
+
+void AsyncSql::StartWaiting() {
+  while (!waiting_.empty()) {
+    SqlConn *conn = pool_->TryGetConn();
+    if (conn == nullptr) {
+      if (pool_->IsDown()) {
+        // 数据库不可用，不必等到期限
+        Job job = std::move(waiting_.front());
+        waiting_.pop_front();
+        pool_->RecordWait(0, true);
+        OnDequeued(job, false);
+        Abort(job, RESULT_UNAVAILABLE);
+        continue;
+      }
+      // 连接都在使用中，有连接归还或新建时再继续
+      if (!notify_registered_.exchange(true)) {
+        pool_->NotifyOnFree(this, [this] {
+          notify_registered_.store(false);
+          Wake();
+        });
+      }
+      return;
+    }
+    size_t slot = 0;
+    while (slot < ops_.size() && ops_[slot].conn != nullptr) {
+      slot++;
+    }
+    if (slot == ops_.size()) {
+      ops_.emplace_back();
+    }
+    Op &op = ops_[slot];
+    op.conn = conn;
+    op.stage = QUERY;
+    op.job = std::move(waiting_.front());
+    waiting_.pop_front();
+    pool_->RecordWait(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - op.job.submit_time)
+            .count(),
+        false);
+    OnDequeued(op.job, true);
+    std::vector<Request> &reqs = op.job.reqs;
+    if (reqs.size() == 1) {
+      // 不记录密码
+      LOG_INFO("Verify name:%s", reqs[0].user.c_str());
+      if (op.job.is_login) {
+        op.query = conn->ExecuteQuery(SqlConn::STMT_LOGIN, &reqs[0].user, 1);
+      } else {
+        const std::string args[] = {reqs[0].user, reqs[0].password};
+        op.query = conn->ExecuteQuery(SqlConn::STMT_REGISTER, args, 2);
+      }
+    } else {
+      LOG_INFO("Register batch: %zu users", reqs.size());
+      // 同一批中重复的用户名只插入第一个
+      std::unordered_set<std::string_view> seen;
+      std::vector<std::string_view> users, passwords;
+      for (const Request &req : reqs) {
+        if (seen.insert(req.user).second) {
+          users.push_back(req.user);
+          passwords.push_back(req.password);
+        }
+      }
+      op.query = conn->RegisterBatchQuery(users, passwords);
+    }
+
+    epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.u64 = slot;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, conn->Get()->net.fd, &ev);
+    bool ok = false;
+    if (Drive(op, &ok)) {
+      Finish(slot, ok);
+    }
+  }
+}
+
+auto AsyncSql::Drive(Op &op, bool *ok) -> bool {
+  MYSQL *sql = op.conn->Get();
+  while (true) {
+    net_async_status status = NET_ASYNC_ERROR;
+    MYSQL_RES *res = nullptr;
+    switch (op.stage) {
+      case QUERY:
+        // 未完成时须以相同参数再次调用
+        status = mysql_real_query_nonblocking(sql, op.query.data(), op.query.size());
+        break;
+      case NEXT:
+        status = mysql_next_result_nonblocking(sql);
+        break;
+      case STORE:
+        status = mysql_store_result_nonblocking(sql, &res);
+        break;
+    }
+    if (status == NET_ASYNC_NOT_READY) {
+      return false;
+    }
+    if (status == NET_ASYNC_ERROR) {
+      OnError(op);
+      *ok = false;
+      return true;
+    }
+    if (op.stage == STORE) {
+      if (res != nullptr) {
+        while (MYSQL_ROW row = mysql_fetch_row(res)) {
+          if (row[0] != nullptr) {
+            op.rows.emplace_back(row[0]);
+          }
+        }
+        // 结果已全部读入内存，释放时没有网络交互
+        mysql_free_result(res);
+      }
+    } else if (mysql_field_count(sql) > 0) {
+      op.stage = STORE;
+      continue;
+    } else {
+      op.affected = mysql_affected_rows(sql);
+    }
+    if (!mysql_more_results(sql)) {
+      *ok = true;
+      return true;
+    }
+    op.stage = NEXT;
+  }
+}
+
+void AsyncSql::OnError(Op &op) {
+  static const char *const STAGE_NAMES[] = {"query", "next result", "store result"};
+  MYSQL *sql = op.conn->Get();
+  LOG_WARN("MySql %s error: %s", STAGE_NAMES[op.stage], mysql_error(sql));
+  unsigned int err = mysql_errno(sql);
+  // 连接断开，或服务端丢失了预处理的语句
+  if (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST || err == ER_UNKNOWN_STMT_HANDLER) {
+    op.conn->MarkBroken();
+  }
+  // 出错后剩余的语句不再执行，事务没有结束；重新连接时服务端回滚
+  if (!op.job.is_login && op.job.reqs.size() > 1) {
+    op.conn->MarkBroken();
+  }
+}
+
+void AsyncSql::Finish(size_t slot, bool ok) {
+  Op &op = ops_[slot];
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, op.conn->Get()->net.fd, nullptr);
+  pool_->FreeConn(op.conn);
+  Job job = std::move(op.job);
+  std::vector<std::string> rows = std::move(op.rows);
+  uint64_t affected = op.affected;
+  op = Op();
+  running_.fetch_sub(1, std::memory_order_relaxed);
+  // 回调中可能提交新的查询，槽位已先释放
+  if (!ok) {
+    Abort(job, RESULT_UNAVAILABLE);
+    return;
+  }
+  if (job.is_login) {
+    Request &req = job.reqs[0];
+    bool found = !rows.empty();
+    Result result = found && req.password == rows[0] ? RESULT_OK : RESULT_FAILED;
+    if (cache_ != nullptr) {
+      // 用户不存在也记录下来，过滤器误判的用户名不会反复查询数据库
+      cache_->Put(req.user, found ? rows[0] : "", found);
+    }
+    LOG_DEBUG("UserVerify %s!", result == RESULT_OK ? "success" : "pwd error");
+    req.cb(result);
+    return;
+  }
+  register_jobs_--;
+  // 单个注册：用户名已存在时不插入任何行；一批注册：查询到的是已存在的用户名
+  std::unordered_set<std::string_view> existing(rows.begin(), rows.end());
+  std::unordered_set<std::string_view> inserted;
+  for (Request &req : job.reqs) {
+    Result result = RESULT_FAILED;
+    if (job.reqs.size() == 1 ? affected == 1 : existing.count(req.user) == 0 && inserted.count(req.user) == 0) {
+      result = RESULT_OK;
+      inserted.insert(req.user);
+    }
+    LOG_DEBUG("%s", result == RESULT_OK ? "regirster!" : "user used!");
+    if (cache_ != nullptr) {
+      if (result == RESULT_OK) {
+        cache_->AddUser(req.user, req.password);
+      } else if (inserted.count(req.user) == 0) {
+        // 用户已存在，但不知道密码；同一批中先注册的用户已写入缓存
+        cache_->Invalidate(req.user);
+      }
+    }
+    req.cb(result);
+  }
+}
@@ -0,0 +1,171 @@
+#ifndef ASYNCSQL_H
+#define ASYNCSQL_H
+
+#include <mysql/mysql.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../log/log.h"
+#include "sqlconnpool.h"
+#include "usercache.h"
+
+// 基于 MySQL 8 C API 非阻塞接口(mysql_real_query_nonblocking 等)的数据库执行器，每个 Reactor 一个。
+// 任意线程都可以提交查询；查询在 Reactor 线程中推进：数据库连接的套接字登记在执行器内部的 epoll 中，
+// 这个 epoll 的 fd 再登记到 Reactor，可读时由 Reactor 调用 OnReady 继续执行，
+// 查询完成后在 Reactor 线程中执行回调。整个过程中没有线程阻塞在数据库上。
+// 连接从 SqlConnPool 中按需取用，没有空闲连接时请求排队，有连接归还时再继续；
+// 排队超过连接池的获取期限，或数据库不可用时，请求以 RESULT_UNAVAILABLE 结束。
+// 查询执行连接上预处理好的语句，设置参数与执行在一个请求中发送。
+// 查询之前先查 UserCache，缓存能确定结果时不访问数据库；查询结果写回缓存。
+// 注册按组提交：没有注册在进行时立即执行；否则先攒批，等进行中的注册结束、攒够 batchMax 个，
+// 或最早的请求已等待 batchDelayUs 时，在一个事务中一次插入，每个请求仍得到各自的结果。
+// 执行器是可能阻塞的工作的独立通道，与处理静态文件的线程互不占用：排队的请求数有上限 maxQueued，
+// 超过时新请求立即以 RESULT_UNAVAILABLE 结束，数据库变慢时不会无限积压。
+class AsyncSql {
+ public:
+  enum Result {
+    // 验证通过
+    RESULT_OK = 0,
+    // 用户名或密码错误，注册时用户名已存在
+    RESULT_FAILED,
+    // 没有及时取得数据库连接，或查询出错
+    RESULT_UNAVAILABLE,
+  };
+  using Callback = std::function<void(Result)>;
+
+  // 运行统计
+  struct Stats {
+    // 排队中(未开始执行)的请求数与执行中的查询数
+    int queued;
+    int running;
+    // 开始执行的请求数，以及这些请求的累计排队时间与最长排队时间(微秒)
+    uint64_t started;
+    uint64_t wait_us_total;
+    uint64_t wait_us_max;
+    // 因队列已满被拒绝的请求数，排队超过期限或数据库不可用而未执行的请求数
+    uint64_t rejected;
+    uint64_t expired;
+  };
+
+  // cache 为空时不使用缓存；batchMax 为一次提交的注册数上限，batchDelayUs 为注册攒批的最长等待时间；
+  // maxQueued 为排队请求数的上限
+  AsyncSql(SqlConnPool *pool, UserCache *cache, size_t batchMax, int batchDelayUs, int maxQueued);
+  ~AsyncSql();
+
+  AsyncSql(const AsyncSql &) = delete;
+  auto operator=(const AsyncSql &) -> AsyncSql & = delete;
+
+  // 登记到 Reactor 的 fd，可读时调用 OnReady
+  auto Fd() const -> int { return epoll_fd_; }
+
+  // 验证用户：isLogin 为 true 时检查密码，否则注册新用户。可在任意线程调用。
+  // 缓存能确定结果或队列已满时在调用线程中立即执行回调，否则在 Reactor 线程中执行
+  void Verify(std::string user, std::string password, bool isLogin, Callback cb);
+
+  // 可在任意线程调用
+  auto GetStats() const -> Stats;
+
+  // Reactor 线程：接收新提交的请求并推进所有进行中的查询，完成的查询在这里执行回调
+  void OnReady();
+
+ private:
+  // 一次查询在一个连接上经过的阶段，请求中的每条语句依次读取结果
+  enum Stage {
+    // 发送请求，读取第一条语句的结果
+    QUERY,
+    // 读取下一条语句的结果
+    NEXT,
+    // 语句有结果集时读取其中的行
+    STORE,
+  };
+
+  struct Request {
+    std::string user;
+    std::string password;
+    bool is_login;
+    Callback cb;
+    // 提交的时间，用于计算获取连接的等待时间与期限
+    std::chrono::steady_clock::time_point submit_time;
+  };
+
+  // 在一个连接上执行的一次查询：一个登录，或一批注册
+  struct Job {
+    bool is_login;
+    std::vector<Request> reqs;
+    // 最早的提交时间
+    std::chrono::steady_clock::time_point submit_time;
+  };
+
+  struct Op {
+    SqlConn *conn = nullptr;
+    Stage stage = QUERY;
+    std::string query;
+    Job job;
+    // 结果集中第一列的值；最后一条没有结果集的语句的影响行数
+    std::vector<std::string> rows;
+    uint64_t affected = 0;
+  };
+
+  // 攒批的注册满足条件时作为一次查询排队
+  void FlushBatch();
+  // 有空闲连接时开始排队中的查询
+  void StartWaiting();
+  // 结束等待超过期限的查询，并按最早的期限(含注册攒批的期限)设置定时器
+  void ExpireWaiting();
+  // 推进一个查询，完成时返回 true，ok 表示各语句均执行成功
+  auto Drive(Op &op, bool *ok) -> bool;
+  // 查询结束：归还连接，按查询结果执行每个请求的回调
+  void Finish(size_t slot, bool ok);
+  // 未执行的查询以 result 结束
+  void Abort(Job &job, Result result);
+  // 排队中的请求开始执行或不再执行时更新统计
+  void OnDequeued(const Job &job, bool started);
+  // 查询出错：记录日志；连接断开、语句丢失，或事务中出错时标记连接，归还后重新连接
+  static void OnError(Op &op);
+  // 唤醒 Reactor 线程
+  void Wake();
+
+  SqlConnPool *pool_;
+  UserCache *cache_;
+  int epoll_fd_;
+  int wake_fd_;
+  // 等待连接的请求的期限
+  int timer_fd_;
+
+  // 其它线程提交的请求
+  std::mutex mtx_;
+  std::vector<Request> submitted_;
+
+  // 以下只在 Reactor 线程访问
+  // 等待空闲连接的查询
+  std::deque<Job> waiting_;
+  // 攒批中的注册
+  std::vector<Request> batch_;
+  size_t batch_max_;
+  std::chrono::microseconds batch_delay_;
+  // 排队或执行中的注册查询数
+  int register_jobs_ = 0;
+  // 进行中的查询，下标作为 epoll 事件的 data；conn 为空的槽位空闲
+  std::vector<Op> ops_;
+  // 是否已向连接池登记了归还通知，通知在归还连接的线程中清除
+  std::atomic<bool> notify_registered_;
+
+  // 统计，GetStats 可能在其它线程读取
+  int max_queued_;
+  std::atomic<int> queued_{0};
+  std::atomic<int> running_{0};
+  std::atomic<uint64_t> started_{0};
+  std::atomic<uint64_t> wait_us_total_{0};
+  std::atomic<uint64_t> wait_us_max_{0};
+  std::atomic<uint64_t> rejected_{0};
+  std::atomic<uint64_t> expired_{0};
+};
+
+#endif  // ASYNCSQL_H
@@ -0,0 +1,124 @@
+#include "sqlconn.h"
+
+#include <cassert>
+
+namespace {
+struct StmtInfo {
+  const char *name;
+  const char *sql;
+  // EXECUTE 时依次使用的参数下标，同一个参数可以出现多次
+  const char *using_args;
+};
+
+// 注册不再先查询再插入：用户名已存在时 INSERT ... SELECT 不插入任何行，一次往返完成
+const StmtInfo STMTS[SqlConn::STMT_COUNT] = {
+    {"login_stmt", "SELECT password FROM user WHERE username = ? LIMIT 1", "@p0"},
+    {"register_stmt",
+     "INSERT INTO user(username, password) SELECT ?, ? FROM DUAL "
+     "WHERE NOT EXISTS (SELECT 1 FROM user WHERE username = ?)",
+     "@p0, @p1, @p0"},
+};
+}  // namespace
+
+auto SqlConn::Connect(const char *host, int port, const char *user, const char *pwd, const char *dbName) -> bool {
+  host_ = host;
+  port_ = port;
+  user_ = user;
+  pwd_ = pwd;
+  db_name_ = dbName;
+  return Reconnect();
+}
+
+auto SqlConn::Reconnect() -> bool {
+  Close();
+  sql_ = mysql_init(nullptr);
+  if (sql_ == nullptr) {
+    LOG_ERROR("MySql init error!");
+    return false;
+  }
+  // 连接在后台线程中建立，数据库无响应时不能无限等待
+  unsigned int timeout = CONNECT_TIMEOUT_S;
+  mysql_options(sql_, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+  // 设置参数与执行语句在同一个请求中发送，需要开启多语句
+  if (mysql_real_connect(sql_, host_.c_str(), user_.c_str(), pwd_.c_str(), db_name_.c_str(), port_, nullptr,
+                         CLIENT_MULTI_STATEMENTS) == nullptr) {
+    LOG_ERROR("MySql Connect error: %s", mysql_error(sql_));
+    Close();
+    return false;
+  }
+  if (!Prepare()) {
+    Close();
+    return false;
+  }
+  broken_ = false;
+  return true;
+}
+
+auto SqlConn::Prepare() -> bool {
+  for (const StmtInfo &stmt : STMTS) {
+    std::string query = std::string("PREPARE ") + stmt.name + " FROM '" + stmt.sql + "'";
+    if (mysql_real_query(sql_, query.data(), query.size()) != 0) {
+      LOG_ERROR("MySql prepare %s error: %s", stmt.name, mysql_error(sql_));
+      return false;
+    }
+  }
+  return true;
+}
+
+void SqlConn::Close() {
+  if (sql_ != nullptr) {
+    mysql_close(sql_);
+    sql_ = nullptr;
+  }
+}
+
+void SqlConn::AppendQuoted(std::string *query, std::string_view arg) const {
+  *query += '\'';
+  size_t pos = query->size();
+  query->resize(pos + arg.size() * 2 + 1);
+  unsigned long len = mysql_real_escape_string(sql_, &(*query)[pos], arg.data(), arg.size());
+  query->resize(pos + len);
+  *query += '\'';
+}
+
+auto SqlConn::ExecuteQuery(Stmt stmt, const std::string *args, int argCount) const -> std::string {
+  assert(stmt < STMT_COUNT);
+  std::string query = "SET ";
+  for (int i = 0; i < argCount; i++) {
+    if (i > 0) {
+      query += ',';
+    }
+    query += "@p" + std::to_string(i) + "=";
+    AppendQuoted(&query, args[i]);
+  }
+  query += ";EXECUTE ";
+  query += STMTS[stmt].name;
+  query += " USING ";
+  query += STMTS[stmt].using_args;
+  return query;
+}
+
+auto SqlConn::RegisterBatchQuery(const std::vector<std::string_view> &users,
+                                 const std::vector<std::string_view> &passwords) const -> std::string {
+  assert(!users.empty() && users.size() == passwords.size());
+  // 加锁读取：并发的批次在同名用户上互相等待，查到的就是插入时已存在的用户名
+  std::string query = "START TRANSACTION;SELECT username FROM user WHERE username IN (";
+  for (size_t i = 0; i < users.size(); i++) {
+    if (i > 0) {
+      query += ',';
+    }
+    AppendQuoted(&query, users[i]);
+  }
+  query += ") FOR UPDATE;INSERT INTO user(username, password) SELECT t.username, t.password FROM (";
+  for (size_t i = 0; i < users.size(); i++) {
+    query += i > 0 ? " UNION ALL SELECT " : "SELECT ";
+    AppendQuoted(&query, users[i]);
+    query += i > 0 ? "," : " AS username,";
+    AppendQuoted(&query, passwords[i]);
+    if (i == 0) {
+      query += " AS password";
+    }
+  }
+  query += ") AS t WHERE NOT EXISTS (SELECT 1 FROM user WHERE user.username = t.username);COMMIT";
+  return query;
+}
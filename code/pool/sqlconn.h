@@ -0,0 +1,77 @@
+#ifndef SQLCONN_H
+#define SQLCONN_H
+
+#include <mysql/mysql.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../log/log.h"
+
+// 连接池中的一个数据库连接。
+// 建立连接后立即在服务端预处理(PREPARE)登录与注册用到的语句，之后每次只需以参数执行，
+// 服务端不再重复解析语句，用户输入只作为参数值传递。重新连接后语句随之重新预处理。
+// 非阻塞接口(mysql_real_query_nonblocking)不支持二进制协议的 MYSQL_STMT，
+// 因此这里使用 SQL 层的 PREPARE/EXECUTE：设置参数与执行语句合在一个请求里发送，仍是一次往返。
+class SqlConn {
+ public:
+  // 预处理的语句
+  enum Stmt {
+    // 参数：用户名；结果：password 一列，最多一行
+    STMT_LOGIN = 0,
+    // 参数：用户名、密码；用户名不存在时插入，影响行数为 1 表示注册成功
+    STMT_REGISTER,
+    STMT_COUNT,
+  };
+
+  // id 为连接在连接池中的序号
+  explicit SqlConn(int id) : id_(id) {}
+  ~SqlConn() { Close(); }
+
+  SqlConn(const SqlConn &) = delete;
+  auto operator=(const SqlConn &) -> SqlConn & = delete;
+
+  // 建立连接并预处理所有语句，失败时返回 false
+  auto Connect(const char *host, int port, const char *user, const char *pwd, const char *dbName) -> bool;
+  // 以上次的参数重新连接，语句随之重新预处理
+  auto Reconnect() -> bool;
+  void Close();
+  // 检查连接是否仍然可用
+  auto Ping() -> bool { return sql_ != nullptr && mysql_ping(sql_) == 0; }
+
+  auto Id() const -> int { return id_; }
+  auto Get() const -> MYSQL * { return sql_; }
+  // 查询中出现网络错误时标记，归还连接池后重新连接
+  void MarkBroken() { broken_ = true; }
+  auto IsBroken() const -> bool { return broken_; }
+
+  // 生成以 args 为参数执行 stmt 的请求文本(参数已转义)。
+  // 请求包含两条语句：第一条设置参数，没有结果；第二条为 EXECUTE
+  auto ExecuteQuery(Stmt stmt, const std::string *args, int argCount) const -> std::string;
+  // 生成在一个事务中注册多个用户的请求文本，users 中没有重复的用户名。
+  // 请求包含四条语句：开始事务；锁定并查询已存在的用户名(结果为 username 一列)；
+  // 一次插入其余的用户；提交。语句数量随人数变化，无法预处理，参数直接转义后写入文本
+  auto RegisterBatchQuery(const std::vector<std::string_view> &users,
+                          const std::vector<std::string_view> &passwords) const -> std::string;
+
+ private:
+  // 建立连接的超时时间(秒)
+  static constexpr unsigned int CONNECT_TIMEOUT_S = 3;
+
+  auto Prepare() -> bool;
+  // 将 arg 转义后加上单引号追加到 query
+  void AppendQuoted(std::string *query, std::string_view arg) const;
+
+  int id_;
+  MYSQL *sql_ = nullptr;
+  bool broken_ = false;
+  // 重新连接时使用
+  std::string host_;
+  int port_ = 0;
+  std::string user_;
+  std::string pwd_;
+  std::string db_name_;
+};
+
+#endif  // SQLCONN_H
@@ -7,7 +7,7 @@
 /* 资源在对象构造初始化 资源在对象析构时释放*/
 class SqlConnRAII {
  public:
-  SqlConnRAII(MYSQL **sql, SqlConnPool *connpool) {
+  SqlConnRAII(SqlConn **sql, SqlConnPool *connpool) {
     assert(connpool);
     *sql = connpool->GetConn();
     sql_ = *sql;
@@ -21,7 +21,7 @@ class SqlConnRAII {
   }
 
  private:
-  MYSQL *sql_;
+  SqlConn *sql_;
   SqlConnPool *connpool_;
 };
 
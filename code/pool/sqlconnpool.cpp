@@ -1,84 +1,365 @@
 #include "sqlconnpool.h"
 
+#include <algorithm>
 #include <cassert>
 
-SqlConnPool::SqlConnPool() {
-  use_count_ = 0;
-  free_count_ = 0;
-}
-
 auto SqlConnPool::Instance() -> SqlConnPool * {
   static SqlConnPool conn_pool;
   return &conn_pool;  // 使用局部静态变量实现单例模式，确保全局唯一的实例，并返回实例的指针
 }
 
-void SqlConnPool::Init(const char *host, int port, const char *user,
-                       const char *pwd, const char *dbName, int connSize = 10) {
-  assert(connSize > 0);
-  for (int i = 0; i < connSize; i++) {
-    MYSQL *sql = nullptr;  // 一个MYSQL对象在MySQL C API中
-    // 代表一个到MySQL数据库服务器的连接。
+void SqlConnPool::Init(const char *host, int port, const char *user, const char *pwd, const char *dbName,
+                       int minConn, int maxConn, int acquireTimeoutMs) {
+  assert(maxConn > 0 && minConn >= 0 && minConn <= maxConn);
+  host_ = host;
+  port_ = port;
+  user_ = user;
+  pwd_ = pwd;
+  db_name_ = dbName;
+  min_conn_ = minConn;
+  max_conn_ = maxConn;
+  acquire_timeout_ms_ = acquireTimeoutMs;
+  slots_.resize(maxConn);
+  for (int i = 0; i < maxConn; i++) {
+    slots_[i].conn = std::make_unique<SqlConn>(i);
+  }
 
-    sql = mysql_init(sql);
-    // 初始化一个MYSQL对象，用于后续的连接操作。
-    // 如果传入的MYSQL指针是nullptr，这个函数会分配、初始化一个新的对象，并返回这个对象的指针。
-    if (sql == nullptr) {
-      // LOG_ERROR("MySql init error!");
-      assert(sql);
-    }
-    sql = mysql_real_connect(sql, host, user, pwd, dbName, port, nullptr, 0);
-    // 用于建立到数据库的连接。它需要传入通过mysql_init初始化的MYSQL对象，
-    // 数据库服务器的地址（host）、用户名（user）、密码（pwd）、数据库名（dbName）、端口号（port），
-    // 以及其他可选的参数如UNIX套接字和客户端标志。
-    // 如果连接成功，返回MYSQL对象的指针；如果失败，返回nullptr。
-
-    if (sql == nullptr) {
-      // LOG_ERROR("MySql Connect error!");
+  // 启动时的连接并行建立，总耗时约等于一次连接
+  std::vector<int> ids;
+  for (int i = 0; i < minConn; i++) {
+    ids.push_back(i);
+  }
+  std::vector<char> ok;
+  ConnectAll(ids, ok);
+  std::vector<std::function<void()>> notify;
+  for (int id : ids) {
+    if (ok[id] != 0) {
+      live_++;
+      PutIdleLocked(slots_[id], notify);
+    } else {
+      // 交给后台线程重试
+      slots_[id].state = SLOT_PENDING;
+      stats_.connect_failures++;
     }
-    conn_que_.push(sql);
   }
-  max_conn_ = connSize;
-  sem_init(&sem_id_, 0, max_conn_);
-  // pashred指示信号量是在进程间共享还是线程间共享。
-  // 如果pshared的值为0，信号量将只能被初始化它的进程的所有线程共享；
-  // 如果pshared的值非0，信号量可以在多个进程间共享。
+  down_ = minConn > 0 && live_ == 0;
+  if (down_) {
+    LOG_ERROR("MySql Connect error!");
+  }
+  stop_ = false;
+  maintainer_ = std::thread([this] { Maintain(); });
 }
 
-auto SqlConnPool::GetConn() -> MYSQL * {
-  MYSQL *sql = nullptr;
-  if (conn_que_.empty()) {
-    // LOG_WARN("SqlConnPool busy!");
+void SqlConnPool::ConnectAll(const std::vector<int> &ids, std::vector<char> &ok) {
+  ok.assign(slots_.size(), 0);
+  auto connect = [this, &ok](int id) {
+    Slot &slot = slots_[id];
+    ok[id] = slot.reconnect ? slot.conn->Reconnect()
+                            : slot.conn->Connect(host_.c_str(), port_, user_.c_str(), pwd_.c_str(), db_name_.c_str());
+  };
+  if (ids.size() == 1) {
+    connect(ids[0]);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int id : ids) {
+    threads.emplace_back(connect, id);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void SqlConnPool::PutIdleLocked(Slot &slot, std::vector<std::function<void()>> &notify) {
+  slot.state = SLOT_IDLE;
+  slot.last_used = Clock::now();
+  idle_.push_back(slot.conn->Id());
+  free_cv_.notify_one();
+  for (auto &waiter : waiters_) {
+    notify.push_back(std::move(waiter.second));
+  }
+  waiters_.clear();
+}
+
+auto SqlConnPool::TakeLocked() -> SqlConn * {
+  if (!idle_.empty()) {
+    Slot &slot = slots_[idle_.back()];
+    idle_.pop_back();
+    slot.state = SLOT_IN_USE;
+    in_use_++;
+    return slot.conn.get();
+  }
+  // 没有空闲conn时按需扩容：没有正在建立的连接时，再并行建立约一半的现有数量(至少一个)
+  if (down_) {
     return nullptr;
   }
-  sem_wait(&sem_id_);
+  for (const Slot &slot : slots_) {
+    if (slot.state == SLOT_PENDING || slot.state == SLOT_CONNECTING) {
+      return nullptr;
+    }
+  }
+  int grow = std::max(1, live_ / 2);
+  for (Slot &slot : slots_) {
+    if (grow > 0 && slot.state == SLOT_CLOSED) {
+      slot.state = SLOT_PENDING;
+      slot.reconnect = false;
+      grow--;
+    }
+  }
+  maint_cv_.notify_one();
+  return nullptr;
+}
+
+auto SqlConnPool::GetConn(int timeoutMs) -> SqlConn * {
+  if (timeoutMs < 0) {
+    timeoutMs = acquire_timeout_ms_;
+  }
+  Clock::time_point start = Clock::now();
+  Clock::time_point deadline = start + std::chrono::milliseconds(timeoutMs);
+  std::unique_lock<std::mutex> lock(mtx_);
+  SqlConn *conn = TakeLocked();
+  while (conn == nullptr && !down_ && !stop_) {
+    if (free_cv_.wait_until(lock, deadline) == std::cv_status::timeout) {
+      conn = TakeLocked();
+      break;
+    }
+    conn = TakeLocked();
+  }
+  uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+  lock.unlock();
+  if (conn == nullptr) {
+    LOG_WARN("SqlConnPool busy!");
+  }
+  RecordWait(wait_us, conn == nullptr);
+  return conn;
+}
+
+auto SqlConnPool::TryGetConn() -> SqlConn * {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return TakeLocked();
+}
+
+void SqlConnPool::FreeConn(SqlConn *conn) {
+  assert(conn);
+  std::vector<std::function<void()>> notify;
   {
     std::lock_guard<std::mutex> lock(mtx_);
-    sql = conn_que_.front();
-    conn_que_.pop();
+    Slot &slot = slots_[conn->Id()];
+    assert(slot.state == SLOT_IN_USE);
+    in_use_--;
+    if (conn->IsBroken()) {
+      // 重新连接可能耗时很久，不在归还的线程(事件循环)中进行
+      live_--;
+      slot.state = SLOT_PENDING;
+      slot.reconnect = true;
+      maint_cv_.notify_one();
+    } else {
+      PutIdleLocked(slot, notify);
+    }
+  }
+  // 通知在锁外执行，被通知方会再次尝试 TryGetConn
+  for (auto &fn : notify) {
+    fn();
   }
-  return sql;
 }
 
-void SqlConnPool::FreeConn(MYSQL *conn) {
-  assert(conn);
+void SqlConnPool::NotifyOnFree(const void *owner, std::function<void()> notify) {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (idle_.empty()) {
+      waiters_.emplace_back(owner, std::move(notify));
+      return;
+    }
+  }
+  notify();
+}
+
+void SqlConnPool::CancelNotify(const void *owner) {
   std::lock_guard<std::mutex> lock(mtx_);
-  conn_que_.push(conn);
-  sem_post(&sem_id_);
+  waiters_.erase(std::remove_if(waiters_.begin(), waiters_.end(),
+                                [owner](const auto &waiter) { return waiter.first == owner; }),
+                 waiters_.end());
+}
+
+void SqlConnPool::RecordWait(uint64_t waitUs, bool timeout) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (timeout) {
+    stats_.timeouts++;
+  } else {
+    stats_.acquires++;
+  }
+  stats_.wait_us_total += waitUs;
+  stats_.wait_us_max = std::max(stats_.wait_us_max, waitUs);
+}
+
+void SqlConnPool::Maintain() {
+  Clock::time_point next_log = Clock::now() + std::chrono::milliseconds(STATS_LOG_MS);
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (!stop_) {
+    Clock::time_point now = Clock::now();
+    // 需要建立或重新建立的连接
+    std::vector<int> connect_ids;
+    for (Slot &slot : slots_) {
+      if (slot.state == SLOT_PENDING) {
+        slot.state = SLOT_CONNECTING;
+        connect_ids.push_back(slot.conn->Id());
+      }
+    }
+    // 空闲过久的连接：多于 minConn 的关闭，其余检查是否仍然可用
+    std::vector<int> check_ids;
+    for (size_t i = 0; i < idle_.size();) {
+      Slot &slot = slots_[idle_[i]];
+      auto idle_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - slot.last_used).count();
+      if (idle_ms >= IDLE_TIMEOUT_MS && live_ > min_conn_) {
+        slot.conn->Close();
+        slot.state = SLOT_CLOSED;
+        live_--;
+      } else if (idle_ms >= HEALTH_CHECK_MS) {
+        slot.state = SLOT_CHECKING;
+        check_ids.push_back(idle_[i]);
+      } else {
+        i++;
+        continue;
+      }
+      idle_.erase(idle_.begin() + i);
+    }
+
+    if (!connect_ids.empty() || !check_ids.empty()) {
+      lock.unlock();
+      std::vector<char> connected;
+      ConnectAll(connect_ids, connected);
+      std::vector<char> alive(slots_.size(), 0);
+      for (int id : check_ids) {
+        alive[id] = slots_[id].conn->Ping();
+      }
+      lock.lock();
+      std::vector<std::function<void()>> notify;
+      bool failed = false;
+      for (int id : connect_ids) {
+        Slot &slot = slots_[id];
+        if (stop_) {
+          slot.state = SLOT_CLOSED;
+        } else if (connected[id] != 0) {
+          if (slot.reconnect) {
+            stats_.reconnects++;
+          }
+          slot.reconnect = false;
+          live_++;
+          PutIdleLocked(slot, notify);
+        } else {
+          // 稍后重试
+          slot.state = SLOT_PENDING;
+          slot.reconnect = true;
+          stats_.connect_failures++;
+          failed = true;
+        }
+      }
+      for (int id : check_ids) {
+        Slot &slot = slots_[id];
+        if (alive[id] != 0) {
+          PutIdleLocked(slot, notify);
+        } else {
+          LOG_WARN("MySql conn[%d] lost, reconnecting", id);
+          live_--;
+          slot.state = stop_ ? SLOT_CLOSED : SLOT_PENDING;
+          slot.reconnect = true;
+        }
+      }
+      bool was_down = down_;
+      down_ = failed && live_ == 0;
+      if (down_ && !was_down) {
+        LOG_ERROR("MySql unavailable, retry every %d ms", RETRY_MS);
+      } else if (!down_ && was_down) {
+        LOG_INFO("MySql available again");
+      }
+      if (down_) {
+        // 数据库不可用，唤醒等待者让其立即失败
+        free_cv_.notify_all();
+      }
+      if (!notify.empty()) {
+        lock.unlock();
+        for (auto &fn : notify) {
+          fn();
+        }
+        lock.lock();
+      }
+      if (failed) {
+        maint_cv_.wait_for(lock, std::chrono::milliseconds(RETRY_MS), [this] { return stop_; });
+      }
+      continue;
+    }
+
+    now = Clock::now();
+    if (now >= next_log) {
+      next_log = now + std::chrono::milliseconds(STATS_LOG_MS);
+      lock.unlock();
+      LogStats();
+      lock.lock();
+      continue;
+    }
+    // 最早需要检查的空闲连接
+    Clock::time_point wake = next_log;
+    for (int id : idle_) {
+      wake = std::min(wake, slots_[id].last_used + std::chrono::milliseconds(HEALTH_CHECK_MS));
+    }
+    maint_cv_.wait_until(lock, wake, [this] {
+      return stop_ || std::any_of(slots_.begin(), slots_.end(), [](const Slot &s) { return s.state == SLOT_PENDING; });
+    });
+  }
+}
+
+void SqlConnPool::LogStats() {
+  Stats stats = GetStats();
+  uint64_t count = stats.acquires + stats.timeouts;
+  LOG_INFO("SqlConnPool total:%d in_use:%d idle:%d acquires:%llu timeouts:%llu avg_wait:%lluus max_wait:%lluus "
+           "reconnects:%llu connect_failures:%llu",
+           stats.total, stats.in_use, stats.idle, static_cast<unsigned long long>(stats.acquires),
+           static_cast<unsigned long long>(stats.timeouts),
+           static_cast<unsigned long long>(count == 0 ? 0 : stats.wait_us_total / count),
+           static_cast<unsigned long long>(stats.wait_us_max), static_cast<unsigned long long>(stats.reconnects),
+           static_cast<unsigned long long>(stats.connect_failures));
+}
+
+auto SqlConnPool::GetStats() -> Stats {
+  std::lock_guard<std::mutex> lock(mtx_);
+  Stats stats = stats_;
+  stats.total = live_;
+  stats.in_use = in_use_;
+  stats.idle = static_cast<int>(idle_.size());
+  return stats;
+}
+
+auto SqlConnPool::IsDown() -> bool {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return down_ && idle_.empty();
 }
 
 void SqlConnPool::ClosePool() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (stop_) {
+      return;
+    }
+    stop_ = true;
+  }
+  maint_cv_.notify_all();
+  free_cv_.notify_all();
+  if (maintainer_.joinable()) {
+    maintainer_.join();
+  }
   std::lock_guard<std::mutex> lock(mtx_);
-  while (!conn_que_.empty()) {
-    auto item = conn_que_.front();
-    conn_que_.pop();
-    mysql_close(item);
+  for (Slot &slot : slots_) {
+    slot.conn->Close();
+    slot.state = SLOT_CLOSED;
   }
+  idle_.clear();
+  live_ = in_use_ = 0;
   mysql_library_end();  // 在程序结束时调用，清理分配给MySQL客户端库的资源。
 }
 
 auto SqlConnPool::GetFreeConnCount() -> int {
   std::lock_guard<std::mutex> lock(mtx_);
-  return conn_que_.size();
+  return static_cast<int>(idle_.size());
 }
 
 SqlConnPool::~SqlConnPool() { ClosePool(); }
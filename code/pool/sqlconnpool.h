@@ -2,39 +2,137 @@
 #define SQLCONNPOOL_H
 
 #include <mysql/mysql.h>
-#include <semaphore.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "../log/log.h"
+#include "sqlconn.h"
 
+// 弹性数据库连接池。
+// 启动时并行建立 minConn 个连接，不够用时按需在后台新建，最多 maxConn 个；
+// 后台线程定期检查空闲连接是否可用，关闭长时间空闲的多余连接，并重新连接出错的连接。
+// 获取连接有等待期限，超时返回 nullptr，调用方据此快速失败(返回 503)而不是一直等待。
 class SqlConnPool {
  public:
+  // 连接池的运行统计
+  struct Stats {
+    // 已建立的连接数，其中正在使用的与空闲的
+    int total;
+    int in_use;
+    int idle;
+    // 成功获取连接的次数与等待超时的次数
+    uint64_t acquires;
+    uint64_t timeouts;
+    // 获取连接的累计等待时间与最长等待时间(微秒)
+    uint64_t wait_us_total;
+    uint64_t wait_us_max;
+    // 重新连接的次数与建立连接失败的次数
+    uint64_t reconnects;
+    uint64_t connect_failures;
+  };
+
   static auto Instance() -> SqlConnPool *;  // 单例模式 确保只创建一个pool
 
-  auto GetConn() -> MYSQL *;       // 从pool里获取一个可用的conn
-  void FreeConn(MYSQL *conn);      // 将用完的conn返回pool
+  // 从pool里获取一个可用的conn，最多等待 timeoutMs(小于 0 时使用 Init 设置的期限)，超时返回nullptr
+  auto GetConn(int timeoutMs = -1) -> SqlConn *;
+  // 不等待，没有空闲conn时返回nullptr；未达上限时在后台新建一个
+  auto TryGetConn() -> SqlConn *;
+  // 将用完的conn返回pool，出错的conn交给后台线程重新连接
+  void FreeConn(SqlConn *conn);
+  // 有conn可用时调用一次notify(在归还或新建conn的线程中执行)；当前就有空闲conn时立即调用。
+  // owner 用于 CancelNotify，owner 销毁前须取消尚未执行的通知
+  void NotifyOnFree(const void *owner, std::function<void()> notify);
+  void CancelNotify(const void *owner);
+  // 记录一次不经过 GetConn 的获取(如 TryGetConn 配合 NotifyOnFree)的等待时间
+  void RecordWait(uint64_t waitUs, bool timeout);
+
   auto GetFreeConnCount() -> int;  // 空闲conn的数量
+  auto GetMaxConnCount() const -> int { return max_conn_; }
+  auto AcquireTimeout() const -> int { return acquire_timeout_ms_; }
+  // 没有可用的conn，且最近一次建立连接失败：数据库不可用，获取连接的请求应立即失败
+  auto IsDown() -> bool;
+  auto GetStats() -> Stats;
 
-  void Init(const char *host, int port, const char *user, const char *pwd,
-            const char *dbName,
-            int connSize);  // 初始化连接池，创建指定数量的数据库连接。
+  // 初始化连接池，并行建立 minConn 个数据库连接，之后按需扩展到 maxConn 个
+  void Init(const char *host, int port, const char *user, const char *pwd, const char *dbName, int minConn,
+            int maxConn, int acquireTimeoutMs);
   void ClosePool();  // 释放所有资源
 
  private:
-  SqlConnPool();
+  // 后台线程检查空闲连接的间隔
+  static constexpr int HEALTH_CHECK_MS = 30000;
+  // 超过 minConn 的连接空闲多久后关闭
+  static constexpr int IDLE_TIMEOUT_MS = 60000;
+  // 建立连接失败后重试的间隔
+  static constexpr int RETRY_MS = 1000;
+  // 输出统计信息的间隔
+  static constexpr int STATS_LOG_MS = 60000;
+
+  using Clock = std::chrono::steady_clock;
+
+  enum SlotState {
+    // 没有连接
+    SLOT_CLOSED,
+    // 等待后台线程建立(或重新建立)连接
+    SLOT_PENDING,
+    // 后台线程正在建立连接
+    SLOT_CONNECTING,
+    SLOT_IDLE,
+    SLOT_IN_USE,
+    // 后台线程正在检查连接是否可用
+    SLOT_CHECKING,
+  };
+
+  struct Slot {
+    std::unique_ptr<SqlConn> conn;
+    SlotState state = SLOT_CLOSED;
+    // 最近一次归还或检查的时间
+    Clock::time_point last_used;
+    // 是否是出错后重新连接
+    bool reconnect = false;
+  };
+
+  SqlConnPool() = default;
   ~SqlConnPool();
 
-  int max_conn_;    // 最大conn数
-  int use_count_;   // 已用conn数
-  int free_count_;  // 空闲conn数
+  // 取出一个空闲conn；没有时若未达上限则请求后台新建一个
+  auto TakeLocked() -> SqlConn *;
+  // conn 变为空闲，需要通知的回调移入 notify
+  void PutIdleLocked(Slot &slot, std::vector<std::function<void()>> &notify);
+  // 并行建立 ids 对应的连接，结果写入 ok
+  void ConnectAll(const std::vector<int> &ids, std::vector<char> &ok);
+  void Maintain();
+  void LogStats();
+
+  std::string host_, user_, pwd_, db_name_;
+  int port_ = 0;
+  int min_conn_ = 0;
+  int max_conn_ = 0;
+  int acquire_timeout_ms_ = 0;
 
-  std::queue<MYSQL *> conn_que_;
   std::mutex mtx_;
-  sem_t sem_id_;  // 信号量
+  std::condition_variable free_cv_;   // 有conn变为空闲
+  std::condition_variable maint_cv_;  // 有conn需要后台线程处理
+  std::vector<Slot> slots_;
+  // 空闲conn的下标，最近归还的在末尾，优先使用，较早的在空闲过久时关闭
+  std::vector<int> idle_;
+  int in_use_ = 0;
+  int live_ = 0;
+  bool down_ = false;
+  bool stop_ = true;
+  // 等待空闲conn的通知
+  std::vector<std::pair<const void *, std::function<void()>>> waiters_;
+  Stats stats_ = {};
+  std::thread maintainer_;
 };
 
-#endif  // SQLCONNPOOL_H
\ No newline at end of file
+#endif  // SQLCONNPOOL_H
@@ -0,0 +1,169 @@
+#include "threadpool.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+
+namespace {
+// 当前线程所属的线程池与队列序号，工作线程提交任务时直接放入自己的队列
+thread_local const ThreadPool *local_pool = nullptr;
+thread_local size_t local_index = 0;
+
+constexpr size_t INIT_QUEUE_CAPACITY = 256;
+
+void FutexWait(std::atomic<uint32_t> *addr, uint32_t expected) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t> *addr, int count) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+}  // namespace
+
+void ThreadPool::Worker::PushLocked(Task &&task, Clock::time_point time) {
+  if (tail - head == slots.size()) {
+    // 队列满，按原顺序搬到两倍大小的数组中
+    std::vector<Entry> bigger(slots.empty() ? INIT_QUEUE_CAPACITY : slots.size() * 2);
+    for (size_t i = head; i < tail; i++) {
+      bigger[i - head] = std::move(slots[i % slots.size()]);
+    }
+    tail -= head;
+    head = 0;
+    slots.swap(bigger);
+  }
+  Entry &entry = slots[tail % slots.size()];
+  entry.task = std::move(task);
+  entry.time = time;
+  tail++;
+}
+
+auto ThreadPool::Worker::PopLocked(Task &task) -> bool {
+  if (head == tail) {
+    return false;
+  }
+  // 自己与窃取者都从队首取，先到的请求先处理
+  Entry &entry = slots[head % slots.size()];
+  task = std::move(entry.task);
+  head++;
+  auto wait = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - entry.time).count());
+  executed++;
+  wait_us_total += wait;
+  wait_us_max = std::max(wait_us_max, wait);
+  return true;
+}
+
+ThreadPool::ThreadPool(size_t threadNumber) {
+  threadNumber = std::max<size_t>(threadNumber, 1);
+  for (size_t i = 0; i < threadNumber; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < threadNumber; ++i) {
+    threads_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  stop_.store(true);
+  epoch_.fetch_add(1);
+  FutexWake(&epoch_, INT_MAX);
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::Push(Task &&task) {
+  bool in_worker = local_pool == this;
+  // 析构期间正在执行的任务仍可提交后续任务，它们会在退出前被执行
+  if (!in_worker && stop_.load(std::memory_order_relaxed)) {
+    throw std::runtime_error("submit on stopped ThreadPool");
+  }
+  size_t index = in_worker ? local_index : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+  auto now = Clock::now();
+  {
+    std::lock_guard<std::mutex> locker(workers_[index]->mtx);
+    workers_[index]->PushLocked(std::move(task), now);
+  }
+  WakeOne();
+}
+
+auto ThreadPool::GetStats() const -> Stats {
+  Stats stats = {};
+  for (const auto &worker : workers_) {
+    std::lock_guard<std::mutex> locker(worker->mtx);
+    stats.queued += worker->tail - worker->head;
+    stats.executed += worker->executed;
+    stats.wait_us_total += worker->wait_us_total;
+    stats.wait_us_max = std::max(stats.wait_us_max, worker->wait_us_max);
+  }
+  return stats;
+}
+
+void ThreadPool::WakeOne() {
+  // 与 WorkerLoop 中 idle_ 的增加配对：要么这里看到有线程休眠，要么休眠前的检查看到新任务
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (idle_.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  // 同一时刻只有一次唤醒在途，连续提交时不必每个任务都进行一次系统调用
+  if (waking_.exchange(true, std::memory_order_seq_cst)) {
+    return;
+  }
+  epoch_.fetch_add(1, std::memory_order_release);
+  FutexWake(&epoch_, 1);
+}
+
+auto ThreadPool::Take(size_t index, Task &task) -> bool {
+  size_t count = workers_.size();
+  for (size_t i = 0; i < count; i++) {
+    Worker &worker = *workers_[(index + i) % count];
+    std::lock_guard<std::mutex> locker(worker.mtx);
+    if (worker.PopLocked(task)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+  local_pool = this;
+  local_index = index;
+  Task task;
+  bool woken = false;
+  while (true) {
+    if (Take(index, task)) {
+      if (woken) {
+        // 被唤醒后拿到了任务，可能还有积压，接力唤醒下一个线程
+        woken = false;
+        WakeOne();
+      }
+      task();
+      task = Task();
+      continue;
+    }
+    woken = false;
+    // 先记下序号再做最后一次检查，检查之后提交的任务会改变序号，FutexWait 立即返回
+    uint32_t epoch = epoch_.load(std::memory_order_acquire);
+    idle_.fetch_add(1, std::memory_order_seq_cst);
+    // 清除在途标记后，之后的提交都会重新唤醒
+    waking_.store(false, std::memory_order_seq_cst);
+    if (Take(index, task)) {
+      idle_.fetch_sub(1, std::memory_order_relaxed);
+      task();
+      task = Task();
+      continue;
+    }
+    if (stop_.load(std::memory_order_acquire)) {
+      // 所有队列都已取空
+      idle_.fetch_sub(1, std::memory_order_relaxed);
+      break;
+    }
+    FutexWait(&epoch_, epoch);
+    idle_.fetch_sub(1, std::memory_order_relaxed);
+    waking_.store(false, std::memory_order_seq_cst);
+    woken = true;
+  }
+}
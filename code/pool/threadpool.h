@@ -1,35 +1,125 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+// 工作窃取线程池。
+// 每个工作线程有自己的任务队列：工作线程内提交的任务进入自己的队列，
+// 其它线程提交的任务轮流分发到各个队列；自己的队列空了就去其它队列窃取，
+// 所有队列都空时通过 futex 休眠。提交任务只锁目标队列，不存在所有线程争用的全局锁。
+// Post 提交不关心结果的任务，小的可调用对象直接存放在任务内部，不分配堆内存；
+// Submit 额外返回 future，供需要结果的调用方使用。
+// 任务只应做不阻塞的工作(解析请求、读写套接字)；可能阻塞的工作(数据库查询)由 AsyncSql 执行，
+// 不占用这里的线程。GetStats 给出积压的任务数与任务的排队时间。
 class ThreadPool {
  public:
-  explicit ThreadPool(size_t threadNumber) {
-    for (size_t i = 0; i < threadNumber; ++i) {
-      m_thread_.emplace_back([this]() {
-        for (;;) {
-          std::function<void()> task;
-          {
-            std::unique_lock<std::mutex> lock(m_mutex_);
-            m_cv_.wait(lock, [this]() { return m_stop_ || !tasks_.empty(); });
-            if (m_stop_ && tasks_.empty()) {
-              return;
-            }
-            task = std::move(tasks_.front());
-            tasks_.pop();
+  // 运行统计
+  struct Stats {
+    // 排队中的任务数
+    size_t queued;
+    // 已开始执行的任务数，以及这些任务的累计排队时间与最长排队时间(微秒)
+    uint64_t executed;
+    uint64_t wait_us_total;
+    uint64_t wait_us_max;
+  };
+
+  // 类型擦除的可调用对象，只可移动。不超过 INLINE_SIZE 的可调用对象原地存放，更大的放在堆上
+  class Task {
+   public:
+    static constexpr size_t INLINE_SIZE = 48;
+
+    Task() = default;
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    explicit Task(F &&f) {
+      using Fn = std::decay_t<F>;
+      if constexpr (IsInline<Fn>()) {
+        new (storage_) Fn(std::forward<F>(f));
+        invoke_ = [](void *p) { (*static_cast<Fn *>(p))(); };
+        manage_ = [](void *dst, void *src) {
+          if (dst != nullptr) {
+            new (dst) Fn(std::move(*static_cast<Fn *>(src)));
           }
-          task();
-        }
-      });
+          static_cast<Fn *>(src)->~Fn();
+        };
+      } else {
+        *reinterpret_cast<Fn **>(storage_) = new Fn(std::forward<F>(f));
+        invoke_ = [](void *p) { (**static_cast<Fn **>(p))(); };
+        manage_ = [](void *dst, void *src) {
+          if (dst != nullptr) {
+            *static_cast<Fn **>(dst) = *static_cast<Fn **>(src);
+          } else {
+            delete *static_cast<Fn **>(src);
+          }
+        };
+      }
     }
-  }
+
+    Task(Task &&other) noexcept { MoveFrom(other); }
+
+    auto operator=(Task &&other) noexcept -> Task & {
+      if (this != &other) {
+        Reset();
+        MoveFrom(other);
+      }
+      return *this;
+    }
+
+    Task(const Task &) = delete;
+    auto operator=(const Task &) -> Task & = delete;
+
+    ~Task() { Reset(); }
+
+    explicit operator bool() const { return invoke_ != nullptr; }
+
+    void operator()() { invoke_(storage_); }
+
+    // 编译期判断可调用对象是否原地存放，即 Post 是否不分配内存
+    template <typename Fn>
+    static constexpr auto IsInline() -> bool {
+      return sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t) &&
+             std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+   private:
+    void Reset() {
+      if (manage_ != nullptr) {
+        manage_(nullptr, storage_);
+        invoke_ = nullptr;
+        manage_ = nullptr;
+      }
+    }
+
+    void MoveFrom(Task &other) {
+      if (other.manage_ != nullptr) {
+        other.manage_(storage_, other.storage_);
+        invoke_ = other.invoke_;
+        manage_ = other.manage_;
+        other.invoke_ = nullptr;
+        other.manage_ = nullptr;
+      }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[INLINE_SIZE];
+    void (*invoke_)(void *) = nullptr;
+    // dst 非空时把 src 移动到 dst 并销毁 src，dst 为空时只销毁 src
+    void (*manage_)(void *dst, void *src) = nullptr;
+  };
+
+  explicit ThreadPool(size_t threadNumber);
 
   ThreadPool(const ThreadPool &) = delete;
   ThreadPool(ThreadPool &&) = delete;
@@ -37,38 +127,66 @@ class ThreadPool {
   auto operator=(const ThreadPool &) -> ThreadPool & = delete;
   auto operator=(ThreadPool &&) -> ThreadPool & = delete;
 
-  ~ThreadPool() {
-    {
-      std::unique_lock<std::mutex> lock(m_mutex_);
-      m_stop_ = true;
-    }
-    m_cv_.notify_all();
-    for (auto &threads : m_thread_) {
-      threads.join();
-    }
+  // 等待已提交的任务全部执行完再退出
+  ~ThreadPool();
+
+  // 提交不需要结果的任务
+  template <typename F>
+  void Post(F &&f) {
+    Push(Task(std::forward<F>(f)));
   }
 
   template <typename F, typename... Args>
   auto Submit(F &&f, Args &&...args) -> std::future<decltype(f(args...))> {
-    auto task_ptr = std::make_shared<std::packaged_task<decltype(f(args...))()>>(
-        std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-    {
-      std::unique_lock<std::mutex> lock(m_mutex_);
-      if (m_stop_) {
-        throw std::runtime_error("submit on stopped ThreadPool");
-      }
-      tasks_.emplace([task_ptr]() { (*task_ptr)(); });
-    }
-    m_cv_.notify_one();
-    return task_ptr->get_future();
+    std::packaged_task<decltype(f(args...))()> task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+    auto future = task.get_future();
+    Push(Task([task = std::move(task)]() mutable { task(); }));
+    return future;
   }
 
+  auto ThreadCount() const -> size_t { return workers_.size(); }
+  auto GetStats() const -> Stats;
+
  private:
-  bool m_stop_{};
-  std::vector<std::thread> m_thread_;
-  std::queue<std::function<void()>> tasks_;
-  std::mutex m_mutex_;
-  std::condition_variable m_cv_;
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    Task task;
+    // 提交的时间
+    Clock::time_point time;
+  };
+
+  // 单个工作线程的任务队列。环形数组在满时扩容，稳定运行后不再分配内存。
+  // 统计在取任务时记录，已持有队列的锁，不另加同步
+  struct alignas(64) Worker {
+    mutable std::mutex mtx;
+    std::vector<Entry> slots;
+    size_t head = 0;
+    size_t tail = 0;
+    uint64_t executed = 0;
+    uint64_t wait_us_total = 0;
+    uint64_t wait_us_max = 0;
+
+    void PushLocked(Task &&task, Clock::time_point time);
+    auto PopLocked(Task &task) -> bool;
+  };
+
+  void Push(Task &&task);
+  void WorkerLoop(size_t index);
+  // 先取自己队列的任务，再依次尝试窃取其它队列
+  auto Take(size_t index, Task &task) -> bool;
+  void WakeOne();
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  // 外部线程提交任务时轮流选择队列
+  std::atomic<size_t> next_{0};
+  // 休眠中的线程数与唤醒序号，序号是 futex 等待的字
+  std::atomic<uint32_t> idle_{0};
+  std::atomic<uint32_t> epoch_{0};
+  // 已发出唤醒、被唤醒的线程尚未开始取任务
+  std::atomic<bool> waking_{false};
+  std::atomic<bool> stop_{false};
 };
 
 #endif  // THREADPOOL_H
@@ -0,0 +1,162 @@
+#include "usercache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+auto UserCache::Instance() -> UserCache * {
+  static UserCache cache;
+  return &cache;
+}
+
+void UserCache::Init(int ttlSec, size_t maxEntries, size_t expectedUsers, SqlConnPool *pool) {
+  ttl_ = std::chrono::seconds(ttlSec);
+  max_per_shard_ = std::max<size_t>(maxEntries / SHARD_NUM, 1);
+  // 按 64 位取整
+  bloom_bits_ = (std::max<size_t>(expectedUsers, 1024) * BLOOM_BITS_PER_USER + 63) / 64 * 64;
+  bloom_ = std::make_unique<std::atomic<uint64_t>[]>(bloom_bits_ / 64);
+  for (size_t i = 0; i < bloom_bits_ / 64; i++) {
+    bloom_[i].store(0, std::memory_order_relaxed);
+  }
+  bloom_ready_.store(LoadUsers(pool));
+}
+
+auto UserCache::LoadUsers(SqlConnPool *pool) -> bool {
+  SqlConn *conn = pool->GetConn();
+  if (conn == nullptr) {
+    LOG_WARN("UserCache: no sql conn, bloom filter disabled");
+    return false;
+  }
+  MYSQL *sql = conn->Get();
+  const char *query = "SELECT username FROM user";
+  size_t count = 0;
+  bool ok = mysql_real_query(sql, query, strlen(query)) == 0;
+  if (ok) {
+    // 逐行读取，不把整张表读入内存
+    MYSQL_RES *res = mysql_use_result(sql);
+    ok = res != nullptr;
+    if (ok) {
+      while (MYSQL_ROW row = mysql_fetch_row(res)) {
+        if (row[0] != nullptr) {
+          BloomAdd(Hash(row[0]));
+          count++;
+        }
+      }
+      ok = mysql_errno(sql) == 0;
+      mysql_free_result(res);
+    }
+  }
+  if (!ok) {
+    LOG_WARN("UserCache: load users error: %s, bloom filter disabled", mysql_error(sql));
+  } else {
+    LOG_INFO("UserCache: %zu users loaded, bloom filter %zu bits", count, bloom_bits_);
+  }
+  pool->FreeConn(conn);
+  return ok;
+}
+
+auto UserCache::Hash(std::string_view user) -> uint64_t {
+  // FNV-1a 再经 splitmix64 混合：最高 4 位选择分片，高低 32 位用于过滤器的双重哈希
+  uint64_t h = 14695981039346656037ULL;
+  for (unsigned char c : user) {
+    h = (h ^ c) * 1099511628211ULL;
+  }
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+void UserCache::BloomAdd(uint64_t hash) {
+  uint64_t h1 = hash & 0xffffffff;
+  uint64_t h2 = (hash >> 32) | 1;
+  for (int i = 0; i < BLOOM_HASHES; i++) {
+    uint64_t bit = (h1 + i * h2) % bloom_bits_;
+    bloom_[bit / 64].fetch_or(1ULL << (bit % 64), std::memory_order_relaxed);
+  }
+}
+
+auto UserCache::BloomMayContain(uint64_t hash) const -> bool {
+  uint64_t h1 = hash & 0xffffffff;
+  uint64_t h2 = (hash >> 32) | 1;
+  for (int i = 0; i < BLOOM_HASHES; i++) {
+    uint64_t bit = (h1 + i * h2) % bloom_bits_;
+    if ((bloom_[bit / 64].load(std::memory_order_relaxed) & (1ULL << (bit % 64))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto UserCache::Lookup(const std::string &user, const std::string &password, bool isLogin) -> Answer {
+  if (!bloom_) {
+    return ANSWER_UNKNOWN;
+  }
+  uint64_t hash = Hash(user);
+  Shard &shard = GetShard(hash);
+  {
+    std::shared_lock<std::shared_mutex> lock(shard.mtx);
+    auto it = shard.records.find(user);
+    if (it != shard.records.end() && it->second.expires > Clock::now()) {
+      const Record &record = it->second;
+      if (isLogin) {
+        return record.exists && record.password == password ? ANSWER_OK : ANSWER_FAILED;
+      }
+      // 用户名已被使用时注册失败；不存在时仍要写入数据库
+      return record.exists ? ANSWER_FAILED : ANSWER_UNKNOWN;
+    }
+  }
+  if (isLogin && bloom_ready_.load(std::memory_order_acquire) && !BloomMayContain(hash)) {
+    return ANSWER_FAILED;
+  }
+  return ANSWER_UNKNOWN;
+}
+
+void UserCache::Put(const std::string &user, const std::string &password, bool exists) {
+  if (!bloom_) {
+    return;
+  }
+  uint64_t hash = Hash(user);
+  Shard &shard = GetShard(hash);
+  std::unique_lock<std::shared_mutex> lock(shard.mtx);
+  auto now = Clock::now();
+  if (shard.records.size() >= max_per_shard_ && shard.records.count(user) == 0) {
+    // 已满时随意淘汰一条，不扫描整个分片；过期的记录在查询时视为不存在
+    shard.records.erase(shard.records.begin());
+  }
+  Record &record = shard.records[user];
+  record.password = exists ? password : std::string();
+  record.exists = exists;
+  record.expires = now + ttl_;
+}
+
+void UserCache::AddUser(const std::string &user, const std::string &password) {
+  if (!bloom_) {
+    return;
+  }
+  BloomAdd(Hash(user));
+  Put(user, password, true);
+}
+
+void UserCache::Invalidate(const std::string &user) {
+  if (!bloom_) {
+    return;
+  }
+  uint64_t hash = Hash(user);
+  // 用户可能是外部新增的，加入过滤器后下次查询一定会访问数据库
+  BloomAdd(hash);
+  Shard &shard = GetShard(hash);
+  std::unique_lock<std::shared_mutex> lock(shard.mtx);
+  shard.records.erase(user);
+}
+
+void UserCache::Clear() {
+  // 外部可能批量新增了用户，过滤器不再可靠
+  bloom_ready_.store(false);
+  for (Shard &shard : shards_) {
+    std::unique_lock<std::shared_mutex> lock(shard.mtx);
+    shard.records.clear();
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef USERCACHE_H
+#define USERCACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../log/log.h"
+#include "sqlconnpool.h"
+
+// 进程内的用户凭据缓存，位于登录、注册的数据库查询之前。
+// 用户名 -> 凭据记录按用户名哈希分片，每片一把读写锁，读多写少时各线程互不阻塞；记录有过期时间(TTL)。
+// 另有一个包含所有已知用户名的布隆过滤器：启动时从数据库加载全部用户名，注册成功时加入。
+// 过滤器判定用户名不存在时一定不存在，这类登录不必查询数据库。
+// 数据库被服务器以外的途径修改时，须调用 Invalidate/Clear 使缓存失效。
+class UserCache {
+ public:
+  // 查询缓存的结果
+  enum Answer {
+    // 缓存无法确定，需要查询数据库
+    ANSWER_UNKNOWN = 0,
+    ANSWER_OK,
+    ANSWER_FAILED,
+  };
+
+  static auto Instance() -> UserCache *;
+
+  // ttlSec 为记录的有效期，maxEntries 为记录数上限，expectedUsers 决定布隆过滤器的大小。
+  // 之后从 pool 加载全部用户名，加载失败时过滤器不参与判断
+  void Init(int ttlSec, size_t maxEntries, size_t expectedUsers, SqlConnPool *pool);
+
+  // 登录：用户名与密码是否匹配；注册：用户名是否已被使用(用户名可用时仍需写入数据库)
+  auto Lookup(const std::string &user, const std::string &password, bool isLogin) -> Answer;
+
+  // 数据库查询到的用户凭据，exists 为 false 表示用户不存在
+  void Put(const std::string &user, const std::string &password, bool exists);
+  // 注册成功：写入缓存并加入过滤器
+  void AddUser(const std::string &user, const std::string &password);
+
+  // 失效钩子：数据库中的用户被外部修改(改密码、删除、直接插入)后调用
+  void Invalidate(const std::string &user);
+  void Clear();
+
+ private:
+  // 分片数，取哈希值的最高 4 位
+  static constexpr int SHARD_NUM = 16;
+  // 每个用户名在过滤器中置位的数量
+  static constexpr int BLOOM_HASHES = 7;
+  // 过滤器每个用户名平均占用的位数，约 1% 的误判率
+  static constexpr size_t BLOOM_BITS_PER_USER = 10;
+
+  using Clock = std::chrono::steady_clock;
+
+  struct Record {
+    std::string password;
+    bool exists;
+    Clock::time_point expires;
+  };
+
+  struct alignas(64) Shard {
+    std::shared_mutex mtx;
+    std::unordered_map<std::string, Record> records;
+  };
+
+  UserCache() = default;
+
+  auto GetShard(uint64_t hash) -> Shard & { return shards_[hash >> 60]; }
+  static auto Hash(std::string_view user) -> uint64_t;
+  void BloomAdd(uint64_t hash);
+  auto BloomMayContain(uint64_t hash) const -> bool;
+  // 从数据库加载全部用户名到过滤器
+  auto LoadUsers(SqlConnPool *pool) -> bool;
+
+  Shard shards_[SHARD_NUM];
+  std::chrono::seconds ttl_{0};
+  size_t max_per_shard_ = 0;
+
+  std::unique_ptr<std::atomic<uint64_t>[]> bloom_;
+  size_t bloom_bits_ = 0;
+  // 过滤器是否包含了数据库中的全部用户名，否则不能据此判定不存在
+  std::atomic<bool> bloom_ready_{false};
+};
+
+#endif  // USERCACHE_H
@@ -0,0 +1,57 @@
+#include "admission.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+// 连接刚建立时发送缓冲区为空，这个响应总能一次发送完
+constexpr char BUSY_RESPONSE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n\r\n";
+}  // namespace
+
+AdmissionControl::AdmissionControl(int minLimit, int maxLimit, int targetDelayUs)
+    : min_limit_(minLimit),
+      max_limit_(maxLimit),
+      target_delay_us_(targetDelayUs),
+      limit_(maxLimit) {}
+
+void AdmissionControl::OnDelay(uint64_t delayUs) {
+  uint64_t cur = max_delay_us_.load(std::memory_order_relaxed);
+  while (delayUs > cur && !max_delay_us_.compare_exchange_weak(cur, delayUs, std::memory_order_relaxed)) {
+  }
+}
+
+void AdmissionControl::Update(int inflight) {
+  uint64_t delay = max_delay_us_.exchange(0, std::memory_order_relaxed);
+  uint64_t rejected = rejected_.exchange(0, std::memory_order_relaxed);
+  int limit = limit_.load(std::memory_order_relaxed);
+  int next = limit;
+  if (delay > target_delay_us_) {
+    // 以实际处理中的请求数为基准减小，上限远大于请求数时也能在一个周期内生效
+    next = std::max(min_limit_, static_cast<int>(std::min(limit, inflight) * DECREASE_RATIO));
+  } else if (inflight >= limit * BUSY_RATIO) {
+    next = std::min(max_limit_, limit + INCREASE_STEP);
+  }
+  limit_.store(next, std::memory_order_relaxed);
+  if (rejected > 0) {
+    LOG_WARN("Admission limit:%d inflight:%d delay:%lluus rejected:%llu", next, inflight,
+             static_cast<unsigned long long>(delay), static_cast<unsigned long long>(rejected));
+  } else if (next != limit) {
+    LOG_DEBUG("Admission limit:%d inflight:%d delay:%lluus", next, inflight, static_cast<unsigned long long>(delay));
+  }
+}
+
+void AdmissionControl::Reject(int fd) {
+  rejected_.fetch_add(1, std::memory_order_relaxed);
+  ssize_t ret = send(fd, BUSY_RESPONSE, sizeof(BUSY_RESPONSE) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+  (void)ret;
+  // 监听套接字可能设置了 SO_LINGER，关闭前取消，close 不等待数据发送完
+  struct linger opt_linger = {0};
+  setsockopt(fd, SOL_SOCKET, SO_LINGER, &opt_linger, sizeof(opt_linger));
+  close(fd);
+}
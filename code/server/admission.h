@@ -0,0 +1,51 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "../log/log.h"
+
+// 接入控制：在 accept 时按处理中的请求数决定是否接受新连接，过载时让已接入的连接保持稳定的时延。
+// 空闲的持久连接只占用一个 fd，不计入；处理中的请求(包括等待数据库的请求)才占用线程池与数据库。
+// 各 Reactor 报告排队时延(线程池中任务的排队时间、事件循环处理一轮事件的耗时)，
+// 每个周期按周期内的最大时延以 AIMD 调整上限：时延超过目标时按当前处理中的请求数乘性减小，
+// 未超过且上限已接近用满时加性增大。处理中的请求数达到上限时，新连接由 Reject 发送预先生成的 503 后立即关闭。
+class AdmissionControl {
+ public:
+  // 处理中请求数的上限在 [minLimit, maxLimit] 之间调整，初始为 maxLimit；targetDelayUs 为可接受的排队时延
+  AdmissionControl(int minLimit, int maxLimit, int targetDelayUs);
+
+  // 处理中的请求数为 inflight 时是否接受新连接，可在任意线程调用
+  auto Admit(int inflight) const -> bool { return inflight < limit_.load(std::memory_order_relaxed); }
+  // 报告一个排队时延样本(微秒)，可在任意线程调用
+  void OnDelay(uint64_t delayUs);
+  // 每隔 UPDATE_MS 调用一次，同一时刻只能有一个线程调用：按周期内的最大时延调整上限
+  void Update(int inflight);
+  // 拒绝新连接：非阻塞地发送 503 与 Retry-After 后关闭，不占用连接表。可在任意线程调用
+  void Reject(int fd);
+
+  auto Limit() const -> int { return limit_.load(std::memory_order_relaxed); }
+
+  // 调整上限的周期
+  static constexpr int UPDATE_MS = 100;
+
+ private:
+  // 时延超标时上限减为当前处理中请求数的比例
+  static constexpr double DECREASE_RATIO = 0.9;
+  // 每个周期增大的请求数
+  static constexpr int INCREASE_STEP = 32;
+  // 处理中的请求数达到上限的这个比例时才增大上限
+  static constexpr double BUSY_RATIO = 0.9;
+
+  int min_limit_;
+  int max_limit_;
+  uint64_t target_delay_us_;
+  std::atomic<int> limit_;
+  // 本周期内的最大时延
+  std::atomic<uint64_t> max_delay_us_{0};
+  // 本周期内拒绝的连接数
+  std::atomic<uint64_t> rejected_{0};
+};
+
+#endif  // ADMISSION_H
@@ -0,0 +1,78 @@
+#ifndef CONNSLAB_H
+#define CONNSLAB_H
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+
+#include "../http/httpconn.h"
+
+// 以 fd 为下标的连接表，替代 unordered_map<int, HttpConn>：
+// 查找只是一次数组访问，没有哈希，也不会因为扩容导致指针失效。
+// 每个槽位带一个代数(generation)，连接关闭时加一；代数与 fd 一起打包成 64 位句柄，
+// 放进 epoll_event.data.u64、定时器回调和线程池任务里，fd 被复用后旧句柄自然失效。
+class ConnSlab {
+ public:
+  // 句柄布局：[63..56] 留给 I/O 后端的标记 | [55..32] 代数 | [31..0] fd
+  static constexpr uint32_t GEN_MASK = 0xffffff;
+
+  explicit ConnSlab(int maxFd) : slots_(new Slot[maxFd]), max_fd_(maxFd) {}
+
+  ConnSlab(const ConnSlab &) = delete;
+  auto operator=(const ConnSlab &) -> ConnSlab & = delete;
+
+  static auto MakeHandle(int fd, uint32_t gen) -> uint64_t {
+    return (static_cast<uint64_t>(gen & GEN_MASK) << 32) | static_cast<uint32_t>(fd);
+  }
+  static auto HandleFd(uint64_t handle) -> int { return static_cast<int>(handle & 0xffffffffU); }
+  static auto HandleGen(uint64_t handle) -> uint32_t { return static_cast<uint32_t>(handle >> 32) & GEN_MASK; }
+
+  auto MaxFd() const -> int { return max_fd_; }
+
+  // 为新连接取出 fd 对应的槽位并返回其当前句柄。
+  // HttpConn 在槽位第一次使用时创建，之后一直复用，地址在服务器生命周期内不变
+  auto Acquire(int fd) -> uint64_t {
+    assert(fd >= 0 && fd < max_fd_);
+    Slot &slot = slots_[fd];
+    if (!slot.conn) {
+      slot.conn = std::make_unique<HttpConn>();
+    }
+    return MakeHandle(fd, slot.gen.load(std::memory_order_acquire));
+  }
+
+  // 根据句柄查找连接，代数不匹配（连接已关闭或 fd 已被复用）时返回 nullptr
+  auto Get(uint64_t handle) const -> HttpConn * {
+    int fd = HandleFd(handle);
+    if (fd < 0 || fd >= max_fd_) {
+      return nullptr;
+    }
+    const Slot &slot = slots_[fd];
+    if ((slot.gen.load(std::memory_order_acquire) & GEN_MASK) != HandleGen(handle)) {
+      return nullptr;
+    }
+    return slot.conn.get();
+  }
+
+  // 连接关闭：代数加一，使所有旧句柄失效。句柄已失效时返回 false，保证只关闭一次
+  auto Retire(uint64_t handle) -> bool {
+    Slot &slot = slots_[HandleFd(handle)];
+    uint32_t gen = slot.gen.load(std::memory_order_acquire);
+    if ((gen & GEN_MASK) != HandleGen(handle)) {
+      return false;
+    }
+    return slot.gen.compare_exchange_strong(gen, gen + 1, std::memory_order_acq_rel);
+  }
+
+ private:
+  // 每个槽位独占一条缓存行，不同线程访问相邻 fd 时不会伪共享
+  struct alignas(64) Slot {
+    std::atomic<uint32_t> gen{0};
+    std::unique_ptr<HttpConn> conn;
+  };
+
+  std::unique_ptr<Slot[]> slots_;
+  int max_fd_;
+};
+
+#endif  // CONNSLAB_H
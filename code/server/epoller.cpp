@@ -16,11 +16,15 @@ Epoller::~Epoller() { close(epoll_fd_); }  // 关闭epoll_fd_指向的epoll实
 // 使用epoll_ctl函数，操作类型为EPOLL_CTL_ADD，向epoll实例注册文件描述符及其关联的事件。
 // 如果操作成功返回true，失败返回false。
 auto Epoller::AddFd(int fd, uint32_t events) -> bool {
+  return AddFd(fd, events, static_cast<uint32_t>(fd));
+}
+
+auto Epoller::AddFd(int fd, uint32_t events, uint64_t data) -> bool {
   if (fd < 0) {
     return false;
   }
   epoll_event ev = {0};
-  ev.data.fd = fd;
+  ev.data.u64 = data;
   ev.events = events;
   return 0 == epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
 }
@@ -29,11 +33,15 @@ auto Epoller::AddFd(int fd, uint32_t events) -> bool {
 // 操作过程与AddFd相似，但操作类型为EPOLL_CTL_MOD。
 // 成功或失败返回值与AddFd相同。
 auto Epoller::ModFd(int fd, uint32_t events) -> bool {
+  return ModFd(fd, events, static_cast<uint32_t>(fd));
+}
+
+auto Epoller::ModFd(int fd, uint32_t events, uint64_t data) -> bool {
   if (fd < 0) {
     return false;
   }
   epoll_event ev = {0};
-  ev.data.fd = fd;
+  ev.data.u64 = data;
   ev.events = events;
   return 0 == epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
 }
@@ -63,15 +71,21 @@ auto Epoller::Wait(int timeoutMs) -> int {
 // 它会将所有就绪的事件，填充到events数组中。
 // 每个就绪的事件都会被填充为events数组的一个元素，epoll_wait同时返回就绪事件的总数。
 
-// 这两个函数用于访问Wait方法返回后，在events_中存储的事件。
-// GetEventFd返回第i个事件的文件描述符。
+// 这几个函数用于访问Wait方法返回后，在events_中存储的事件。
+// GetEventFd返回第i个事件的文件描述符（data 的低 32 位）。
 // GetEvents返回第i个事件的类型（如EPOLLIN、EPOLLOUT等）。
+// GetEventData返回注册时传入的完整 data。
 auto Epoller::GetEventFd(size_t i) const -> int {
   assert(i < events_.size() && i >= 0);
-  return events_[i].data.fd;
+  return static_cast<int>(events_[i].data.u64 & 0xffffffffU);
 }
 
 auto Epoller::GetEvents(size_t i) const -> uint32_t {
   assert(i < events_.size() && i >= 0);
   return events_[i].events;
-}
\ No newline at end of file
+}
+
+auto Epoller::GetEventData(size_t i) const -> uint64_t {
+  assert(i < events_.size() && i >= 0);
+  return events_[i].data.u64;
+}
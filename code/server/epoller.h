@@ -15,8 +15,11 @@ class Epoller {
   ~Epoller();
 // 向epoll实例中添加一个文件描述符fd，并指定关注的事件events。
   auto AddFd(int fd, uint32_t events) -> bool;
+// 同上，data 作为 epoll_event.data.u64 原样返回（如打包了代数的连接句柄）
+  auto AddFd(int fd, uint32_t events, uint64_t data) -> bool;
 // 修改epoll实例中已注册文件描述符的关注事件。
   auto ModFd(int fd, uint32_t events) -> bool;
+  auto ModFd(int fd, uint32_t events, uint64_t data) -> bool;
 
 // 从epoll实例中删除一个文件描述符。
   auto DelFd(int fd) -> bool;
@@ -26,6 +29,7 @@ class Epoller {
 // 这两个函数用于访问Wait方法返回后，在events_(就绪队列)中存储的事件。
   auto GetEventFd(size_t i) const -> int;
   auto GetEvents(size_t i) const -> uint32_t;
+  auto GetEventData(size_t i) const -> uint64_t;
 
  private:
   int epoll_fd_;
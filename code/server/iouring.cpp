@@ -0,0 +1,342 @@
+#include "iouring.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+// 所依赖的 multishot recv 在 6.0 内核中加入
+auto KernelSupportsMultishot() -> bool {
+  struct utsname name;
+  if (uname(&name) != 0) {
+    return false;
+  }
+  int major = 0;
+  int minor = 0;
+  if (sscanf(name.release, "%d.%d", &major, &minor) != 2) {
+    return false;
+  }
+  return major >= 6;
+}
+
+// 用户态与内核共享的队列指针需要 acquire/release 语义
+inline auto LoadAcquire(const unsigned *p) -> unsigned { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+
+inline void StoreRelease(unsigned *p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+}  // namespace
+
+IoUring::IoUring(unsigned entries, unsigned maxEvent)
+    : ring_fd_(-1),
+      features_(0),
+      sq_ring_(MAP_FAILED),
+      sq_ring_size_(0),
+      sq_head_(nullptr),
+      sq_tail_(nullptr),
+      sq_mask_(0),
+      sq_entries_(0),
+      sqes_(static_cast<io_uring_sqe *>(MAP_FAILED)),
+      sqes_size_(0),
+      sqe_tail_(0),
+      sqe_submitted_(0),
+      cq_ring_(MAP_FAILED),
+      cq_ring_size_(0),
+      cq_head_(nullptr),
+      cq_tail_(nullptr),
+      cq_mask_(0),
+      cqes_(nullptr),
+      buf_ring_(nullptr),
+      buf_ring_size_(0),
+      bufs_(nullptr),
+      buf_count_(0),
+      buf_size_(0),
+      buf_tail_(0),
+      events_(maxEvent) {
+  if (!KernelSupportsMultishot()) {
+    return;
+  }
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  // multishot 请求会源源不断产生完成事件，CQ 开得比 SQ 大一些
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = entries * 4;
+  int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (fd < 0) {
+    return;
+  }
+  ring_fd_ = fd;
+  features_ = params.features;
+  // 用 EXT_ARG 在 io_uring_enter 中携带超时，定时器依赖它
+  if ((features_ & IORING_FEAT_EXT_ARG) == 0U) {
+    Release();
+    return;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (features_ & IORING_FEAT_SINGLE_MMAP) != 0U;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ =
+      mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    Release();
+    return;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ =
+        mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      Release();
+      return;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = static_cast<io_uring_sqe *>(
+      mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED) {
+    Release();
+    return;
+  }
+
+  char *sq = static_cast<char *>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_entries_ = params.sq_entries;
+  // SQ 索引数组采用恒等映射，之后只需移动尾指针
+  auto *array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  for (unsigned i = 0; i < sq_entries_; i++) {
+    array[i] = i;
+  }
+  sqe_tail_ = sqe_submitted_ = *sq_tail_;
+
+  char *cq = static_cast<char *>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+IoUring::~IoUring() { Release(); }
+
+void IoUring::Release() {
+  if (bufs_ != nullptr) {
+    munmap(bufs_, static_cast<size_t>(buf_count_) * buf_size_);
+    bufs_ = nullptr;
+  }
+  if (buf_ring_ != nullptr) {
+    munmap(buf_ring_, buf_ring_size_);
+    buf_ring_ = nullptr;
+  }
+  if (sqes_ != MAP_FAILED) {
+    munmap(sqes_, sqes_size_);
+    sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+  }
+  if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  cq_ring_ = MAP_FAILED;
+  if (sq_ring_ != MAP_FAILED) {
+    munmap(sq_ring_, sq_ring_size_);
+    sq_ring_ = MAP_FAILED;
+  }
+  if (ring_fd_ >= 0) {
+    close(ring_fd_);
+    ring_fd_ = -1;
+  }
+}
+
+auto IoUring::SetupBufRing(unsigned count, unsigned size) -> bool {
+  assert(IsValid());
+  assert(count > 0 && (count & (count - 1)) == 0);
+  buf_ring_size_ = count * sizeof(io_uring_buf);
+  void *ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (ring == MAP_FAILED) {
+    return false;
+  }
+  void *bufs = mmap(nullptr, static_cast<size_t>(count) * size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+                    -1, 0);
+  if (bufs == MAP_FAILED) {
+    munmap(ring, buf_ring_size_);
+    return false;
+  }
+  // 头文件中的 io_uring_buf_ring 借助柔性数组宏声明，在 C++ 中布局与内核不一致，
+  // 这里直接按 io_uring_buf 数组访问，尾指针复用第 0 项的 resv 字段
+  buf_ring_ = static_cast<io_uring_buf *>(ring);
+  bufs_ = static_cast<char *>(bufs);
+  buf_count_ = count;
+  buf_size_ = size;
+
+  // 把全部缓冲区交给内核
+  for (unsigned bid = 0; bid < count; bid++) {
+    io_uring_buf *buf = &buf_ring_[bid];
+    buf->addr = reinterpret_cast<uint64_t>(bufs_ + static_cast<size_t>(bid) * size);
+    buf->len = size;
+    buf->bid = static_cast<uint16_t>(bid);
+  }
+  buf_tail_ = count;
+  __atomic_store_n(&buf_ring_[0].resv, static_cast<uint16_t>(buf_tail_), __ATOMIC_RELEASE);
+  io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+  reg.ring_entries = count;
+  reg.bgid = 0;
+  if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    return false;
+  }
+  return true;
+}
+
+auto IoUring::GetSqe() -> io_uring_sqe * {
+  if (sqe_tail_ - LoadAcquire(sq_head_) >= sq_entries_) {
+    // SQ 已满，先把已有请求提交给内核腾出空间
+    unsigned to_submit = FlushSq();
+    Enter(to_submit, 0, 0, nullptr, 0);
+    if (sqe_tail_ - LoadAcquire(sq_head_) >= sq_entries_) {
+      return nullptr;
+    }
+  }
+  io_uring_sqe *sqe = &sqes_[sqe_tail_ & sq_mask_];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe_tail_++;
+  return sqe;
+}
+
+auto IoUring::FlushSq() -> unsigned {
+  StoreRelease(sq_tail_, sqe_tail_);
+  unsigned to_submit = sqe_tail_ - sqe_submitted_;
+  return to_submit;
+}
+
+auto IoUring::Enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize) -> int {
+  int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, toSubmit, minComplete, flags, arg, argSize));
+  if (ret > 0) {
+    sqe_submitted_ += ret;
+  }
+  return ret;
+}
+
+void IoUring::PrepAcceptMultishot(int fd, uint64_t data) {
+  io_uring_sqe *sqe = GetSqe();
+  assert(sqe);
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->user_data = data;
+}
+
+void IoUring::PrepRecvMultishot(int fd, uint64_t data) {
+  io_uring_sqe *sqe = GetSqe();
+  assert(sqe);
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = data;
+}
+
+void IoUring::PrepPollAdd(int fd, uint32_t events, uint64_t data) {
+  io_uring_sqe *sqe = GetSqe();
+  assert(sqe);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = events;
+  sqe->user_data = data;
+}
+
+void IoUring::PrepSend(int fd, const void *buf, size_t len, uint64_t data, bool link) {
+  io_uring_sqe *sqe = GetSqe();
+  assert(sqe);
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(buf);
+  sqe->len = static_cast<uint32_t>(len);
+  // MSG_WAITALL 让内核在短写时自行重试，链上的下一个发送才不会乱序；
+  // 链上非最后一个发送加 MSG_MORE，避免响应头单独成包后被 Nagle 与延迟确认拖住
+  sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+  if (link) {
+    sqe->msg_flags |= MSG_MORE;
+    sqe->flags = IOSQE_IO_LINK;
+  }
+  sqe->user_data = data;
+}
+
+void IoUring::PrepCancelFd(int fd, uint64_t data) {
+  io_uring_sqe *sqe = GetSqe();
+  assert(sqe);
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = fd;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  sqe->user_data = data;
+}
+
+auto IoUring::Wait(int timeoutMs) -> int {
+  unsigned to_submit = FlushSq();
+  unsigned head = *cq_head_;
+  // 已有完成事件时只提交不等待
+  bool ready = LoadAcquire(cq_tail_) != head;
+  if (ready || timeoutMs == 0) {
+    if (to_submit > 0) {
+      Enter(to_submit, 0, 0, nullptr, 0);
+    }
+  } else {
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    struct __kernel_timespec ts;
+    if (timeoutMs > 0) {
+      ts.tv_sec = timeoutMs / 1000;
+      ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+      arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    // 提交与等待合并为一次 io_uring_enter，超时返回 -ETIME
+    Enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+  }
+
+  unsigned tail = LoadAcquire(cq_tail_);
+  size_t n = 0;
+  while (head != tail && n < events_.size()) {
+    events_[n++] = cqes_[head & cq_mask_];
+    head++;
+  }
+  StoreRelease(cq_head_, head);
+  return static_cast<int>(n);
+}
+
+auto IoUring::GetData(size_t i) const -> uint64_t {
+  assert(i < events_.size());
+  return events_[i].user_data;
+}
+
+auto IoUring::GetRes(size_t i) const -> int {
+  assert(i < events_.size());
+  return events_[i].res;
+}
+
+auto IoUring::GetFlags(size_t i) const -> uint32_t {
+  assert(i < events_.size());
+  return events_[i].flags;
+}
+
+auto IoUring::GetBuf(uint32_t flags) const -> const char * {
+  assert((flags & IORING_CQE_F_BUFFER) != 0U);
+  unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+  assert(bid < buf_count_);
+  return bufs_ + static_cast<size_t>(bid) * buf_size_;
+}
+
+void IoUring::RecycleBuf(uint32_t flags) {
+  assert((flags & IORING_CQE_F_BUFFER) != 0U);
+  unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+  io_uring_buf *buf = &buf_ring_[buf_tail_ & (buf_count_ - 1)];
+  buf->addr = reinterpret_cast<uint64_t>(bufs_ + static_cast<size_t>(bid) * buf_size_);
+  buf->len = buf_size_;
+  buf->bid = static_cast<uint16_t>(bid);
+  buf_tail_++;
+  __atomic_store_n(&buf_ring_[0].resv, static_cast<uint16_t>(buf_tail_), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,100 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// 基于 io_uring 的 I/O 后端，直接通过系统调用操作提交队列(SQ)与完成队列(CQ)。
+// 与 Epoller 的接口保持相似：Wait 返回就绪的完成事件数，再通过 GetData/GetRes/GetFlags 逐个访问。
+// 依赖 multishot accept/recv 与 provided buffer ring，需要 6.0 及以上内核，否则 IsValid() 返回 false。
+class IoUring {
+ public:
+  explicit IoUring(unsigned entries = 4096, unsigned maxEvent = 1024);
+
+  ~IoUring();
+
+  IoUring(const IoUring &) = delete;
+  auto operator=(const IoUring &) -> IoUring & = delete;
+
+  // 环是否创建成功且内核满足要求
+  auto IsValid() const -> bool { return ring_fd_ >= 0; }
+
+  // 注册 provided buffer ring，count 个大小为 size 的接收缓冲区（count 须为 2 的幂）
+  auto SetupBufRing(unsigned count, unsigned size) -> bool;
+
+  // multishot accept：一次提交，持续产生新连接的完成事件，新连接已是非阻塞的
+  void PrepAcceptMultishot(int fd, uint64_t data);
+  // multishot recv：数据写入内核从 buffer ring 中挑选的缓冲区，完成事件的 flags 携带缓冲区编号
+  void PrepRecvMultishot(int fd, uint64_t data);
+  // 发送 len 字节（MSG_WAITALL），link 为 true 时与下一个提交链接，保证按序执行
+  void PrepSend(int fd, const void *buf, size_t len, uint64_t data, bool link);
+  // 一次性的 poll：fd 上出现 events(POLLIN 等)时产生一个完成事件，之后需要重新提交
+  void PrepPollAdd(int fd, uint32_t events, uint64_t data);
+  // 取消 fd 上所有未完成的请求
+  void PrepCancelFd(int fd, uint64_t data);
+
+  // 提交所有待提交的请求并等待完成事件，timeoutMs 为 -1 时无限等待。
+  // 返回就绪的完成事件数量。
+  auto Wait(int timeoutMs = -1) -> int;
+
+  // 访问 Wait 返回后的第 i 个完成事件
+  auto GetData(size_t i) const -> uint64_t;
+  auto GetRes(size_t i) const -> int;
+  auto GetFlags(size_t i) const -> uint32_t;
+
+  // 根据完成事件的 flags 取出接收缓冲区，用完后须归还给 buffer ring
+  auto GetBuf(uint32_t flags) const -> const char *;
+  void RecycleBuf(uint32_t flags);
+
+ private:
+  auto GetSqe() -> io_uring_sqe *;
+  // 将本地 SQ 尾指针发布给内核，返回尚未提交的请求数量
+  auto FlushSq() -> unsigned;
+  auto Enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize) -> int;
+  void Release();
+
+  int ring_fd_;
+  unsigned features_;
+
+  // 提交队列
+  void *sq_ring_;
+  size_t sq_ring_size_;
+  unsigned *sq_head_;
+  unsigned *sq_tail_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  io_uring_sqe *sqes_;
+  size_t sqes_size_;
+  unsigned sqe_tail_;  // 本地已分配但未发布的尾指针
+  unsigned sqe_submitted_;
+
+  // 完成队列
+  void *cq_ring_;
+  size_t cq_ring_size_;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe *cqes_;
+
+  // 接收缓冲区环
+  io_uring_buf *buf_ring_;
+  size_t buf_ring_size_;
+  char *bufs_;
+  unsigned buf_count_;
+  unsigned buf_size_;
+  unsigned buf_tail_;
+
+  std::vector<io_uring_cqe> events_;  // 就绪的完成事件
+};
+
+#endif  // IOURING_H
@@ -1,49 +1,111 @@
 #include "webserver.h"
 
+namespace {
+auto NowMs() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// 事件循环等待的时长：空闲时也按接入控制的周期醒来，调整上限与输出统计不会因为某个 Reactor 阻塞在等待中而停顿
+auto WaitMs(int nextTickMs) -> int {
+  return nextTickMs < 0 ? AdmissionControl::UPDATE_MS : std::min(nextTickMs, AdmissionControl::UPDATE_MS);
+}
+}  // namespace
+
 WebServer::WebServer(int port, int trigMode, int timeoutMS, bool OptLinger,
                      int sqlPort, const char *sqlUser, const char *sqlPwd,
                      const char *dbName, int connPoolNum, int threadNum,
-                     bool openLog, int logLevel, int logQueSize)
+                     bool openLog, int logLevel, int logQueSize,
+                     int reactorNum, int ioBackend)
     : port_(port),
       open_linger_(OptLinger),
       timeout_ms_(timeoutMS),
       is_close_(false),
-      timer_(new HeapTimer()),
-      threadpool_(new ThreadPool(threadNum)),
-      epoller_(new Epoller()) {
+      multi_reactor_(reactorNum > 0),
+      use_uring_(ioBackend == 1),
+      users_(MAX_FD) {
+  // 先打开日志，初始化过程中的错误也能记录下来
+  if (openLog) {
+    Log::Instance()->Init(logLevel, "./log", ".log", logQueSize);
+  }
   src_dir_ = getcwd(nullptr, 256);
   assert(src_dir_);
   strncat(src_dir_, "/resources/", 16);
   HttpConn::user_count = 0;
+  HttpConn::request_count = 0;
   HttpConn::src_dir = src_dir_;
-  SqlConnPool::Instance()->Init("127.0.0.1", sqlPort, sqlUser, sqlPwd, dbName,
-                                connPoolNum);
+  HttpConn::deadlines = {FIRST_BYTE_TIMEOUT_MS, timeout_ms_, HEADER_TIMEOUT_MS, BODY_TIMEOUT_MS,
+                         WRITE_STALL_TIMEOUT_MS, MIN_RATE_BPS, MIN_RATE_GRACE_MS};
+  deadline_check_ms_ = std::min({FIRST_BYTE_TIMEOUT_MS, timeout_ms_, HEADER_TIMEOUT_MS, BODY_TIMEOUT_MS,
+                                 WRITE_STALL_TIMEOUT_MS, MIN_RATE_GRACE_MS});
+  HttpRequest::SetLimits(MAX_REQUEST_LINE, MAX_REQUEST_HEADER, MAX_REQUEST_BODY);
+  for (const auto &[prefix, value] : CACHE_CONTROL) {
+    HttpResponse::AddCacheControl(prefix, value);
+  }
+  // connPoolNum 为连接数上限，启动时只建立一部分，其余按需建立
+  SqlConnPool::Instance()->Init("127.0.0.1", sqlPort, sqlUser, sqlPwd, dbName, std::min(connPoolNum, SQL_MIN_CONN),
+                                connPoolNum, SQL_ACQUIRE_TIMEOUT_MS);
+  UserCache::Instance()->Init(USER_CACHE_TTL_S, USER_CACHE_MAX_ENTRIES, USER_CACHE_EXPECTED_USERS,
+                              SqlConnPool::Instance());
   /// 服务器中可以改成localhost 访问    但是本地只能127.0.0.1 不知道为啥
   InitEventMode(trigMode);
-  if (!InitSocket()) {
-    is_close_ = true;
-  }
-
-  //   if (openLog) {
-  //     Log::Instance()->init(logLevel, "./log", ".log", logQueSize);
-  //     if (isClose_) {
-  //       LOG_ERROR("========== Server init error!==========");
-  //     } else {
-  //       LOG_INFO("========== Server init ==========");
-  //       LOG_INFO("Port:%d, OpenLinger: %s", port_, OptLinger ? "true" :
-  //       "false"); LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
-  //                (listenEvent_ & EPOLLET ? "ET" : "LT"),
-  //                (connEvent_ & EPOLLET ? "ET" : "LT"));
-  //       LOG_INFO("LogSys level: %d", logLevel);
-  //       LOG_INFO("srcDir: %s", HttpConn::srcDir);
-  //       LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum,
-  //                threadNum);
-  //     }
-  //   }
+  int reactor_num = multi_reactor_ ? reactorNum : 1;
+  for (int i = 0; i < reactor_num; i++) {
+    auto reactor = std::make_unique<Reactor>();
+    if (use_uring_ && !InitUring(reactor.get())) {
+      use_uring_ = false;
+    }
+    reactors_.push_back(std::move(reactor));
+  }
+  for (auto &reactor : reactors_) {
+    if (!use_uring_) {
+      // 内核不支持 io_uring 时回退到 epoll
+      reactor->uring.reset();
+      reactor->epoller = std::make_unique<Epoller>();
+    }
+    reactor->timer = std::make_unique<TimerWheel>();
+    reactor->sql = std::make_unique<AsyncSql>(SqlConnPool::Instance(), UserCache::Instance(), REGISTER_BATCH_MAX,
+                                              REGISTER_BATCH_DELAY_US, SQL_MAX_QUEUED);
+    if (reactor->epoller) {
+      reactor->epoller->AddFd(reactor->sql->Fd(), EPOLLIN);
+    }
+    if (!InitSocket(reactor.get())) {
+      is_close_ = true;
+    }
+  }
+  // io_uring 直接提交内存中的数据，大文件仍映射到内存；epoll 后端使用 sendfile
+  HttpResponse::use_sendfile = !use_uring_;
+  // io_uring 与多 Reactor 模式都在事件循环线程内处理请求，不需要线程池
+  if (!multi_reactor_ && !use_uring_) {
+    threadpool_ = std::make_unique<ThreadPool>(threadNum);
+  }
+  admission_ = std::make_unique<AdmissionControl>(ADMISSION_MIN_REQUESTS, MAX_FD, ADMISSION_TARGET_DELAY_US);
+
+  if (openLog) {
+    if (is_close_) {
+      LOG_ERROR("========== Server init error!==========");
+    } else {
+      LOG_INFO("========== Server init ==========");
+      LOG_INFO("Port:%d, OpenLinger: %s", port_, OptLinger ? "true" : "false");
+      LOG_INFO("Listen Mode: %s, OpenConn Mode: %s", (listen_event_ & EPOLLET ? "ET" : "LT"),
+               (conn_event_ & EPOLLET ? "ET" : "LT"));
+      LOG_INFO("Reactor num: %zu, IO backend: %s", reactors_.size(), use_uring_ ? "io_uring" : "epoll");
+      LOG_INFO("LogSys level: %d", logLevel);
+      LOG_INFO("srcDir: %s", HttpConn::src_dir);
+      LOG_INFO("SqlConnPool min: %d, max: %d, ThreadPool num: %d", std::min(connPoolNum, SQL_MIN_CONN), connPoolNum,
+               threadNum);
+    }
+  }
 }
 
 WebServer::~WebServer() {
-  close(listen_fd_);
+  for (auto &reactor : reactors_) {
+    if (reactor->listen_fd >= 0) {
+      close(reactor->listen_fd);
+    }
+    // 进行中的查询先归还连接，再关闭连接池
+    reactor->sql.reset();
+  }
   is_close_ = true;
   free(src_dir_);
   SqlConnPool::Instance()->ClosePool();
@@ -76,146 +138,342 @@ void WebServer::InitEventMode(int trigMode) {
 }
 
 void WebServer::Start() {
-  int time_ms = -1;  // epoll wait timeout == -1 无事件将阻塞
   if (!is_close_) {
-    // LOG_INFO("========== Server start ==========");
+    LOG_INFO("========== Server start ==========");
+  }
+  // 多 Reactor 模式下，除主线程外每个 Reactor 各占一个线程
+  std::vector<std::thread> loops;
+  for (size_t i = 1; i < reactors_.size(); i++) {
+    loops.emplace_back([this, reactor = reactors_[i].get()] { Loop(reactor); });
+  }
+  Loop(reactors_[0].get());
+  for (auto &loop : loops) {
+    loop.join();
+  }
+}
+
+void WebServer::Loop(Reactor *reactor) {
+  if (reactor->uring) {
+    UringLoop(reactor);
+    return;
   }
+  int time_ms = -1;  // 定时器为空时 GetNextTick 返回 -1
+  Epoller *epoller = reactor->epoller.get();
   while (!is_close_) {
     if (timeout_ms_ > 0) {
-      time_ms = timer_->GetNextTick();
+      time_ms = reactor->timer->GetNextTick();
     }
-    int event_cnt = epoller_->Wait(time_ms);
+    int event_cnt = epoller->Wait(WaitMs(time_ms));
+    auto wake = std::chrono::steady_clock::now();
+    // 等待可能持续很久，本轮事件中的超时以返回时的时间计算
+    reactor->timer->UpdateClock();
     for (int i = 0; i < event_cnt; i++) {
       /* 处理事件 */
-      int fd = epoller_->GetEventFd(i);
-      uint32_t events = epoller_->GetEvents(i);
-      if (fd == listen_fd_) {
-        DealListen();
-      } else if ((events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0U) {
+      int fd = epoller->GetEventFd(i);
+      uint32_t events = epoller->GetEvents(i);
+      if (fd == reactor->listen_fd) {
+        DealListen(reactor);
+        continue;
+      }
+      if (fd == reactor->sql->Fd()) {
+        reactor->sql->OnReady();
+        continue;
+      }
+      // 连接事件携带句柄，代数不匹配说明是已关闭连接的过期事件，直接丢弃
+      uint64_t handle = epoller->GetEventData(i);
+      if (users_.Get(handle) == nullptr) {
+        continue;
+      }
+      if ((events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0U) {
         // EPOLLRDHUP：表示对端套接字关闭连接或者发生了对等方关机。当远程套接字关闭连接时，此事件将被触发。
         // EPOLLHUP：表示发生了挂起事件。这可能是由于对端套接字关闭了连接或者发生了异常情况。
         // EPOLLERR：表示发生了错误事件。通常，这表明套接字发生了错误，如连接重置或其他异常情况。
-        assert(users_.count(fd) > 0);
-        CloseConn(&users_[fd]);
+        CloseConn(reactor, handle);
       } else if ((events & EPOLLIN) != 0U) {
-        assert(users_.count(fd) > 0);
-        DealRead(&users_[fd]);
+        DealRead(reactor, handle);
       } else if ((events & EPOLLOUT) != 0U) {
-        assert(users_.count(fd) > 0);
-        DealWrite(&users_[fd]);
+        DealWrite(reactor, handle);
       } else {
-        // LOG_ERROR("Unexpected event");
+        LOG_ERROR("Unexpected event");
       }
 
       // EPOLLOUT：表示套接字可以进行写操作。当套接字的发送缓冲区变为可写时，此事件将被触发，表示可以向套接字写入数据了。
       // EPOLLIN：表示套接字可以进行读操作。当套接字的接收缓冲区中有数据可供读取时，此事件将被触发，表示可以从套接字读取数据了。
     }
+    // 一轮事件的处理时间即最后一个事件的排队时延
+    admission_->OnDelay(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wake).count()));
+    UpdateAdmission();
+    LogStats();
   }
 }
 
-void WebServer::SendError(int fd, const char *info) {
-  assert(fd > 0);
-  int ret = send(fd, info, strlen(info), 0);
-  if (ret < 0) {
-    // LOG_WARN("send error to client[%d] error!", fd);
+void WebServer::UpdateAdmission() {
+  int64_t now = NowMs();
+  int64_t due = next_admission_update_ms_.load(std::memory_order_relaxed);
+  // 到期后只有一个 Reactor 能取得执行权，执行期间其它 Reactor 看到的到期时间为 INT64_MAX
+  if (now < due || !next_admission_update_ms_.compare_exchange_strong(due, INT64_MAX, std::memory_order_acquire)) {
+    return;
   }
-  close(fd);
+  if (threadpool_) {
+    // 本周期内开始执行的任务的平均排队时间
+    ThreadPool::Stats stats = threadpool_->GetStats();
+    uint64_t executed = stats.executed - last_pool_stats_.executed;
+    if (executed > 0) {
+      admission_->OnDelay((stats.wait_us_total - last_pool_stats_.wait_us_total) / executed);
+    }
+    last_pool_stats_ = stats;
+  }
+  admission_->Update(HttpConn::request_count);
+  next_admission_update_ms_.store(now + AdmissionControl::UPDATE_MS, std::memory_order_release);
 }
 
-void WebServer::CloseConn(HttpConn *client) {
-  assert(client);
-  // LOG_INFO("Client[%d] quit!", client->GetFd());
-  epoller_->DelFd(client->GetFd());
+void WebServer::LogStats() {
+  int64_t now = NowMs();
+  int64_t due = next_stats_log_ms_.load(std::memory_order_relaxed);
+  if (now < due || !next_stats_log_ms_.compare_exchange_strong(due, INT64_MAX, std::memory_order_acquire)) {
+    return;
+  }
+  if (threadpool_) {
+    ThreadPool::Stats stats = threadpool_->GetStats();
+    LOG_INFO("ThreadPool queued:%zu executed:%llu avg_wait:%lluus max_wait:%lluus", stats.queued,
+             static_cast<unsigned long long>(stats.executed),
+             static_cast<unsigned long long>(stats.executed == 0 ? 0 : stats.wait_us_total / stats.executed),
+             static_cast<unsigned long long>(stats.wait_us_max));
+  }
+  for (size_t i = 0; i < reactors_.size(); i++) {
+    AsyncSql::Stats stats = reactors_[i]->sql->GetStats();
+    LOG_INFO("AsyncSql[%zu] queued:%d running:%d started:%llu avg_wait:%lluus max_wait:%lluus rejected:%llu "
+             "expired:%llu",
+             i, stats.queued, stats.running, static_cast<unsigned long long>(stats.started),
+             static_cast<unsigned long long>(stats.started == 0 ? 0 : stats.wait_us_total / stats.started),
+             static_cast<unsigned long long>(stats.wait_us_max), static_cast<unsigned long long>(stats.rejected),
+             static_cast<unsigned long long>(stats.expired));
+  }
+  next_stats_log_ms_.store(now + STATS_LOG_MS, std::memory_order_release);
+}
+
+void WebServer::CloseConn(Reactor *reactor, uint64_t handle) {
+  HttpConn *client = users_.Get(handle);
+  if (client == nullptr) {
+    return;
+  }
+  if (reactor->uring) {
+    UringClose(reactor, handle);
+    return;
+  }
+  // 先让句柄失效，定时器与线程池中残留的旧句柄都不会再作用到这个 fd 上
+  if (!users_.Retire(handle)) {
+    return;
+  }
+  // 定时器或对端关闭时可能有工作线程正在读写该连接，此时由它离开时完成关闭
+  if (client->RequestClose()) {
+    FinishClose(reactor, client);
+  }
+}
+
+void WebServer::FinishClose(Reactor *reactor, HttpConn *client) {
+  LOG_DEBUG("Client[%d] quit!", client->GetFd());
+  reactor->epoller->DelFd(client->GetFd());
   client->Close();
 }
 
-void WebServer::AddClient(int fd, sockaddr_in addr) {
+auto WebServer::EnterConn(uint64_t handle) -> HttpConn * {
+  // 任务排队期间连接可能已被关闭，fd 甚至已被新连接复用
+  HttpConn *client = users_.Get(handle);
+  if (client != nullptr) {
+    // 登记之后连接仍可能被 Reactor 线程关闭，此时关闭由本线程离开时完成；处理函数会再次检查句柄
+    client->EnterWorker();
+  }
+  return client;
+}
+
+void WebServer::LeaveConn(Reactor *reactor, HttpConn *client) {
+  if (client->LeaveWorker()) {
+    FinishClose(reactor, client);
+  }
+}
+
+void WebServer::AddClient(Reactor *reactor, int fd, sockaddr_in addr) {
   assert(fd > 0);
-  users_[fd].Init(fd, addr);
-  if (timeout_ms_ > 0) {
-    timer_->Add(fd, timeout_ms_,
-                [this, capture0 = &users_[fd]] { CloseConn(capture0); });
-  }  // capture0为局部变量名
-  epoller_->AddFd(fd, EPOLLIN | conn_event_);
+  uint64_t handle = users_.Acquire(fd);
+  HttpConn *client = users_.Get(handle);
+  client->Init(fd, addr);
+  ArmDeadline(reactor, handle, fd, FIRST_BYTE_TIMEOUT_MS);
+  reactor->epoller->AddFd(fd, EPOLLIN | conn_event_, handle);
   // 默认设置为读事件(EPOLLIN)是因为在
   // Web服务器中，最常见的操作是从客户端读取请求数据，
   // 因此在客户端与服务器建立连接后，首先需要准备好读取客户端发送的数据。因此，
   // 将文件描述符添加到epoll 实例时，默认设置为监听读事件（EPOLLIN）。
   SetFdNonblock(fd);
-  // LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+  LOG_DEBUG("Client[%d] in!", client->GetFd());
 }
 
-void WebServer::DealListen() {
+void WebServer::DealListen(Reactor *reactor) {
   struct sockaddr_in addr;
   socklen_t len = sizeof(addr);
   do {
-    int fd =
-        accept(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr), &len);
+    int fd = accept(reactor->listen_fd,
+                    reinterpret_cast<struct sockaddr *>(&addr), &len);
     if (fd <= 0) {
       return;
     }
-    if (HttpConn::user_count >= MAX_FD) {
-      SendError(fd, "Server busy!");
-      // LOG_WARN("Clients is full!");
-      return;
+    // 过载时直接拒绝，继续处理积压的连接
+    if (fd >= users_.MaxFd() || !admission_->Admit(HttpConn::request_count)) {
+      admission_->Reject(fd);
+      continue;
     }
-    AddClient(fd, addr);
+    AddClient(reactor, fd, addr);
   } while ((listen_event_ & EPOLLET) != 0U);
 }
 
-void WebServer::DealRead(HttpConn *client) {
-  assert(client);
-  ExtentTime(client);
-  threadpool_->Submit([this, client] { OnRead(client); });
+void WebServer::DealRead(Reactor *reactor, uint64_t handle) {
+  if (multi_reactor_) {
+    // 连接只属于当前线程，直接处理，省去线程间的投递与唤醒
+    OnRead(reactor, handle);
+    return;
+  }
+  threadpool_->Post([this, reactor, handle] {
+    if (HttpConn *client = EnterConn(handle)) {
+      OnRead(reactor, handle);
+      LeaveConn(reactor, client);
+    }
+  });
 }
 
-void WebServer::DealWrite(HttpConn *client) {
-  assert(client);
-  ExtentTime(client);
-  threadpool_->Submit([this, client] { OnWrite(client); });
+void WebServer::DealWrite(Reactor *reactor, uint64_t handle) {
+  if (multi_reactor_) {
+    OnWrite(reactor, handle);
+    return;
+  }
+  threadpool_->Post([this, reactor, handle] {
+    if (HttpConn *client = EnterConn(handle)) {
+      OnWrite(reactor, handle);
+      LeaveConn(reactor, client);
+    }
+  });
 }
 
-void WebServer::ExtentTime(HttpConn *client) {
-  assert(client);
+void WebServer::ArmDeadline(Reactor *reactor, uint64_t handle, int fd, int timeoutMs) {
   if (timeout_ms_ > 0) {
-    timer_->Adjust(client->GetFd(), timeout_ms_);
+    reactor->timer->Add(fd, std::min(timeoutMs, deadline_check_ms_),
+                        [this, reactor, handle] { OnDeadline(reactor, handle); });
   }
 }
 
-void WebServer::OnRead(HttpConn *client) {
-  assert(client);
+void WebServer::OnDeadline(Reactor *reactor, uint64_t handle) {
+  HttpConn *client = users_.Get(handle);
+  if (client == nullptr) {
+    return;
+  }
+  int left = client->CheckDeadline();
+  if (left < 0) {
+    LOG_INFO("Client[%d] deadline exceeded, phase:%d", client->GetFd(), client->GetPhase());
+    CloseConn(reactor, handle);
+    return;
+  }
+  ArmDeadline(reactor, handle, client->GetFd(), left);
+}
+
+void WebServer::OnRead(Reactor *reactor, uint64_t handle) {
+  // 任务排队期间连接可能已被关闭，fd 甚至已被新连接复用
+  HttpConn *client = users_.Get(handle);
+  if (client == nullptr) {
+    return;
+  }
   int ret = -1;
   int read_errno = 0;
   ret = client->Read(&read_errno);
   if (ret <= 0 && read_errno != EAGAIN) {
-    CloseConn(client);
+    CloseConn(reactor, handle);
     return;
   }
-  OnProcess(client);
+  OnProcess(reactor, handle);
 }
 
-void WebServer::OnProcess(HttpConn *client) {
+void WebServer::OnProcess(Reactor *reactor, uint64_t handle) {
+  HttpConn *client = users_.Get(handle);
+  if (client == nullptr) {
+    return;
+  }
+  OnProcessed(reactor, handle, client->Process());
+}
+
+void WebServer::OnProcessed(Reactor *reactor, uint64_t handle, bool ready) {
+  HttpConn *client = users_.Get(handle);
+  // 处理期间连接可能已被定时器关闭，关闭由本线程离开时完成
+  if (client == nullptr) {
+    return;
+  }
   // 调用 client->Process() 处理客户端请求。如果处理结果为
   // true，则表示请求处理完毕，且有数据要发送给客户端，因此需要将连接的 epoll
   // 事件设置为 EPOLLOUT（写事件就绪）。
   // 如果处理结果为 false，表示需要继续读取客户端的数据，因此将连接的 epoll
   // 事件设置为 EPOLLIN（读事件就绪）。
-  if (client->Process()) {
-    epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT);
+  if (ready) {
+    if (multi_reactor_) {
+      // 套接字通常可写，直接尝试发送，写不完再等待 EPOLLOUT
+      OnWrite(reactor, handle);
+      return;
+    }
+    reactor->epoller->ModFd(client->GetFd(), conn_event_ | EPOLLOUT, handle);
+  } else if (client->IsWaiting()) {
+    // 等待数据库期间不关注连接上的事件，查询完成后再继续
+    StartVerify(reactor, handle);
   } else {
-    epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLIN);
+    reactor->epoller->ModFd(client->GetFd(), conn_event_ | EPOLLIN, handle);
   }
 }
 
-void WebServer::OnWrite(HttpConn *client) {
-  assert(client);
+void WebServer::StartVerify(Reactor *reactor, uint64_t handle) {
+  const HttpRequest &request = users_.Get(handle)->GetRequest();
+  reactor->sql->Verify(request.VerifyUser(), request.VerifyPassword(),
+                       request.GetVerify() == HttpRequest::VERIFY_LOGIN,
+                       [this, reactor, handle](AsyncSql::Result result) { OnVerified(reactor, handle, result); });
+}
+
+void WebServer::OnVerified(Reactor *reactor, uint64_t handle, AsyncSql::Result result) {
+  // 查询期间连接可能已超时关闭
+  if (users_.Get(handle) == nullptr) {
+    return;
+  }
+  if (reactor->uring) {
+    UringResume(reactor, handle, result);
+    return;
+  }
+  if (multi_reactor_) {
+    OnResume(reactor, handle, result);
+    return;
+  }
+  threadpool_->Post([this, reactor, handle, result] {
+    if (HttpConn *client = EnterConn(handle)) {
+      OnResume(reactor, handle, result);
+      LeaveConn(reactor, client);
+    }
+  });
+}
+
+void WebServer::OnResume(Reactor *reactor, uint64_t handle, AsyncSql::Result result) {
+  HttpConn *client = users_.Get(handle);
+  if (client == nullptr) {
+    return;
+  }
+  OnProcessed(reactor, handle,
+              client->Resume(result == AsyncSql::RESULT_OK, result == AsyncSql::RESULT_UNAVAILABLE ? 503 : 200));
+}
+
+void WebServer::OnWrite(Reactor *reactor, uint64_t handle) {
+  HttpConn *client = users_.Get(handle);
+  if (client == nullptr) {
+    return;
+  }
   int ret = -1;
   int write_errno = 0;
   ret = client->Write(&write_errno);
   if (client->ToWriteBytes() == 0) {
     /* 传输完成 */
     if (client->IsKeepAlive()) {
-      OnProcess(client);
+      OnProcess(reactor, handle);
       return;
     }
   } else if (ret < 0) {
@@ -225,19 +483,19 @@ void WebServer::OnWrite(HttpConn *client) {
       /* 继续传输 */
       // 当前不能写更多数据，需要等待下一次写事件就绪再继续写入。此时，将连接的
       // epoll 事件设置为 EPOLLOUT
-      epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT);
+      reactor->epoller->ModFd(client->GetFd(), conn_event_ | EPOLLOUT, handle);
       return;
     }  // 如果写操作失败且不是因为 EAGAIN，则关闭连接
   }
-  CloseConn(client);
+  CloseConn(reactor, handle);
 }
 
 /* Create listenFd */
-auto WebServer::InitSocket() -> bool {
+auto WebServer::InitSocket(Reactor *reactor) -> bool {
   int ret;
   struct sockaddr_in addr;
   if (port_ > 65535 || port_ < 1024) {
-    // LOG_ERROR("Port:%d error!", port_);
+    LOG_ERROR("Port:%d error!", port_);
     return false;
   }
   addr.sin_family = AF_INET;
@@ -251,58 +509,74 @@ auto WebServer::InitSocket() -> bool {
   }
   // 调用 socket 函数创建一个面向连接的 TCP
   // 套接字（SOCK_STREAM），并检查是否创建成功。
-  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-  if (listen_fd_ < 0) {
-    // LOG_ERROR("Create socket error!", port_);
+  reactor->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (reactor->listen_fd < 0) {
+    LOG_ERROR("Create socket error!");
     return false;
   }
 
-  ret = setsockopt(listen_fd_, SOL_SOCKET, SO_LINGER, &opt_linger,
+  ret = setsockopt(reactor->listen_fd, SOL_SOCKET, SO_LINGER, &opt_linger,
                    sizeof(opt_linger));
   if (ret < 0) {
-    close(listen_fd_);
-    // LOG_ERROR("Init linger error!", port_);
+    close(reactor->listen_fd);
+    LOG_ERROR("Init linger error!");
     return false;
   }
 
   int optval = 1;
   /* 端口复用 */
   /* 只有最后一个套接字会正常接收数据。 */
-  ret = setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR,
+  ret = setsockopt(reactor->listen_fd, SOL_SOCKET, SO_REUSEADDR,
                    static_cast<const void *>(&optval), sizeof(int));
 
   if (ret == -1) {
-    // LOG_ERROR("set socket setsockopt error !");
-    close(listen_fd_);
+    LOG_ERROR("set socket setsockopt error !");
+    close(reactor->listen_fd);
     return false;
   }
+
+  if (multi_reactor_) {
+    // 每个 Reactor 绑定同一端口的独立监听套接字，由内核按四元组哈希分发新连接
+    ret = setsockopt(reactor->listen_fd, SOL_SOCKET, SO_REUSEPORT,
+                     static_cast<const void *>(&optval), sizeof(int));
+    if (ret == -1) {
+      LOG_ERROR("set socket SO_REUSEPORT error !");
+      close(reactor->listen_fd);
+      return false;
+    }
+  }
   // 将前面设置的地址信息绑定到监听套接字上。如果绑定失败，函数返回 false。
-  ret = bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+  ret = bind(reactor->listen_fd, reinterpret_cast<struct sockaddr *>(&addr),
              sizeof(addr));
   if (ret < 0) {
-    // LOG_ERROR("Bind Port:%d error!", port_);
-    close(listen_fd_);
+    LOG_ERROR("Bind Port:%d error!", port_);
+    close(reactor->listen_fd);
     return false;
   }
   // 通过 listen 函数使套接字进入监听状态，准备接受连接请求。listen
   // 函数的第二个参数指定了套接字的最大待处理连接队列长度。
-  ret = listen(listen_fd_, 6);
+  // 突发的连接在内核中排队，由接入控制决定接受还是拒绝，而不是在握手阶段被丢弃
+  ret = listen(reactor->listen_fd, SOMAXCONN);
   if (ret < 0) {
-    // LOG_ERROR("Listen port:%d error!", port_);
-    close(listen_fd_);
+    LOG_ERROR("Listen port:%d error!", port_);
+    close(reactor->listen_fd);
     return false;
   }
   // 将监听套接字添加到 epoll 事件监听中，关注的事件包括
   // EPOLLIN（表示有新的连接请求）以及其他通过 listen_event_
   // 指定的事件。如果添加失败，函数返回 false。
-  ret = static_cast<int>(epoller_->AddFd(listen_fd_, listen_event_ | EPOLLIN));
-  if (ret == 0) {
-    // LOG_ERROR("Add listen error!");
-    close(listen_fd_);
-    return false;
+  // io_uring 后端在事件循环开始时提交 multishot accept。
+  if (reactor->epoller) {
+    ret = static_cast<int>(
+        reactor->epoller->AddFd(reactor->listen_fd, listen_event_ | EPOLLIN));
+    if (ret == 0) {
+      LOG_ERROR("Add listen error!");
+      close(reactor->listen_fd);
+      return false;
+    }
   }
-  SetFdNonblock(listen_fd_);
-  // LOG_INFO("Server port:%d", port_);
+  SetFdNonblock(reactor->listen_fd);
+  LOG_INFO("Server port:%d", port_);
   return true;
 }
 
@@ -314,3 +588,240 @@ auto WebServer::SetFdNonblock(int fd) -> int {
   // 标志都会被添加到其中，使文件描述符进入非阻塞模式。
   return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
 }
+
+auto WebServer::InitUring(Reactor *reactor) -> bool {
+  auto uring = std::make_unique<IoUring>();
+  // 每个 Reactor 512 个 4KB 接收缓冲区，数据到达时才占用，拷入读缓冲区后立即归还
+  if (!uring->IsValid() || !uring->SetupBufRing(512, 4096)) {
+    return false;
+  }
+  reactor->uring = std::move(uring);
+  reactor->uring_conns.resize(MAX_FD);
+  return true;
+}
+
+void WebServer::UringLoop(Reactor *reactor) {
+  IoUring *uring = reactor->uring.get();
+  uring->PrepAcceptMultishot(reactor->listen_fd,
+                             UringData(URING_ACCEPT, reactor->listen_fd));
+  uring->PrepPollAdd(reactor->sql->Fd(), POLLIN, UringData(URING_SQL, 0));
+  while (!is_close_) {
+    // 重新提交 accept 也由定时器驱动，不检查期限时定时器通常为空，GetNextTick 返回 -1
+    int time_ms = reactor->timer->GetNextTick();
+    // 上一轮产生的接收、发送、重新挂载请求在这里一次性提交
+    int event_cnt = uring->Wait(WaitMs(time_ms));
+    auto wake = std::chrono::steady_clock::now();
+    // 等待可能持续很久，本轮事件中的超时以返回时的时间计算
+    reactor->timer->UpdateClock();
+    for (int i = 0; i < event_cnt; i++) {
+      uint64_t data = uring->GetData(i);
+      int res = uring->GetRes(i);
+      uint32_t flags = uring->GetFlags(i);
+      uint64_t handle = data & ((1ULL << 56) - 1);
+      switch (data >> 56) {
+        case URING_ACCEPT:
+          if (res >= 0) {
+            UringAddClient(reactor, res);
+          } else {
+            LOG_WARN("Accept error: %s", strerror(-res));
+          }
+          if ((flags & IORING_CQE_F_MORE) == 0U) {
+            // multishot accept 被内核终止，重新提交。因 fd 或内存耗尽而终止时立即提交会马上再次失败，
+            // 事件循环空转，等待 ACCEPT_RETRY_MS 后再提交
+            if (res >= 0) {
+              uring->PrepAcceptMultishot(reactor->listen_fd, data);
+            } else {
+              reactor->timer->Add(reactor->listen_fd, ACCEPT_RETRY_MS,
+                                  [reactor, data] { reactor->uring->PrepAcceptMultishot(reactor->listen_fd, data); });
+            }
+          }
+          break;
+        case URING_RECV:
+          OnUringRecv(reactor, handle, res, flags);
+          break;
+        case URING_SEND:
+          OnUringSend(reactor, handle, res);
+          break;
+        case URING_SQL:
+          reactor->sql->OnReady();
+          // 单次 poll，处理完重新挂载
+          uring->PrepPollAdd(reactor->sql->Fd(), POLLIN, data);
+          break;
+        default:
+          break;
+      }
+    }
+    // 一轮事件的处理时间即最后一个事件的排队时延
+    admission_->OnDelay(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wake).count()));
+    UpdateAdmission();
+    LogStats();
+  }
+}
+
+void WebServer::UringAddClient(Reactor *reactor, int fd) {
+  assert(fd > 0);
+  if (fd >= users_.MaxFd() || !admission_->Admit(HttpConn::request_count)) {
+    admission_->Reject(fd);
+    return;
+  }
+  struct sockaddr_in addr = {0};
+  socklen_t len = sizeof(addr);
+  getpeername(fd, reinterpret_cast<struct sockaddr *>(&addr), &len);
+  uint64_t handle = users_.Acquire(fd);
+  users_.Get(handle)->Init(fd, addr);
+  ArmDeadline(reactor, handle, fd, FIRST_BYTE_TIMEOUT_MS);
+  UringConn &conn = reactor->uring_conns[fd];
+  conn = UringConn();
+  conn.inflight = 1;
+  conn.recv_armed = true;
+  reactor->uring->PrepRecvMultishot(fd, UringData(URING_RECV, handle));
+}
+
+void WebServer::OnUringRecv(Reactor *reactor, uint64_t handle, int res,
+                            uint32_t flags) {
+  // 未完成的请求全部结束前不会让句柄失效，这里的查找总能成功
+  HttpConn *client = users_.Get(handle);
+  assert(client);
+  UringConn &conn = reactor->uring_conns[client->GetFd()];
+  if ((flags & IORING_CQE_F_MORE) == 0U) {
+    conn.inflight--;
+    conn.recv_armed = false;
+  }
+  if (res > 0) {
+    // 关闭中的连接丢弃取消生效前收到的数据
+    if (!conn.closing) {
+      client->AppendRead(reactor->uring->GetBuf(flags), res);
+    }
+    reactor->uring->RecycleBuf(flags);
+    if (!conn.closing) {
+      // 发送中的连接等本轮响应发完、等待数据库的连接等查询完成再处理新数据，
+      // 期间 recv 仍在接收，收到的数据不能无限堆积
+      if (conn.sending == 0 && !client->IsWaiting()) {
+        UringProcess(reactor, handle);
+      } else if (client->ReadOverflow()) {
+        LOG_WARN("Client[%d] read buffer overflow", client->GetFd());
+        // 由 UringClose 标记关闭并取消仍在接收的 recv，不必等发送或查询结束
+        UringClose(reactor, handle);
+        return;
+      }
+    }
+  } else if (res != -ENOBUFS) {
+    // 对端关闭(0)或出错
+    UringClose(reactor, handle);
+    return;
+  }
+  if (conn.closing) {
+    UringClose(reactor, handle);
+  } else if (!conn.recv_armed) {
+    conn.inflight++;
+    conn.recv_armed = true;
+    reactor->uring->PrepRecvMultishot(client->GetFd(),
+                                      UringData(URING_RECV, handle));
+  }
+}
+
+void WebServer::OnUringSend(Reactor *reactor, uint64_t handle, int res) {
+  HttpConn *client = users_.Get(handle);
+  assert(client);
+  UringConn &conn = reactor->uring_conns[client->GetFd()];
+  conn.inflight--;
+  conn.sending--;
+  if (res > 0) {
+    client->Consume(res);
+  } else if (res < 0) {
+    // 链上出错后，后续的发送会以 -ECANCELED 完成
+    conn.send_error = true;
+  }
+  if (conn.sending > 0) {
+    return;
+  }
+  if (conn.closing || conn.send_error) {
+    UringClose(reactor, handle);
+    return;
+  }
+  if (client->ToWriteBytes() > 0) {
+    /* 继续传输 */
+    UringSend(reactor, handle);
+    return;
+  }
+  if (!client->IsKeepAlive()) {
+    UringClose(reactor, handle);
+    return;
+  }
+  // 发送期间可能已收到下一个请求
+  UringProcess(reactor, handle);
+}
+
+void WebServer::UringProcess(Reactor *reactor, uint64_t handle) {
+  HttpConn *client = users_.Get(handle);
+  if (client->IsWaiting()) {
+    // 数据库查询完成后由 UringResume 继续处理新到的数据
+    return;
+  }
+  if (client->Process()) {
+    UringSend(reactor, handle);
+  } else if (client->IsWaiting()) {
+    StartVerify(reactor, handle);
+  }
+}
+
+void WebServer::UringResume(Reactor *reactor, uint64_t handle, AsyncSql::Result result) {
+  HttpConn *client = users_.Get(handle);
+  if (reactor->uring_conns[client->GetFd()].closing) {
+    // 正在关闭，等未完成的请求结束即可
+    return;
+  }
+  if (client->Resume(result == AsyncSql::RESULT_OK, result == AsyncSql::RESULT_UNAVAILABLE ? 503 : 200)) {
+    UringSend(reactor, handle);
+  } else if (client->IsWaiting()) {
+    StartVerify(reactor, handle);
+  }
+}
+
+void WebServer::UringSend(Reactor *reactor, uint64_t handle) {
+  HttpConn *client = users_.Get(handle);
+  int fd = client->GetFd();
+  UringConn &conn = reactor->uring_conns[fd];
+  const struct iovec *iov = client->GetIov();
+  int last = -1;
+  for (int i = 0; i < client->GetIovCnt(); i++) {
+    if (iov[i].iov_len > 0) {
+      last = i;
+    }
+  }
+  // 状态行与响应头、文件内容分别作为链接的发送请求，与其它请求一起在下一次 Wait 中提交
+  for (int i = 0; i <= last; i++) {
+    if (iov[i].iov_len == 0) {
+      continue;
+    }
+    reactor->uring->PrepSend(fd, iov[i].iov_base, iov[i].iov_len,
+                             UringData(URING_SEND, handle), i < last);
+    conn.inflight++;
+    conn.sending++;
+  }
+  conn.send_error = false;
+}
+
+void WebServer::UringClose(Reactor *reactor, uint64_t handle) {
+  HttpConn *client = users_.Get(handle);
+  if (client == nullptr) {
+    return;
+  }
+  int fd = client->GetFd();
+  UringConn &conn = reactor->uring_conns[fd];
+  if (conn.inflight > 0) {
+    if (!conn.closing) {
+      conn.closing = true;
+      reactor->uring->PrepCancelFd(fd, UringData(URING_CANCEL, handle));
+    }
+    return;
+  }
+  // 所有请求都已完成，此时才让句柄失效并关闭 fd
+  if (!users_.Retire(handle)) {
+    return;
+  }
+  LOG_DEBUG("Client[%d] quit!", fd);
+  conn = UringConn();
+  client->Close();
+}
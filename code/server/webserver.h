@@ -4,62 +4,196 @@
 #include <arpa/inet.h>
 #include <fcntl.h>  // fcntl()
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <unistd.h>  // close()
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
-#include <unordered_map>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "../http/httpconn.h"
 #include "../log/log.h"
-#include "../pool/sqlconnRAII.h"
+#include "../pool/asyncsql.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/threadpool.h"
 #include "../timer/timer.h"
+#include "admission.h"
+#include "connslab.h"
 #include "epoller.h"
+#include "iouring.h"
 
 class WebServer {
  public:
+  // reactorNum == 0：单 Reactor + 线程池模式（主线程 epoll，读写交给线程池）
+  // reactorNum  > 0：多 Reactor 模式（one loop per thread），每个线程一个事件循环，
+  //                  各自持有 SO_REUSEPORT 监听套接字、Epoller、定时器与连接表
+  // ioBackend: 0 为 epoll；1 为 io_uring，内核不支持时回退到 epoll。
+  //            io_uring 为完成模型，请求在所属 Reactor 线程内直接处理
   WebServer(int port, int trigMode, int timeoutMS, bool OptLinger, int sqlPort,
             const char *sqlUser, const char *sqlPwd, const char *dbName,
             int connPoolNum, int threadNum, bool openLog, int logLevel,
-            int logQueSize);
+            int logQueSize, int reactorNum = 0, int ioBackend = 0);
 
   ~WebServer();
   // 启动服务器
   void Start();
 
  private:
+  // io_uring 后端下每个连接的未完成请求状态
+  struct UringConn {
+    // 尚未收到最终完成事件的请求数，归零前不能关闭 fd，避免 fd 被复用
+    int inflight = 0;
+    // 正在发送的请求数
+    int sending = 0;
+    // multishot recv 是否仍然有效
+    bool recv_armed = false;
+    // 发送链上是否出现错误
+    bool send_error = false;
+    // 是否正在关闭
+    bool closing = false;
+  };
+
+  // 一个事件循环所需的全部状态，连接在其整个生命周期内只属于一个 Reactor
+  struct Reactor {
+    // 监听套接字的文件描述符
+    int listen_fd = -1;
+    // 用于监听和处理事件（epoll 后端）
+    std::unique_ptr<Epoller> epoller;
+    // 用于提交和收割 I/O 请求（io_uring 后端），uring_conns 以 fd 为下标
+    std::unique_ptr<IoUring> uring;
+    std::vector<UringConn> uring_conns;
+    // 定时器，用于处理客户端连接的超时
+    std::unique_ptr<TimerWheel> timer;
+    // 登录、注册的数据库查询，在本 Reactor 线程中以非阻塞方式执行
+    std::unique_ptr<AsyncSql> sql;
+  };
+
   // 初始化套接字
-  auto InitSocket() -> bool;
+  auto InitSocket(Reactor *reactor) -> bool;
   // 根据触发模式初始化事件模式
   void InitEventMode(int trigMode);
+  // 运行一个 Reactor 的事件循环
+  void Loop(Reactor *reactor);
   // 向服务器添加客户端连接
-  void AddClient(int fd, sockaddr_in addr);
+  void AddClient(Reactor *reactor, int fd, sockaddr_in addr);
   // 处理监听套接字上的事件
-  void DealListen();
+  void DealListen(Reactor *reactor);
 
-  // 处理读、写事件(事件的处理被委托给了线程池中的任务)
-  void DealWrite(HttpConn *client);
-  void DealRead(HttpConn *client);
+  // 处理读、写事件(单 Reactor 模式下委托给线程池，多 Reactor 模式下在本线程直接处理)
+  // 连接以 ConnSlab 句柄传递，任务执行时连接已关闭则直接返回
+  void DealWrite(Reactor *reactor, uint64_t handle);
+  void DealRead(Reactor *reactor, uint64_t handle);
 
-  // 发送错误信息给客户端
-  void SendError(int fd, const char *info);
-  // 更新客户端的超时时间
-  void ExtentTime(HttpConn *client);
-  // 关闭客户端连接
-  void CloseConn(HttpConn *client);
+  // 连接的定时器到期：按连接所处阶段检查期限，超过时关闭，否则重新设置定时器。
+  // 定时器间隔不超过 deadline_check_ms_，阶段变化后的期限不会被错过，处理事件时不必调整定时器
+  void OnDeadline(Reactor *reactor, uint64_t handle);
+  void ArmDeadline(Reactor *reactor, uint64_t handle, int fd, int timeoutMs);
+  // 关闭客户端连接。线程池模式下有工作线程正在处理该连接时只让句柄失效，由它离开时完成关闭
+  void CloseConn(Reactor *reactor, uint64_t handle);
+  // 注销 fd 并释放连接的资源，只由连接的处理者(没有工作线程时为 Reactor 线程)调用
+  void FinishClose(Reactor *reactor, HttpConn *client);
+  // 线程池模式下工作线程处理连接前后调用，连接已关闭时 EnterConn 返回 nullptr
+  auto EnterConn(uint64_t handle) -> HttpConn *;
+  void LeaveConn(Reactor *reactor, HttpConn *client);
 
   // 处理读、写事件(底层实现)
-  void OnRead(HttpConn *client);
-  void OnWrite(HttpConn *client);
+  void OnRead(Reactor *reactor, uint64_t handle);
+  void OnWrite(Reactor *reactor, uint64_t handle);
 
   // 处理客户端请求的具体逻辑
-  void OnProcess(HttpConn *client);
+  void OnProcess(Reactor *reactor, uint64_t handle);
+  // 根据处理结果等待写事件、发起数据库查询或继续等待读事件
+  void OnProcessed(Reactor *reactor, uint64_t handle, bool ready);
+  // 为暂停的登录、注册请求发起数据库查询，结果在 Reactor 线程中交给 OnVerified
+  void StartVerify(Reactor *reactor, uint64_t handle);
+  void OnVerified(Reactor *reactor, uint64_t handle, AsyncSql::Result result);
+  // 带着验证结果继续处理暂停的请求，没有及时取得数据库连接时响应 503
+  void OnResume(Reactor *reactor, uint64_t handle, AsyncSql::Result result);
+  // 每隔 STATS_LOG_MS 输出线程池与各数据库执行器的排队统计。
+  // 与 UpdateAdmission 相同，各 Reactor 每轮事件后都调用，周期到达时由最先调用的一个执行
+  void LogStats();
+  // 每个周期报告线程池的排队时延并按处理中的请求数调整接入上限。
+  // 各 Reactor 每轮事件后都调用，周期到达时由最先调用的一个执行
+  void UpdateAdmission();
+
+  // io_uring 后端：用户数据的高 8 位为请求类型，低 56 位为连接句柄
+  enum UringOp : uint64_t {
+    URING_ACCEPT = 1,
+    URING_RECV,
+    URING_SEND,
+    URING_CANCEL,
+    // 数据库执行器的 fd 可读
+    URING_SQL,
+  };
+  static auto UringData(UringOp op, uint64_t handle) -> uint64_t {
+    return (static_cast<uint64_t>(op) << 56) | handle;
+  }
+  // 为 Reactor 创建 io_uring，失败时返回 false
+  auto InitUring(Reactor *reactor) -> bool;
+  // 运行一个 io_uring 事件循环
+  void UringLoop(Reactor *reactor);
+  void UringAddClient(Reactor *reactor, int fd);
+  void OnUringRecv(Reactor *reactor, uint64_t handle, int res, uint32_t flags);
+  void OnUringSend(Reactor *reactor, uint64_t handle, int res);
+  // 解析已接收的数据，生成响应后提交发送
+  void UringProcess(Reactor *reactor, uint64_t handle);
+  // 数据库查询完成后继续处理暂停的请求
+  void UringResume(Reactor *reactor, uint64_t handle, AsyncSql::Result result);
+  // 将响应的各个数据块作为链接的发送请求提交
+  void UringSend(Reactor *reactor, uint64_t handle);
+  // 取消连接上的未完成请求，全部完成后再关闭 fd 并让句柄失效
+  void UringClose(Reactor *reactor, uint64_t handle);
 
   // 服务器支持的最大文件描述符数量
   static const int MAX_FD = 65536;
+  // 数据库连接池启动时建立的连接数(不超过 connPoolNum)，以及获取连接的最长等待时间
+  static const int SQL_MIN_CONN = 4;
+  static const int SQL_ACQUIRE_TIMEOUT_MS = 500;
+  // 用户凭据缓存的有效期、记录数上限，以及布隆过滤器按多少个用户名分配
+  static const int USER_CACHE_TTL_S = 300;
+  static const size_t USER_CACHE_MAX_ENTRIES = 1 << 20;
+  static const size_t USER_CACHE_EXPECTED_USERS = 1 << 20;
+  // 一次事务提交的注册数上限，以及注册攒批的最长等待时间(微秒)
+  static const size_t REGISTER_BATCH_MAX = 64;
+  static const int REGISTER_BATCH_DELAY_US = 2000;
+  // 每个 Reactor 的数据库执行器排队请求数的上限，超过时响应 503
+  static const int SQL_MAX_QUEUED = 1024;
+  // io_uring 后端 accept 出错(如 fd 耗尽)后，重新提交前等待的时间
+  static const int ACCEPT_RETRY_MS = 100;
+  // 输出排队统计的间隔
+  static const int STATS_LOG_MS = 60000;
+  // 新连接收到第一个字节、接收头部、接收请求体的期限，以及发送响应无进展的期限
+  static const int FIRST_BYTE_TIMEOUT_MS = 10000;
+  static const int HEADER_TIMEOUT_MS = 10000;
+  static const int BODY_TIMEOUT_MS = 30000;
+  static const int WRITE_STALL_TIMEOUT_MS = 10000;
+  // 接收请求体、发送响应超过 MIN_RATE_GRACE_MS 后的最低平均速率(字节/秒)
+  static const int MIN_RATE_BPS = 1024;
+  static const int MIN_RATE_GRACE_MS = 10000;
+  // 请求行、请求行加头部、请求体的长度上限
+  static const size_t MAX_REQUEST_LINE = 8192;
+  static const size_t MAX_REQUEST_HEADER = 16384;
+  static const size_t MAX_REQUEST_BODY = 65536;
+  // 按路径前缀设置的 Cache-Control，最长的前缀优先：页面每次都向服务器验证(通常得到 304)，
+  // 样式、脚本、字体与图片在有效期内直接使用客户端缓存
+  static constexpr std::pair<const char *, const char *> CACHE_CONTROL[] = {
+      {"/", "no-cache"},
+      {"/css/", "public, max-age=86400"},
+      {"/js/", "public, max-age=86400"},
+      {"/fonts/", "public, max-age=2592000"},
+      {"/images/", "public, max-age=604800"},
+  };
+  // 接入控制的处理中请求数下限，以及可接受的排队时延(微秒)
+  static const int ADMISSION_MIN_REQUESTS = 64;
+  static const int ADMISSION_TARGET_DELAY_US = 10000;
   // 用于设置指定文件描述符为非阻塞模式
   static auto SetFdNonblock(int fd) -> int;
 
@@ -69,12 +203,16 @@ class WebServer {
   // SO_LINGER
   // 是套接字选项中的一种，用于控制关闭连接时的行为。当一个套接字关闭时，操作系统会尝试将发送缓冲区中的数据发送给对方，然后等待一段时间以确保数据发送成功，最后再关闭连接。SO_LINGER选项允许设置套接字关闭的行为，特别是在存在未发送完的数据时。
   bool open_linger_;
-  // 超时时间 MS
+  // 持久连接的空闲超时时间 MS，不大于 0 时不检查任何期限
   int timeout_ms_;
+  // 各阶段期限中最短的一个，连接定时器的最长间隔
+  int deadline_check_ms_;
 
   bool is_close_;
-  // 监听套接字的文件描述符
-  int listen_fd_;
+  // 是否为多 Reactor 模式
+  bool multi_reactor_;
+  // 是否使用 io_uring 后端
+  bool use_uring_;
   // 存储服务器资源目录的路径
   char *src_dir_;
   // 监听套接字关注的事件类型
@@ -82,14 +220,19 @@ class WebServer {
   // 连接套接字关注的事件类型
   uint32_t conn_event_;
 
-  // 定时器，用于处理客户端连接的超时
-  std::unique_ptr<HeapTimer> timer_;
-  // 用于处理客户端请求
+  // 用于处理客户端请求（仅单 Reactor 模式）。只执行不阻塞的工作，数据库查询交给各 Reactor 的 AsyncSql
   std::unique_ptr<ThreadPool> threadpool_;
-  // 用于监听和处理事件
-  std::unique_ptr<Epoller> epoller_;
-  // 存储客户端连接的容器，键为文件描述符，值为对应的 HttpConn 实例
-  std::unordered_map<int, HttpConn> users_;
+  // 下一次输出排队统计的时间(毫秒)，正在输出时为 INT64_MAX
+  std::atomic<int64_t> next_stats_log_ms_{0};
+  std::unique_ptr<AdmissionControl> admission_;
+  // 下一次调整接入上限的时间(毫秒)，正在调整时为 INT64_MAX；以及上次读取的线程池统计，只由调整的一方访问
+  std::atomic<int64_t> next_admission_update_ms_{0};
+  ThreadPool::Stats last_pool_stats_ = {};
+  // 事件循环，单 Reactor 模式下只有一个
+  std::vector<std::unique_ptr<Reactor>> reactors_;
+  // 以 fd 为下标的连接表。fd 在进程内唯一，多 Reactor 共用一张表，
+  // 每个 Reactor 只会访问自己接受的那些 fd
+  ConnSlab users_;
 };
 
-#endif  // WEBSERVER_H
\ No newline at end of file
+#endif  // WEBSERVER_H
@@ -1,137 +1,232 @@
-
 #include "timer.h"
 
-void HeapTimer::HeapifyUp(size_t i) {
-  assert(i >= 0 && i < heap_.size());
-  size_t j = (i - 1) / 2;
-  while (j >= 0) {
-    if (heap_[j] < heap_[i]) {
-      break;
+#include <algorithm>
+#include <climits>
+#include <ctime>
+
+TimerWheel::TimerWheel() {
+  nodes_.reserve(64);
+  for (auto &level : heads_) {
+    for (int &head : level) {
+      head = -1;
     }
-    SwapNode(i, j);
-    i = j;
-    j = (i - 1) / 2;
   }
+  UpdateClock();
+  now_ = cur_ + 1;
 }
 
-void HeapTimer::SwapNode(size_t i, size_t j) {
-  assert(i >= 0 && i < heap_.size());
-  assert(j >= 0 && j < heap_.size());
-  std::swap(heap_[i], heap_[j]);
-  ref_[heap_[i].id_] = i;
-  ref_[heap_[j].id_] = j;
+void TimerWheel::UpdateClock() {
+  // 粗粒度时钟走 vDSO，不进入内核，精度(几毫秒)对连接超时足够
+  struct timespec ts {};
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  cur_ = static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
 }
 
-auto HeapTimer::HeapifyDown(size_t idx, size_t n) -> bool {
-  assert(idx >= 0 && idx < heap_.size());
-  assert(n >= 0 && n <= heap_.size());  // 边界[a,b)
-  size_t i = idx;
-  size_t j = i * 2 + 1;
-  while (j < n) {
-    if (j + 1 < n && heap_[j + 1] < heap_[j]) {
-      j++;
-    }
-    if (heap_[i] < heap_[j]) {
-      break;
-    }
-    SwapNode(i, j);
-    i = j;
-    j = i * 2 + 1;
+auto TimerWheel::Node(int id) -> TimerNode & {
+  assert(id >= 0);
+  if (static_cast<size_t>(id) >= nodes_.size()) {
+    nodes_.resize(std::max(static_cast<size_t>(id) + 1, nodes_.size() * 2));
   }
-  return i > idx;
+  return nodes_[id];
 }
 
-void HeapTimer::Add(int id, int timeout, const TimeoutCallBack &cb) {
-  assert(id >= 0);
-  size_t i;
-  if (ref_.count(id) == 0) {
-    /* 新节点：堆尾插入，调整堆 */
-    i = heap_.size();
-    ref_[id] = i;
-    heap_.emplace_back(id, Clock::now() + MS(timeout), cb);
-    HeapifyUp(i);
+void TimerWheel::Link(int id) {
+  TimerNode &node = nodes_[id];
+  uint64_t delta = node.expires > now_ ? node.expires - now_ : 0;
+  if (delta > MAX_SPAN) {
+    delta = MAX_SPAN;
+  }
+  int level = 0;
+  while ((delta >> (SLOT_BITS * (level + 1))) != 0) {
+    level++;
+  }
+  int slot = static_cast<int>(((now_ + delta) >> (SLOT_BITS * level)) & SLOT_MASK);
+  node.level = level;
+  node.slot = slot;
+  node.prev = -1;
+  node.next = heads_[level][slot];
+  if (node.next >= 0) {
+    nodes_[node.next].prev = id;
+  }
+  heads_[level][slot] = id;
+  bitmap_[level] |= 1ULL << slot;
+}
+
+void TimerWheel::Unlink(int id) {
+  TimerNode &node = nodes_[id];
+  if (node.prev >= 0) {
+    nodes_[node.prev].next = node.next;
   } else {
-    /* 已有结点：调整堆 */
-    i = ref_[id];
-    heap_[i].expires_ = Clock::now() + MS(timeout);
-    heap_[i].cb_ = cb;
-    if (!HeapifyDown(i, heap_.size())) {
-      HeapifyUp(i);
+    heads_[node.level][node.slot] = node.next;
+    if (node.next < 0) {
+      bitmap_[node.level] &= ~(1ULL << node.slot);
     }
   }
+  if (node.next >= 0) {
+    nodes_[node.next].prev = node.prev;
+  }
+  node.prev = node.next = -1;
 }
 
-void HeapTimer::DoWork(int id) {
-  /* 删除指定id结点，并触发回调函数 */
-  if (heap_.empty() || ref_.count(id) == 0) {
-    return;
+void TimerWheel::Add(int id, int timeout, const TimeoutCallBack &cb) {
+  TimerNode &node = Node(id);
+  if (node.active) {
+    Unlink(id);
+  } else {
+    node.active = true;
+    count_++;
   }
-  size_t i = ref_[id];
-  TimerNode node = heap_[i];
-  node.cb_();
-  Del(i);
+  node.expires = cur_ + std::max(timeout, 0);
+  node.cb = cb;
+  Link(id);
 }
 
-void HeapTimer::Del(size_t idx) {
-  /* 删除指定位置的结点 */
-  assert(!heap_.empty() && idx >= 0 && idx < heap_.size());
-  /* 将要删除的结点换到堆尾，然后调整堆 */
-  size_t i = idx;
-  size_t n = heap_.size() - 1;
-  assert(i <= n);
-  if (i < n) {
-    SwapNode(i, n);
-    if (!HeapifyDown(i, n)) {
-      HeapifyUp(i);
-    }
+void TimerWheel::Adjust(int id, int newExpires) {
+  if (id < 0 || static_cast<size_t>(id) >= nodes_.size() || !nodes_[id].active) {
+    return;
+  }
+  TimerNode &node = nodes_[id];
+  uint64_t expires = cur_ + std::max(newExpires, 0);
+  if (expires >= node.expires) {
+    // 延后：所在槽位不晚于新的到期时间，到时再重新挂入
+    node.expires = expires;
+    return;
   }
-  /* 堆尾元素删除 */
-  ref_.erase(heap_.back().id_);
-  heap_.pop_back();
+  Unlink(id);
+  node.expires = expires;
+  Link(id);
 }
 
-void HeapTimer::Adjust(int id, int newExpires) {
-  /* 调整指定id的结点 */
-  assert(!heap_.empty() && ref_.count(id) > 0);
-  heap_[ref_[id]].expires_ = Clock::now() + MS(newExpires);
-  if (!HeapifyDown(ref_[id], heap_.size())) {
-    HeapifyUp(ref_[id]);
+void TimerWheel::DoWork(int id) {
+  if (id < 0 || static_cast<size_t>(id) >= nodes_.size() || !nodes_[id].active) {
+    return;
   }
+  TimerNode &node = nodes_[id];
+  Unlink(id);
+  node.active = false;
+  count_--;
+  // 回调可能重新添加同一个 id，先移出再执行
+  TimeoutCallBack cb = std::move(node.cb);
+  node.cb = nullptr;
+  cb();
 }
 
-void HeapTimer::Tick() {
-  /* 清除超时结点 */
-  if (heap_.empty()) {
+void TimerWheel::Cancel(int id) {
+  if (id < 0 || static_cast<size_t>(id) >= nodes_.size() || !nodes_[id].active) {
     return;
   }
-  while (!heap_.empty()) {
-    TimerNode node = heap_.front();
-    if (std::chrono::duration_cast<MS>(node.expires_ - Clock::now()).count() > 0) {
-      break;
+  Unlink(id);
+  nodes_[id].active = false;
+  nodes_[id].cb = nullptr;
+  count_--;
+}
+
+void TimerWheel::Clear() {
+  for (TimerNode &node : nodes_) {
+    node = TimerNode();
+  }
+  for (auto &level : heads_) {
+    for (int &head : level) {
+      head = -1;
+    }
+  }
+  for (uint64_t &bits : bitmap_) {
+    bits = 0;
+  }
+  count_ = 0;
+}
+
+void TimerWheel::Cascade(int level, int slot) {
+  int id = heads_[level][slot];
+  heads_[level][slot] = -1;
+  bitmap_[level] &= ~(1ULL << slot);
+  while (id >= 0) {
+    TimerNode &node = nodes_[id];
+    int next = node.next;
+    if (node.expires <= now_) {
+      node.prev = node.next = -1;
+      node.active = false;
+      count_--;
+      due_.push_back(std::move(node.cb));
+      node.cb = nullptr;
+    } else {
+      // 未到期(高层级联下来，或到期时间被延后过)，按剩余时间重新挂入
+      Link(id);
+    }
+    id = next;
+  }
+}
+
+void TimerWheel::ProcessTick() {
+  // 从高层到低层级联，级联下来的节点可能落在本次要处理的第 0 层槽位
+  for (int level = LEVEL_NUM - 1; level > 0; level--) {
+    uint64_t span = 1ULL << (SLOT_BITS * level);
+    if ((now_ & (span - 1)) == 0 && bitmap_[level] != 0) {
+      Cascade(level, static_cast<int>((now_ >> (SLOT_BITS * level)) & SLOT_MASK));
     }
-    node.cb_();
-    Pop();
+  }
+  int slot = static_cast<int>(now_ & SLOT_MASK);
+  if (heads_[0][slot] >= 0) {
+    Cascade(0, slot);
   }
 }
 
-void HeapTimer::Pop() {
-  assert(!heap_.empty());
-  Del(0);
+void TimerWheel::Tick() {
+  while (now_ <= cur_) {
+    // 低 k 层全空时，不是 64^k 整数倍的时刻都无事可做，直接跳过
+    int empty = 0;
+    while (empty < LEVEL_NUM && bitmap_[empty] == 0) {
+      empty++;
+    }
+    if (empty == LEVEL_NUM) {
+      now_ = cur_ + 1;
+      break;
+    }
+    if (empty > 0) {
+      uint64_t span = 1ULL << (SLOT_BITS * empty);
+      uint64_t next = (now_ + span - 1) & ~(span - 1);
+      if (next > now_) {
+        now_ = std::min(next, cur_ + 1);
+        continue;
+      }
+    }
+    ProcessTick();
+    now_++;
+  }
+  RunDue();
 }
 
-void HeapTimer::Clear() {
-  ref_.clear();
-  heap_.clear();
+void TimerWheel::RunDue() {
+  // 一次 Tick 中到期的回调批量执行
+  for (size_t i = 0; i < due_.size(); i++) {
+    due_[i]();
+  }
+  due_.clear();
 }
 
-auto HeapTimer::GetNextTick() -> int {
+auto TimerWheel::GetNextTick() -> int {
+  UpdateClock();
   Tick();
-  size_t res = -1;
-  if (!heap_.empty()) {
-    res = std::chrono::duration_cast<MS>(heap_.front().expires_ - Clock::now()).count();
-    if (res < 0) {
-      res = 0;
+  if (count_ == 0) {
+    return -1;
+  }
+  uint64_t next = UINT64_MAX;
+  for (int level = 0; level < LEVEL_NUM; level++) {
+    if (bitmap_[level] == 0) {
+      continue;
     }
+    int shift = SLOT_BITS * level;
+    uint64_t base = now_ >> shift;
+    int cur = static_cast<int>(base & SLOT_MASK);
+    // 以当前槽位为起点旋转位图，最低的置位即最近的非空槽位
+    uint64_t bits = cur == 0 ? bitmap_[level] : (bitmap_[level] >> cur) | (bitmap_[level] << (SLOT_NUM - cur));
+    if ((now_ & ((1ULL << shift) - 1)) != 0) {
+      // 当前槽位的级联时刻已过，下一次要再转一圈
+      bits &= ~1ULL;
+    }
+    uint64_t offset = bits == 0 ? SLOT_NUM : __builtin_ctzll(bits);
+    next = std::min(next, (base + offset) << shift);
   }
-  return res;
-}
\ No newline at end of file
+  uint64_t wait = next > cur_ ? next - cur_ : 0;
+  return static_cast<int>(std::min<uint64_t>(wait, INT_MAX));
+}
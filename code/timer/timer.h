@@ -1,70 +1,88 @@
-
 #ifndef TIMER_H
 #define TIMER_H
 
-#include <arpa/inet.h>
-
-#include <algorithm>
 #include <cassert>
-#include <chrono>
-#include <ctime>
+#include <cstdint>
 #include <functional>
-#include <queue>
-#include <unordered_map>
-#include <utility>
+#include <vector>
 
 using TimeoutCallBack = std::function<void()>;
-using Clock = std::chrono::high_resolution_clock;
-using MS = std::chrono::milliseconds;
-using TimeStamp = Clock::time_point;
 
-class TimerNode {
+// 分层时间轮，替代二叉堆定时器。
+// 以 1ms 为一格，共 LEVEL_NUM 层、每层 64 个槽位：第 0 层覆盖未来 64ms，
+// 第 L 层每格 64^L ms；高层槽位到期时把其中的节点重新分配到低层(级联)。
+// 定时器节点以 id(连接的 fd)为下标存放在数组中，通过节点内的链表指针挂在槽位上，
+// 添加、调整、删除都是 O(1)，不需要哈希查找。
+// 时间取自缓存的粗粒度单调时钟，只在 UpdateClock/GetNextTick 时读取一次。
+class TimerWheel {
  public:
-  TimerNode(int id, std::chrono::time_point<std::chrono::system_clock> expires,
-            TimeoutCallBack cb)
-      : id_(id), expires_(expires), cb_(std::move(cb)) {}
-  int id_;             // 用来标记定时器
-  TimeStamp expires_;  // 设置过期时间
-  TimeoutCallBack
-      cb_;  // 设置一个回调函数用来方便删除定时器时将对应的HTTP连接关闭
-  auto operator<(const TimerNode &t) -> bool { return expires_ < t.expires_; }
-};
+  TimerWheel();
 
-class HeapTimer {
- public:
-  HeapTimer() { heap_.reserve(64); }
+  ~TimerWheel() { Clear(); }
 
-  ~HeapTimer() { Clear(); }
-  // 调整指定id的定时器的到期时间。这可能需要根据新的到期时间向上或向下调整堆
+  // 调整指定id的定时器的到期时间。
+  // 只延后时仅记录新的到期时间，节点所在槽位到期时再按新时间重新挂入，不移动节点
   void Adjust(int id, int newExpires);
 
-  // 向堆中添加一个新的定时器节点，或者如果节点已存在，则更新其到期时间和回调函数。
-  // 新节点被添加到堆的末尾，然后使用HeapifyUp进行调整。如果节点已存在，则可能需要向上或向下调整。
+  // 添加定时器，如果id已存在，则更新其到期时间和回调函数
   void Add(int id, int timeOut, const TimeoutCallBack &cb);
 
-  // 执行并删除指定id的定时器节点。这涉及到查找节点、执行回调函数，然后删除节点。
+  // 执行并删除指定id的定时器
   void DoWork(int id);
-  // 清空整个定时器堆和id到位置的映射表ref_。
+  // 删除指定id的定时器，不执行回调
+  void Cancel(int id);
+  // 删除所有定时器
   void Clear();
-  // 检查并执行所有已到期的定时器任务。它循环检查堆顶的定时器，如果已到期，则执行其回调函数并从堆中删除。
+  // 推进时间轮，执行所有已到期的定时器。到期的回调先全部摘下，再依次执行
   void Tick();
-  // 删除堆顶的定时器节点，通常在定时器到期并执行回调后调用。
-  void Pop();
-  // 返回距离下一个定时任务到期还剩余的时间（毫秒）。如果堆为空，返回-1。
+  // 返回距离下一个定时任务到期还剩余的时间（毫秒）。没有定时器时返回-1。
+  // 延后过的定时器会在原到期时间附近多唤醒一次，返回值不会晚于实际到期时间
   auto GetNextTick() -> int;
 
- private:
-  void Del(size_t i);
+  // 重新读取时钟。事件循环在等待返回后调用，之后的 Add/Adjust 以此为当前时间
+  void UpdateClock();
 
-  void HeapifyUp(size_t i);
+ private:
+  static constexpr int LEVEL_NUM = 5;
+  static constexpr int SLOT_BITS = 6;
+  static constexpr int SLOT_NUM = 1 << SLOT_BITS;
+  static constexpr uint64_t SLOT_MASK = SLOT_NUM - 1;
+  // 最长可表示的定时(约 12 天)，更长的按此值处理
+  static constexpr uint64_t MAX_SPAN = (1ULL << (SLOT_BITS * LEVEL_NUM)) - 1;
 
-  auto HeapifyDown(size_t idx, size_t n) -> bool;
+  struct TimerNode {
+    int prev = -1;
+    int next = -1;
+    bool active = false;
+    uint8_t level = 0;
+    uint8_t slot = 0;
+    // 到期时刻(ms)
+    uint64_t expires = 0;
+    // 回调函数，用来在超时时关闭对应的HTTP连接
+    TimeoutCallBack cb;
+  };
 
-  void SwapNode(size_t i, size_t j);
+  auto Node(int id) -> TimerNode &;
+  // 按到期时间挂到对应层与槽位
+  void Link(int id);
+  void Unlink(int id);
+  // 处理第 0 层 now_ 所在的槽位，并在需要时先级联高层槽位
+  void ProcessTick();
+  // 把第 level 层 slot 槽位中的节点重新挂入，已到期的收集到 due_
+  void Cascade(int level, int slot);
+  void RunDue();
 
-  std::vector<TimerNode> heap_;
-  // 映射一个fd对应的定时器在heap_中的位置
-  std::unordered_map<int, size_t> ref_;
+  std::vector<TimerNode> nodes_;
+  int heads_[LEVEL_NUM][SLOT_NUM];
+  // 每层非空槽位的位图
+  uint64_t bitmap_[LEVEL_NUM] = {};
+  size_t count_ = 0;
+  // 缓存的当前时刻
+  uint64_t cur_;
+  // 下一个尚未处理的时刻，之前的槽位都已处理
+  uint64_t now_;
+  // 本次 Tick 到期、等待执行的回调
+  std::vector<TimeoutCallBack> due_;
 };
 
-#endif  // TIMER_H
\ No newline at end of file
+#endif  // TIMER_H
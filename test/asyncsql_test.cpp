@@ -0,0 +1,175 @@
+// AsyncSql 在内存中的 MySQL 替身(mysqlstub/)上执行登录与注册：单个注册与重复注册，登录的密码检查，
+// 一批注册中重复的用户名只有第一个成功，以及事务中途出错时整批不可用、连接被重新建立、插入的行被回滚。
+// 替身的非阻塞调用每次先返回未完成，查询经过 QUERY、NEXT、STORE 各阶段的重入。
+#include <mysql/errmsg.h>
+#include <mysql/mysqld_error.h>
+#include <poll.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "mysqlstub.h"
+#include "pool/asyncsql.h"
+#include "pool/sqlconnpool.h"
+
+namespace {
+constexpr int TIMEOUT_MS = 3000;
+
+int failures = 0;
+
+void Expect(bool ok, const char *what) {
+  if (!ok) {
+    failures++;
+    printf("  failed: %s\n", what);
+  }
+}
+
+// 一组同时提交的请求，在本线程中充当 Reactor 执行到全部回调结束
+class Runner {
+ public:
+  explicit Runner(AsyncSql *sql) : sql_(sql) {}
+
+  void Login(const std::string &user, const std::string &password) { Submit(user, password, true); }
+  void Register(const std::string &user, const std::string &password) { Submit(user, password, false); }
+
+  // 各请求的结果，按提交顺序；超时未结束的为 -1
+  auto Run() -> std::vector<int> {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TIMEOUT_MS);
+    while (pending_ > 0 && std::chrono::steady_clock::now() < deadline) {
+      pollfd pfd = {sql_->Fd(), POLLIN, 0};
+      poll(&pfd, 1, 10);
+      sql_->OnReady();
+    }
+    std::vector<int> results = std::move(results_);
+    results_.clear();
+    return results;
+  }
+
+ private:
+  void Submit(const std::string &user, const std::string &password, bool isLogin) {
+    size_t index = results_.size();
+    results_.push_back(-1);
+    pending_++;
+    sql_->Verify(user, password, isLogin, [this, index](AsyncSql::Result result) {
+      results_[index] = result;
+      pending_--;
+    });
+  }
+
+  AsyncSql *sql_;
+  std::vector<int> results_;
+  int pending_ = 0;
+};
+
+auto Password(const std::string &user) -> std::string {
+  std::string password;
+  return MysqlStub::FindUser(user, &password) ? password : "(none)";
+}
+
+// 等待后台线程重新建立出错的连接
+auto WaitReconnects(SqlConnPool *pool, uint64_t count) -> bool {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TIMEOUT_MS);
+  while (pool->GetStats().reconnects < count) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    poll(nullptr, 0, 1);
+  }
+  return true;
+}
+
+void LoginRegister(Runner &runner) {
+  printf("login and register\n");
+  runner.Register("alice", "pw'1");
+  Expect(runner.Run() == std::vector<int>{AsyncSql::RESULT_OK}, "register new user");
+  Expect(Password("alice") == "pw'1", "user inserted with the escaped password");
+  runner.Register("alice", "other");
+  Expect(runner.Run() == std::vector<int>{AsyncSql::RESULT_FAILED}, "register existing user fails");
+  Expect(Password("alice") == "pw'1", "existing password kept");
+
+  runner.Login("alice", "pw'1");
+  Expect(runner.Run() == std::vector<int>{AsyncSql::RESULT_OK}, "login with the right password");
+  runner.Login("alice", "pw");
+  Expect(runner.Run() == std::vector<int>{AsyncSql::RESULT_FAILED}, "login with a wrong password");
+  runner.Login("nobody", "");
+  Expect(runner.Run() == std::vector<int>{AsyncSql::RESULT_FAILED}, "login of an unknown user");
+}
+
+// 同时提交的注册在一个事务中执行；批中重复的用户名只有第一个成功，已存在的用户名失败
+void Batch(Runner &runner) {
+  printf("register batch\n");
+  int commits = MysqlStub::Commits();
+  runner.Register("bob", "b1");
+  runner.Register("carol", "c1");
+  runner.Register("bob", "b2");
+  runner.Register("alice", "a2");
+  runner.Register("dave", "d1");
+  std::vector<int> expected = {AsyncSql::RESULT_OK, AsyncSql::RESULT_OK, AsyncSql::RESULT_FAILED,
+                               AsyncSql::RESULT_FAILED, AsyncSql::RESULT_OK};
+  Expect(runner.Run() == expected, "batch results");
+  Expect(MysqlStub::Commits() == commits + 1, "one transaction for the batch");
+  Expect(Password("bob") == "b1", "first duplicate inserted");
+  Expect(Password("alice") == "pw'1", "existing user unchanged");
+  Expect(MysqlStub::UserCount() == 4, "three users inserted");
+}
+
+// 事务中途出错：整批不可用，连接归还后重新建立，未提交的行随旧连接回滚；之后的注册照常执行
+void BatchError(Runner &runner, SqlConnPool *pool) {
+  printf("error inside the transaction\n");
+  uint64_t reconnects = pool->GetStats().reconnects;
+  int rollbacks = MysqlStub::Rollbacks();
+  MysqlStub::FailNext("INSERT", ER_LOCK_DEADLOCK);
+  runner.Register("erin", "e1");
+  runner.Register("frank", "f1");
+  std::vector<int> expected = {AsyncSql::RESULT_UNAVAILABLE, AsyncSql::RESULT_UNAVAILABLE};
+  Expect(runner.Run() == expected, "batch unavailable");
+  Expect(WaitReconnects(pool, reconnects + 1), "connection reconnected");
+  Expect(MysqlStub::Rollbacks() == rollbacks + 1, "transaction rolled back");
+  Expect(Password("erin") == "(none)" && Password("frank") == "(none)", "nothing inserted");
+
+  runner.Register("erin", "e1");
+  runner.Register("frank", "f1");
+  expected = {AsyncSql::RESULT_OK, AsyncSql::RESULT_OK};
+  Expect(runner.Run() == expected, "retry succeeds");
+  Expect(Password("frank") == "f1", "retry inserted");
+}
+
+// 连接断开：单个请求不可用，连接重新建立后继续使用
+void ConnectionLost(Runner &runner, SqlConnPool *pool) {
+  printf("connection lost\n");
+  uint64_t reconnects = pool->GetStats().reconnects;
+  MysqlStub::FailNext("EXECUTE login_stmt", CR_SERVER_LOST);
+  runner.Login("alice", "pw'1");
+  Expect(runner.Run() == std::vector<int>{AsyncSql::RESULT_UNAVAILABLE}, "login unavailable");
+  Expect(WaitReconnects(pool, reconnects + 1), "connection reconnected");
+  runner.Login("alice", "pw'1");
+  Expect(runner.Run() == std::vector<int>{AsyncSql::RESULT_OK}, "login after reconnect");
+}
+}  // namespace
+
+auto main() -> int {
+  MysqlStub::Reset();
+  SqlConnPool *pool = SqlConnPool::Instance();
+  // 只有一个连接：连接出错后，之后的请求等到重新连接才能执行
+  pool->Init("127.0.0.1", 3306, "root", "root", "webserver", 1, 1, TIMEOUT_MS);
+  {
+    AsyncSql sql(pool, nullptr, 8, 1000, 64);
+    Runner runner(&sql);
+    LoginRegister(runner);
+    Batch(runner);
+    BatchError(runner, pool);
+    ConnectionLost(runner, pool);
+    Expect(sql.GetStats().queued == 0 && sql.GetStats().running == 0, "nothing left queued or running");
+  }
+  pool->ClosePool();
+
+  if (failures > 0) {
+    printf("FAILED: %d checks\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
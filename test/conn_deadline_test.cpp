@@ -0,0 +1,232 @@
+// 线程池模式下连接关闭与工作线程的配合：工作线程正在发送响应(Write 遇到 EAGAIN 后仍在处理中)时
+// 发送期限到期，Reactor 线程只能让句柄失效，由工作线程离开时完成关闭，对端仍收到完整的响应。
+// 另以随机的先后顺序检查每次关闭恰好由一方完成。步骤与 WebServer 中的 EnterConn/CloseConn/LeaveConn 相同。
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "http/httpconn.h"
+#include "server/connslab.h"
+#include "timer/timer.h"
+
+namespace {
+constexpr int WRITE_STALL_MS = 50;
+const char PATH[] = "css/bootstrap.min.css";
+
+int failures = 0;
+
+void Expect(bool ok, const char *what) {
+  if (!ok) {
+    failures++;
+    printf("  failed: %s\n", what);
+  }
+}
+
+auto ReadFile(const std::string &path) -> std::string {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// 对端：读到 EOF 为止
+auto ReadAll(int fd) -> std::string {
+  std::string data;
+  char buf[16384];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    data.append(buf, n);
+  }
+  return data;
+}
+
+void DeadlineDuringWrite(bool sendfile) {
+  printf("deadline during write (%s)\n", sendfile ? "sendfile" : "in memory");
+  HttpResponse::use_sendfile = sendfile;
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+    Expect(false, "socketpair");
+    return;
+  }
+  // 套接字缓冲区很小，对端不读时第一次 Write 就会遇到 EAGAIN
+  int size = 4096;
+  setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+
+  ConnSlab users(1024);
+  int fd = sv[0];
+  uint64_t handle = users.Acquire(fd);
+  HttpConn *conn = users.Get(handle);
+  conn->Init(fd, {});
+  std::string request = std::string("GET /") + PATH + " HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+  conn->AppendRead(request.data(), request.size());
+  Expect(conn->Process(), "request processed");
+  Expect(HttpConn::request_count == 1, "request counted in flight");
+  const size_t expected = conn->ToWriteBytes();
+
+  std::atomic<bool> mid_write{false};
+  std::atomic<bool> retired{false};
+  bool reactor_closed = true;
+  bool worker_closed = false;
+  bool sent_all = false;
+
+  // 工作线程：与 DealWrite 投递的任务相同，登记后发送，期限到期后仍在处理中，写完才离开
+  std::thread worker([&] {
+    HttpConn *client = users.Get(handle);
+    client->EnterWorker();
+    int err = 0;
+    client->Write(&err);
+    Expect(client->ToWriteBytes() > 0 && err == EAGAIN, "first write blocks");
+    mid_write = true;
+    while (!retired) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // 句柄已失效，但缓冲区与文件引用仍然有效
+    while (client->ToWriteBytes() > 0) {
+      if (client->Write(&err) < 0) {
+        if (err != EAGAIN) {
+          break;
+        }
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        poll(&pfd, 1, 100);
+      }
+    }
+    sent_all = client->ToWriteBytes() == 0;
+    worker_closed = client->LeaveWorker();
+    if (worker_closed) {
+      client->Close();
+    }
+  });
+
+  // Reactor 线程：与 OnDeadline 相同，期限到期后让句柄失效并请求关闭
+  TimerWheel timer;
+  std::function<void()> on_deadline = [&] {
+    HttpConn *client = users.Get(handle);
+    if (client == nullptr) {
+      return;
+    }
+    int left = client->CheckDeadline();
+    if (left >= 0) {
+      timer.Add(fd, left, on_deadline);
+      return;
+    }
+    Expect(client->GetPhase() == HttpConn::PHASE_WRITE, "deadline in write phase");
+    if (users.Retire(handle)) {
+      reactor_closed = client->RequestClose();
+      retired = true;
+    }
+  };
+  while (!mid_write) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto start = std::chrono::steady_clock::now();
+  timer.UpdateClock();
+  timer.Add(fd, 1, on_deadline);
+  while (!retired) {
+    int next = timer.GetNextTick();
+    std::this_thread::sleep_for(std::chrono::milliseconds(next > 0 ? next : 1));
+    timer.UpdateClock();
+  }
+  auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+  // 期限到期后对端才开始读取，读到工作线程关闭连接为止
+  std::string received = ReadAll(sv[1]);
+  worker.join();
+  close(sv[1]);
+
+  std::string body = ReadFile(std::string(RESOURCES_DIR) + PATH);
+  size_t header_end = received.find("\r\n\r\n");
+  printf("  deadline after %lldms, received %zu of %zu bytes\n", static_cast<long long>(waited.count()),
+         received.size(), expected);
+  Expect(waited.count() >= WRITE_STALL_MS - 1, "deadline not early");
+  Expect(!reactor_closed, "reactor thread did not close while the worker was inside");
+  Expect(worker_closed, "worker finished the close when leaving");
+  Expect(sent_all, "worker sent the whole response after the deadline");
+  Expect(received.size() == expected, "peer received the whole response");
+  Expect(header_end != std::string::npos && received.compare(header_end + 4, std::string::npos, body) == 0,
+         "body matches the file");
+  Expect(users.Get(handle) == nullptr, "handle retired");
+  Expect(HttpConn::user_count == 0, "connection counted as closed");
+  Expect(HttpConn::request_count == 0, "request no longer in flight");
+}
+
+// 工作线程的登记、离开与关闭请求以随机的先后顺序发生，每一轮恰好有一方负责关闭
+void CloseHandshake() {
+  constexpr int ROUNDS = 20000;
+  printf("close handshake, %d rounds\n", ROUNDS);
+  auto conn = std::make_unique<HttpConn>();
+  std::atomic<int> round{0};
+  std::atomic<int> done{0};
+  std::atomic<int> closers{0};
+  int bad_rounds = 0;
+  std::thread worker([&] {
+    std::mt19937 rng(1);
+    for (int i = 1; i <= ROUNDS; i++) {
+      while (round.load() < i) {
+        std::this_thread::yield();
+      }
+      for (int spin = rng() % 64; spin > 0; spin--) {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+      }
+      conn->EnterWorker();
+      for (int spin = rng() % 64; spin > 0; spin--) {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+      }
+      if (conn->LeaveWorker()) {
+        closers++;
+      }
+      done++;
+    }
+  });
+  std::mt19937 rng(2);
+  for (int i = 1; i <= ROUNDS; i++) {
+    closers = 0;
+    round = i;
+    for (int spin = rng() % 128; spin > 0; spin--) {
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+    if (conn->RequestClose()) {
+      closers++;
+    }
+    while (done.load() < i) {
+      std::this_thread::yield();
+    }
+    if (closers != 1) {
+      bad_rounds++;
+    }
+  }
+  worker.join();
+  Expect(bad_rounds == 0, "exactly one side closes");
+}
+}  // namespace
+
+auto main() -> int {
+  HttpConn::src_dir = RESOURCES_DIR;
+  HttpConn::is_et = true;
+  HttpConn::deadlines = {10000, 10000, 10000, 10000, WRITE_STALL_MS, 0, 10000};
+  // 对端关闭后写入返回 EPIPE 而不是终止进程
+  signal(SIGPIPE, SIG_IGN);
+
+  DeadlineDuringWrite(false);
+  DeadlineDuringWrite(true);
+  CloseHandshake();
+  if (failures > 0) {
+    printf("FAILED: %d checks\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+// ConstTable 与 unordered_map/unordered_set 的查找耗时(纳秒/次)：
+// 后缀名到 MIME 类型、状态码到状态行、默认页面三种表，查找的键中命中与未命中各约一半。
+// 容器的键与替换前一样是 std::string，查找的键预先构造好，不计入构造 std::string 的开销。
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "http/consttable.h"
+
+namespace {
+constexpr int ROUNDS = 200;
+
+constexpr auto SUFFIX_TYPE = MakeConstTable<std::string_view, std::string_view>({
+    {".html", "text/html"},
+    {".htm", "text/html"},
+    {".xml", "text/xml"},
+    {".xhtml", "application/xhtml+xml"},
+    {".txt", "text/plain"},
+    {".md", "text/markdown"},
+    {".csv", "text/csv"},
+    {".css", "text/css"},
+    {".js", "text/javascript"},
+    {".mjs", "text/javascript"},
+    {".json", "application/json"},
+    {".map", "application/json"},
+    {".wasm", "application/wasm"},
+    {".rtf", "application/rtf"},
+    {".pdf", "application/pdf"},
+    {".word", "application/msword"},
+    {".doc", "application/msword"},
+    {".png", "image/png"},
+    {".gif", "image/gif"},
+    {".jpg", "image/jpeg"},
+    {".jpeg", "image/jpeg"},
+    {".bmp", "image/bmp"},
+    {".webp", "image/webp"},
+    {".avif", "image/avif"},
+    {".svg", "image/svg+xml"},
+    {".ico", "image/x-icon"},
+    {".woff", "font/woff"},
+    {".woff2", "font/woff2"},
+    {".ttf", "font/ttf"},
+    {".otf", "font/otf"},
+    {".eot", "application/vnd.ms-fontobject"},
+    {".au", "audio/basic"},
+    {".mp3", "audio/mpeg"},
+    {".wav", "audio/wav"},
+    {".oga", "audio/ogg"},
+    {".mpeg", "video/mpeg"},
+    {".mpg", "video/mpeg"},
+    {".avi", "video/x-msvideo"},
+    {".mp4", "video/mp4"},
+    {".webm", "video/webm"},
+    {".ogv", "video/ogg"},
+    {".gz", "application/x-gzip"},
+    {".tar", "application/x-tar"},
+    {".zip", "application/zip"},
+});
+static_assert(SUFFIX_TYPE.Valid(), "SUFFIX_TYPE has no perfect hash");
+
+constexpr auto CODE_STATUS = MakeConstTable<int, std::string_view>({
+    {200, "HTTP/1.1 200 OK\r\n"},
+    {206, "HTTP/1.1 206 Partial Content\r\n"},
+    {304, "HTTP/1.1 304 Not Modified\r\n"},
+    {400, "HTTP/1.1 400 Bad Request\r\n"},
+    {403, "HTTP/1.1 403 Forbidden\r\n"},
+    {404, "HTTP/1.1 404 Not Found\r\n"},
+    {413, "HTTP/1.1 413 Payload Too Large\r\n"},
+    {414, "HTTP/1.1 414 URI Too Long\r\n"},
+    {416, "HTTP/1.1 416 Range Not Satisfiable\r\n"},
+    {431, "HTTP/1.1 431 Request Header Fields Too Large\r\n"},
+    {503, "HTTP/1.1 503 Service Unavailable\r\n"},
+});
+static_assert(CODE_STATUS.Valid(), "CODE_STATUS has no perfect hash");
+
+constexpr auto DEFAULT_HTML = MakeConstTable<std::string_view, bool>({
+    {"/", true},
+    {"/index", true},
+    {"/register", true},
+    {"/login", true},
+    {"/welcome", true},
+    {"/video", true},
+    {"/picture", true},
+});
+static_assert(DEFAULT_HTML.Valid(), "DEFAULT_HTML has no perfect hash");
+
+// 每次查找的平均耗时，预热后取三次中最好的结果
+template <typename Key, typename F>
+auto Measure(const std::vector<Key> &keys, F &&f) -> double {
+  double best = 1e30;
+  for (int round = 0; round < 4; round++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+      for (const Key &key : keys) {
+        f(key);
+      }
+    }
+    std::chrono::duration<double, std::nano> used = std::chrono::steady_clock::now() - start;
+    if (round > 0 && used.count() < best) {
+      best = used.count();
+    }
+  }
+  return best / ROUNDS / keys.size();
+}
+
+void Report(const char *name, const char *container, double old, double table) {
+  printf("%-16s %-15s %8.2f %12.2f %8.2fx\n", name, container, old, table, old / table);
+}
+}  // namespace
+
+auto main() -> int {
+  volatile size_t sink = 0;
+  printf("ns/lookup (lower is better)\n");
+  printf("%-16s %-15s %8s %12s %9s\n", "table", "container", "old", "ConstTable", "speedup");
+
+  {
+    std::unordered_map<std::string, std::string> map;
+    for (const std::string_view suffix :
+         {".html", ".htm", ".xml", ".xhtml", ".txt", ".md", ".csv", ".css", ".js", ".mjs", ".json", ".map", ".wasm",
+          ".rtf", ".pdf", ".word", ".doc", ".png", ".gif", ".jpg", ".jpeg", ".bmp", ".webp", ".avif", ".svg", ".ico",
+          ".woff", ".woff2", ".ttf", ".otf", ".eot", ".au", ".mp3", ".wav", ".oga", ".mpeg", ".mpg", ".avi", ".mp4",
+          ".webm", ".ogv", ".gz", ".tar", ".zip"}) {
+      map.emplace(std::string(suffix), std::string(*SUFFIX_TYPE.Find(suffix)));
+    }
+    std::vector<std::string> keys = {".html", ".css", ".js", ".png", ".woff2", ".jpg", ".ico", ".svg",
+                                     ".HTML", ".php", ".bak", ".htmll", ".c", ".tar.bz2", ".exe", ".asp"};
+    double old = Measure(keys, [&](const std::string &key) { sink = sink + map.count(key); });
+    double table = Measure(keys, [&](const std::string &key) { sink = sink + (SUFFIX_TYPE.Find(key) != nullptr); });
+    Report("suffix -> MIME", "unordered_map", old, table);
+  }
+
+  {
+    std::unordered_map<int, std::string> map;
+    for (int code : {200, 206, 304, 400, 403, 404, 413, 414, 416, 431, 503}) {
+      map.emplace(code, std::string(*CODE_STATUS.Find(code)));
+    }
+    std::vector<int> keys = {200, 200, 304, 404, 206, 400, 100, 201, 302, 500, 405, 401};
+    double old = Measure(keys, [&](int key) { sink = sink + map.count(key); });
+    double table = Measure(keys, [&](int key) { sink = sink + (CODE_STATUS.Find(key) != nullptr); });
+    Report("status line", "unordered_map", old, table);
+  }
+
+  {
+    std::unordered_set<std::string> set = {"/", "/index", "/register", "/login", "/welcome", "/video", "/picture"};
+    std::vector<std::string> keys = {"/",           "/index",        "/login",
+                                     "/welcome",    "/index.html",   "/js/custom.js",
+                                     "/css/bootstrap.min.css", "/images/profile-image.jpg"};
+    double old = Measure(keys, [&](const std::string &key) { sink = sink + set.count(key); });
+    double table = Measure(keys, [&](const std::string &key) { sink = sink + (DEFAULT_HTML.Find(key) != nullptr); });
+    Report("default page", "unordered_set", old, table);
+  }
+  return 0;
+}
@@ -0,0 +1,198 @@
+// ConstTable 的正确性测试：编译期与运行时构造的各种大小(1~255)的表，
+// 随机生成的字符串键与整数键都要能查回自己的值，不在表中的键(包括只差一个字节的键)返回 nullptr。
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "http/consttable.h"
+#include "http/httpresponse.h"
+
+namespace {
+// 编译期：小表与 255 项的表，Valid() 已包含所有键查回自己的检查
+constexpr auto SMALL = MakeConstTable<std::string_view, int>({{"a", 1}, {"ab", 2}, {"ba", 3}, {"", 4}});
+static_assert(SMALL.Valid() && *SMALL.Find("ab") == 2 && *SMALL.Find("") == 4, "small table");
+static_assert(SMALL.Find("b") == nullptr && SMALL.Find("abc") == nullptr && SMALL.Find("aa") == nullptr,
+              "small table misses");
+
+constexpr auto SINGLE = MakeConstTable<int, int>({{-7, 1}});
+static_assert(SINGLE.Valid() && *SINGLE.Find(-7) == 1 && SINGLE.Find(7) == nullptr && SINGLE.Find(0) == nullptr,
+              "single entry table");
+
+constexpr size_t MAX_ENTRIES = 255;
+
+// 键 "k000"~"k254" 的存储，编译期生成的表只保存视图
+struct Keys {
+  char text[MAX_ENTRIES * 4] = {};
+};
+constexpr auto MakeKeys() -> Keys {
+  Keys keys;
+  for (size_t i = 0; i < MAX_ENTRIES; i++) {
+    keys.text[i * 4] = 'k';
+    keys.text[i * 4 + 1] = static_cast<char>('0' + i / 100);
+    keys.text[i * 4 + 2] = static_cast<char>('0' + i / 10 % 10);
+    keys.text[i * 4 + 3] = static_cast<char>('0' + i % 10);
+  }
+  return keys;
+}
+constexpr Keys KEYS = MakeKeys();
+
+template <typename K>
+struct Entries {
+  ConstEntry<K, int> e[MAX_ENTRIES] = {};
+};
+constexpr auto MakeStringEntries() -> Entries<std::string_view> {
+  Entries<std::string_view> entries;
+  for (size_t i = 0; i < MAX_ENTRIES; i++) {
+    entries.e[i] = {std::string_view(KEYS.text + i * 4, 4), static_cast<int>(i)};
+  }
+  return entries;
+}
+constexpr auto MakeIntEntries() -> Entries<int> {
+  Entries<int> entries;
+  for (size_t i = 0; i < MAX_ENTRIES; i++) {
+    // 步长为 2 的幂的键，低位完全相同
+    entries.e[i] = {static_cast<int>(i) * 1024 - 100000, static_cast<int>(i)};
+  }
+  return entries;
+}
+constexpr Entries<std::string_view> STRING_ENTRIES = MakeStringEntries();
+constexpr Entries<int> INT_ENTRIES = MakeIntEntries();
+constexpr auto FULL_STRING = MakeConstTable(STRING_ENTRIES.e);
+constexpr auto FULL_INT = MakeConstTable(INT_ENTRIES.e);
+static_assert(FULL_STRING.Valid() && FULL_STRING.Size() == MAX_ENTRIES, "255 string keys");
+static_assert(FULL_INT.Valid() && FULL_INT.Size() == MAX_ENTRIES, "255 int keys");
+static_assert(*FULL_STRING.Find("k254") == 254 && FULL_STRING.Find("k255") == nullptr, "255 string keys lookup");
+static_assert(*FULL_INT.Find(-100000) == 0 && FULL_INT.Find(-99999) == nullptr, "255 int keys lookup");
+
+int failures = 0;
+long lookups = 0;
+
+void Check(bool ok, const char *what, size_t n, const std::string &key) {
+  lookups++;
+  if (!ok && failures++ < 20) {
+    fprintf(stderr, "N=%zu %s: key \"%s\"\n", n, what, key.c_str());
+  }
+}
+
+// 短键、小字母表时键之间很相似，长键、大字母表时哈希分布更随机
+auto RandomKey(std::mt19937 &rng, const std::string &alphabet, size_t maxLen) -> std::string {
+  std::string key(rng() % (maxLen + 1), ' ');
+  for (char &ch : key) {
+    ch = alphabet[rng() % alphabet.size()];
+  }
+  return key;
+}
+
+template <size_t N>
+void StringTables(std::mt19937 &rng, int rounds) {
+  static const std::string ALPHABETS[] = {"ab", ".abcdefgh", "!#$%&'*+-.^_`|~0123456789ABCXYZabcxyz\x80\xff"};
+  for (int round = 0; round < rounds; round++) {
+    const std::string &alphabet = ALPHABETS[round % 3];
+    size_t maxLen = round % 3 == 0 ? 10 : 3 + rng() % 20;
+    std::set<std::string> keys;
+    while (keys.size() < N) {
+      keys.insert(RandomKey(rng, alphabet, maxLen));
+    }
+    std::vector<std::string> storage(keys.begin(), keys.end());
+    ConstEntry<std::string_view, int> entries[N];
+    for (size_t i = 0; i < N; i++) {
+      entries[i] = {storage[i], static_cast<int>(i)};
+    }
+    ConstTable<std::string_view, int, N> table(entries);
+    Check(table.Valid(), "not valid", N, storage[0]);
+    for (size_t i = 0; i < N; i++) {
+      const int *value = table.Find(storage[i]);
+      Check(value != nullptr && *value == static_cast<int>(i), "round trip", N, storage[i]);
+      // 只差一个字节、少一个字节、多一个字节的键
+      std::string near = storage[i] + "a";
+      Check(keys.count(near) > 0 || table.Find(near) == nullptr, "miss", N, near);
+      if (!storage[i].empty()) {
+        near = storage[i].substr(0, storage[i].size() - 1);
+        Check(keys.count(near) > 0 || table.Find(near) == nullptr, "miss", N, near);
+        near = storage[i];
+        near[rng() % near.size()] ^= 1 << (rng() % 8);
+        Check(keys.count(near) > 0 || table.Find(near) == nullptr, "miss", N, near);
+      }
+    }
+    for (int i = 0; i < 200; i++) {
+      std::string key = RandomKey(rng, alphabet, maxLen + 2);
+      Check(keys.count(key) > 0 || table.Find(key) == nullptr, "miss", N, key);
+    }
+  }
+}
+
+template <size_t N>
+void IntTables(std::mt19937 &rng, int rounds) {
+  for (int round = 0; round < rounds; round++) {
+    // 交替使用小范围的键(如状态码)与任意 int
+    int range = round % 2 == 0 ? 1000 : 0;
+    std::set<int> keys;
+    while (keys.size() < N) {
+      keys.insert(range > 0 ? static_cast<int>(rng() % range) : static_cast<int>(rng()));
+    }
+    ConstEntry<int, int> entries[N];
+    size_t i = 0;
+    for (int key : keys) {
+      entries[i] = {key, static_cast<int>(i)};
+      i++;
+    }
+    ConstTable<int, int, N> table(entries);
+    Check(table.Valid(), "not valid", N, std::to_string(entries[0].key));
+    for (i = 0; i < N; i++) {
+      const int *value = table.Find(entries[i].key);
+      Check(value != nullptr && *value == static_cast<int>(i), "round trip", N, std::to_string(entries[i].key));
+      int near = entries[i].key + 1;
+      Check(keys.count(near) > 0 || table.Find(near) == nullptr, "miss", N, std::to_string(near));
+    }
+    for (int j = 0; j < 200; j++) {
+      int key = range > 0 ? static_cast<int>(rng() % (range * 2)) - range / 2 : static_cast<int>(rng());
+      Check(keys.count(key) > 0 || table.Find(key) == nullptr, "miss", N, std::to_string(key));
+    }
+  }
+}
+
+template <size_t... Ns>
+void AllSizes(std::mt19937 &rng, int rounds) {
+  (StringTables<Ns>(rng, rounds), ...);
+  (IntTables<Ns>(rng, rounds), ...);
+}
+
+// 有重复的键时构造失败
+void Duplicates() {
+  ConstEntry<std::string_view, int> strings[] = {{"a", 1}, {"b", 2}, {"a", 3}};
+  Check(!ConstTable<std::string_view, int, 3>(strings).Valid(), "duplicate accepted", 3, "a");
+  ConstEntry<int, int> ints[] = {{5, 1}, {5, 2}};
+  Check(!ConstTable<int, int, 2>(ints).Valid(), "duplicate accepted", 2, "5");
+}
+
+// 服务器中的表通过公开接口检查
+void FileTypes() {
+  const char *const CASES[][2] = {
+      {"/index.html", "text/html"},         {"/a.b/c.woff2", "font/woff2"},   {"/x.woff", "font/woff"},
+      {"/pkg.tar.gz", "application/x-gzip"}, {"/js/app.mjs", "text/javascript"}, {"/img.jpeg", "image/jpeg"},
+      {"/noext", "text/plain"},              {"/a.HTML", "text/plain"},       {"/a.unknownsuffix", "text/plain"},
+      {"/trailing.", "text/plain"},
+  };
+  for (const auto &c : CASES) {
+    Check(HttpResponse::GetFileType(c[0]) == c[1], "GetFileType", 0, c[0]);
+  }
+}
+}  // namespace
+
+auto main() -> int {
+  std::mt19937 rng(20240601);
+  AllSizes<1, 2, 3, 5, 8, 16, 31, 32, 44, 63, 64, 65, 100, 127, 128, 129, 200, 254, 255>(rng, 60);
+  Duplicates();
+  FileTypes();
+  printf("%ld lookups\n", lookups);
+  if (failures > 0) {
+    printf("FAILED: %d\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+// FileCache 的缓存与淘汰：大量随机路径的 404 请求不会淘汰已缓存的文件；
+// 不存在的记录过期后能发现新建的文件；sendfile 的大文件不按文件大小计入预算；超出预算时按 LRU 淘汰真实文件。
+// 同一文件的不同路径写法经 HttpRequest 规范化后是同一个缓存键，被淘汰的缓存项不再占用 inotify 监视。
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "buffer/buffer.h"
+#include "http/filecache.h"
+#include "http/httprequest.h"
+#include "http/httpresponse.h"
+
+namespace {
+// 每个分片 16KB
+constexpr size_t SMALL_BUDGET = 16 * 16 * 1024;
+
+int failures = 0;
+
+void Expect(bool ok, const char *what) {
+  if (!ok) {
+    failures++;
+    printf("  failed: %s\n", what);
+  }
+}
+
+void WriteFile(const std::string &path, size_t size) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << std::string(size, 'x');
+}
+
+// 本进程添加的 inotify 监视数
+auto CountWatches() -> int {
+  int watches = 0;
+  DIR *proc = opendir("/proc/self/fdinfo");
+  if (proc == nullptr) {
+    return -1;
+  }
+  while (struct dirent *ent = readdir(proc)) {
+    std::ifstream info(std::string("/proc/self/fdinfo/") + ent->d_name);
+    std::string line;
+    while (std::getline(info, line)) {
+      if (line.compare(0, 11, "inotify wd:") == 0) {
+        watches++;
+      }
+    }
+  }
+  closedir(proc);
+  return watches;
+}
+
+auto ParsedPath(const std::string &target) -> std::string {
+  Buffer buff;
+  buff.Append("GET " + target + " HTTP/1.1\r\n\r\n");
+  HttpRequest request;
+  if (request.Parse(buff) != HttpRequest::GET_REQUEST) {
+    return "(bad request)";
+  }
+  return request.Path();
+}
+
+// 请求路径的规范化，以及不同写法只对应一个缓存项和一个监视
+void PathSpellings(const std::string &dir) {
+  printf("path spellings\n");
+  const char *const CASES[][2] = {
+      {"/hot.html", "/hot.html"},          {"//hot.html", "/hot.html"},
+      {"/./hot.html", "/hot.html"},        {"/css/../hot.html", "/hot.html"},
+      {"/a/./b//../../hot.html", "/hot.html"}, {"/../../etc/passwd", "/etc/passwd"},
+      {"/a/b/..", "/a/"},                  {"/a/b/.", "/a/b/"},
+      {"//", "/index.html"},               {"/./index", "/index.html"},
+      {"/x/.?q=/../y", "/x/?q=/../y"},     {"/.well-known/a..b", "/.well-known/a..b"},
+  };
+  for (const auto &c : CASES) {
+    std::string path = ParsedPath(c[0]);
+    if (path != c[1]) {
+      printf("  %s -> %s, expected %s\n", c[0], path.c_str(), c[1]);
+      Expect(false, "normalized path");
+    }
+  }
+
+  FileCache *cache = FileCache::Instance();
+  FileCache::EntryPtr hot = cache->Get(dir + ParsedPath("/hot.html"));
+  int watches = CountWatches();
+  std::string spelling = "/hot.html";
+  for (int i = 0; i < 1000; i++) {
+    spelling.insert(0, i % 2 == 0 ? "/." : "/x/..");
+    Expect(cache->Get(dir + ParsedPath(spelling)) == hot, "spelling maps to the cached entry");
+  }
+  Expect(CountWatches() == watches, "no new watches for other spellings");
+}
+
+// 预算很小，每个分片只放得下几个文件；随后的随机 404 若占用预算，会把文件挤出 LRU
+void MissingBurst(const std::string &dir) {
+  printf("burst of random 404s\n");
+  FileCache *cache = FileCache::Instance();
+  std::string hot = dir + "/hot.html";
+  WriteFile(hot, 4096);
+  FileCache::EntryPtr first = cache->Get(hot);
+  Expect(first != nullptr, "hot file loaded");
+
+  std::mt19937 rng(7);
+  int visible = 0;
+  for (int i = 0; i < 100000; i++) {
+    std::string path = dir + "/nothing-" + std::to_string(rng()) + ".html?cachebust=" + std::to_string(i);
+    if (cache->Get(path) != nullptr) {
+      visible++;
+    }
+  }
+  Expect(visible == 0, "missing files return nullptr");
+  Expect(cache->Get(hot) == first, "hot file still cached after the burst");
+}
+
+// 不存在的记录在 TTL 内有效，过期后重新检查磁盘
+void MissingExpires(const std::string &dir) {
+  printf("missing entry expires\n");
+  FileCache *cache = FileCache::Instance();
+  std::string path = dir + "/late.html";
+  Expect(cache->Get(path) == nullptr, "not created yet");
+  WriteFile(path, 100);
+  Expect(cache->Get(path) == nullptr, "missing entry cached within the TTL");
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  FileCache::EntryPtr entry = cache->Get(path);
+  Expect(entry != nullptr && entry->st.st_size == 100, "new file found after the TTL");
+}
+
+// sendfile 的大文件只计入缓存项本身的内存，比分片预算大的文件也能缓存
+void LargeSendfile(const std::string &dir) {
+  printf("large sendfile file\n");
+  HttpResponse::use_sendfile = true;
+  FileCache *cache = FileCache::Instance();
+  std::string path = dir + "/large.bin";
+  WriteFile(path, 1024 * 1024);
+  FileCache::EntryPtr entry = cache->Get(path);
+  Expect(entry != nullptr && entry->fd >= 0, "large file opened for sendfile");
+  Expect(entry != nullptr && entry->charge < 4096, "file size not charged");
+  Expect(cache->Get(path) == entry, "large file cached");
+
+  // 打开的 fd 数有上限，超出时淘汰最久未使用的大文件。预算足够大，只受 fd 数限制
+  entry.reset();
+  cache->SetBudget(64 * 1024 * 1024);
+  for (int i = 0; i < 1000; i++) {
+    std::string big = dir + "/big-" + std::to_string(i) + ".bin";
+    WriteFile(big, HttpResponse::INLINE_FILE_MAX + 1);
+    cache->Get(big);
+  }
+  int fds = 0;
+  if (DIR *proc = opendir("/proc/self/fd")) {
+    while (readdir(proc) != nullptr) {
+      fds++;
+    }
+    closedir(proc);
+  }
+  int watches = CountWatches();
+  printf("  %d fds open, %d watches after loading 1000 large files\n", fds, watches);
+  Expect(fds < 600, "open fds bounded");
+  Expect(watches >= 0 && watches < 600, "evicted entries release their watches");
+  cache->SetBudget(SMALL_BUDGET);
+}
+
+// 真实文件超出预算时淘汰最久未使用的：hot.html 所在分片被新文件填满后，它不再被缓存
+void LruEviction(const std::string &dir) {
+  printf("lru eviction\n");
+  FileCache *cache = FileCache::Instance();
+  FileCache::EntryPtr hot = cache->Get(dir + "/hot.html");
+  for (int i = 0; i < 256; i++) {
+    std::string path = dir + "/file-" + std::to_string(i) + ".html";
+    WriteFile(path, 4096);
+    FileCache::EntryPtr entry = cache->Get(path);
+    Expect(entry != nullptr && cache->Get(path) == entry, "just loaded file cached");
+  }
+  Expect(cache->Get(dir + "/hot.html") != hot, "least recently used file evicted");
+}
+}  // namespace
+
+auto main() -> int {
+  char tmpl[] = "/tmp/filecache_test.XXXXXX";
+  if (mkdtemp(tmpl) == nullptr) {
+    printf("FAILED: mkdtemp\n");
+    return EXIT_FAILURE;
+  }
+  std::string dir = tmpl;
+  FileCache::Instance()->SetBudget(SMALL_BUDGET);
+
+  MissingBurst(dir);
+  MissingExpires(dir);
+  PathSpellings(dir);
+  LargeSendfile(dir);
+  LruEviction(dir);
+
+  std::string cmd = "rm -rf " + dir;
+  if (system(cmd.c_str()) != 0) {
+    printf("  cannot remove %s\n", dir.c_str());
+  }
+  if (failures > 0) {
+    printf("FAILED: %d checks\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
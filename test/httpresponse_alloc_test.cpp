@@ -0,0 +1,145 @@
+// HttpResponse::MakeResponse 的堆分配计数测试：替换全局 operator new，
+// 预热(文件缓存、块缓存、后台压缩)之后，各类响应每次生成都不应再分配内存。
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http/httpresponse.h"
+
+namespace {
+// 只统计主线程，后台压缩线程与日志线程的分配不计入
+thread_local bool counting = false;
+thread_local long allocs = 0;
+
+auto Allocate(size_t size) -> void * {
+  if (counting) {
+    allocs++;
+  }
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+}  // namespace
+
+auto operator new(size_t size) -> void * { return Allocate(size); }
+auto operator new[](size_t size) -> void * { return Allocate(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace {
+constexpr int ROUNDS = 1000;
+
+struct Case {
+  const char *name;
+  std::string path;
+  int code;
+  HttpResponse::Conditions cond;
+  // 期望的状态行
+  const char *status;
+};
+
+HttpResponse response;
+Buffer buff;
+
+// 生成一个响应，这是被计数的部分
+void Make(const Case &c) {
+  buff.RetrieveAll();
+  response.Init(RESOURCES_DIR, c.path, true, c.code);
+  response.SetConditions(c.cond);
+  response.MakeResponse(buff);
+}
+
+// 生成一个响应，返回状态行与响应头
+auto Run(const Case &c) -> std::string {
+  Make(c);
+  std::string head(buff.Peek(), buff.ReadableBytes());
+  return head.substr(0, head.find("\r\n\r\n") + 4);
+}
+
+auto HeaderValue(const std::string &head, const std::string &name) -> std::string {
+  size_t pos = head.find(name + ": ");
+  if (pos == std::string::npos) {
+    return "";
+  }
+  pos += name.size() + 2;
+  return head.substr(pos, head.find("\r\n", pos) - pos);
+}
+}  // namespace
+
+auto main() -> int {
+  // 小文件读入缓存随响应头一起写出，大文件通过 sendfile 发送
+  const std::string small = "/login.html";
+  const std::string large = "/css/bootstrap.min.css";
+  std::string small_etag = HeaderValue(Run({"", small, 200, {}, ""}), "ETag");
+  std::string large_modified = HeaderValue(Run({"", large, 200, {}, ""}), "Last-Modified");
+  std::vector<Case> cases = {
+      {"200 inline", small, 200, {}, "HTTP/1.1 200 OK"},
+      {"200 sendfile", large, 200, {}, "HTTP/1.1 200 OK"},
+      {"304 If-None-Match", small, 200, {small_etag, "", "", "", ""}, "HTTP/1.1 304 Not Modified"},
+      {"304 If-Modified-Since", large, 200, {"", large_modified, "", "", ""}, "HTTP/1.1 304 Not Modified"},
+      {"404", "/nothere.html", 200, {}, "HTTP/1.1 404 Not Found"},
+      {"400", small, 400, {}, "HTTP/1.1 400 Bad Request"},
+      {"206 single range", large, 200, {"", "", "bytes=0-99", "", ""}, "HTTP/1.1 206 Partial Content"},
+      {"206 multiple ranges", large, 200, {"", "", "bytes=0-9,50-99", "", ""}, "HTTP/1.1 206 Partial Content"},
+      {"416", large, 200, {"", "", "bytes=99999999-", "", ""}, "HTTP/1.1 416 Range Not Satisfiable"},
+      {"200 gzip", large, 200, {"", "", "", "", "gzip"}, "HTTP/1.1 200 OK"},
+  };
+
+  int failures = 0;
+  // 确认替换的 operator new 确实在计数
+  counting = true;
+  delete new int(0);
+  counting = false;
+  if (allocs != 1) {
+    printf("operator new is not counted\n");
+    return EXIT_FAILURE;
+  }
+
+  // 预热：第一次请求 gzip 时提交后台压缩，等压缩结果就绪
+  for (const Case &c : cases) {
+    Run(c);
+  }
+  for (int i = 0; i < 200 && HeaderValue(Run(cases.back()), "Content-Encoding") != "gzip"; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if (HeaderValue(Run(cases.back()), "Content-Encoding") != "gzip") {
+    printf("gzip variant not ready\n");
+    failures++;
+  }
+  Make(cases[1]);
+  if (response.FileFd() < 0) {
+    printf("%s is not sent with sendfile\n", large.c_str());
+    failures++;
+  }
+
+  for (const Case &c : cases) {
+    std::string head = Run(c);
+    bool status_ok = head.compare(0, strlen(c.status), c.status) == 0;
+    counting = true;
+    allocs = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+      Make(c);
+    }
+    counting = false;
+    printf("%-24s %-32.*s allocs/%d: %ld\n", c.name, static_cast<int>(head.find("\r\n")), head.c_str(), ROUNDS,
+           allocs);
+    if (!status_ok || allocs != 0) {
+      failures++;
+    }
+  }
+  if (failures > 0) {
+    printf("FAILED: %d cases\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+// HttpScan 各实现与标量实现的一致性测试：
+// 随机生成的请求头部块，以及目标字节落在 16/32 字节边界前后的构造数据，
+// 对当前 CPU 支持的每一组实现逐个比较 FindLf、FindDelim、SkipToken 的结果。
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "http/httpscan.h"
+
+namespace {
+int failures = 0;
+long comparisons = 0;
+
+using ScanFunc = HttpScan::ScanFunc;
+
+struct Func {
+  const char *name;
+  ScanFunc HttpScan::Kernels::*member;
+  ScanFunc scalar;
+};
+
+const Func FUNCS[] = {
+    {"FindLf", &HttpScan::Kernels::find_lf, HttpScan::FindLfScalar},
+    {"FindDelim", &HttpScan::Kernels::find_delim, HttpScan::FindDelimScalar},
+    {"SkipToken", &HttpScan::Kernels::skip_token, HttpScan::SkipTokenScalar},
+};
+
+void Compare(const HttpScan::Kernels &kernels, const Func &func, const char *begin, const char *end) {
+  comparisons++;
+  const char *got = (kernels.*func.member)(begin, end);
+  const char *want = func.scalar(begin, end);
+  if (got != want) {
+    if (failures++ < 20) {
+      fprintf(stderr, "%s %s: len %td, got %td, want %td\n", kernels.isa, func.name, end - begin, got - begin,
+              want - begin);
+    }
+  }
+}
+
+// 从 0~maxStart 的每个起点扫描到块尾，以及到随机选取的若干终点
+void CompareBlock(const HttpScan::Kernels &kernels, const std::string &data, size_t maxStart, std::mt19937 &rng) {
+  const char *base = data.data();
+  for (const Func &func : FUNCS) {
+    for (size_t start = 0; start <= maxStart && start < data.size(); start++) {
+      Compare(kernels, func, base + start, base + data.size());
+      for (int i = 0; i < 40; i++) {
+        Compare(kernels, func, base + start, base + start + rng() % (data.size() - start + 1));
+      }
+    }
+  }
+}
+
+// 长度 0~96 的数据：填充字节中只在 pos 处放一个命中字节(pos == len 时没有)，
+// 覆盖 16 与 32 字节块的首尾、跨块以及只剩尾部的情况
+void BoundaryCases(const HttpScan::Kernels &kernels) {
+  // 填充字节对三个函数都不命中，命中字节取所有其它字节值
+  const char fill = 'a';
+  // 每个用例单独分配(长度为 0 时也不是空指针)，数据紧贴分配的末尾，越界读会被 AddressSanitizer 发现
+  for (size_t len = 0; len <= 96; len++) {
+    for (size_t pos = 0; pos <= len; pos++) {
+      for (int hit = 0; hit < 256; hit++) {
+        if (hit == fill) {
+          continue;
+        }
+        std::unique_ptr<char[]> buf(new char[len]);
+        memset(buf.get(), fill, len);
+        if (pos < len) {
+          buf[pos] = static_cast<char>(hit);
+        }
+        for (const Func &func : FUNCS) {
+          Compare(kernels, func, buf.get(), buf.get() + len);
+        }
+      }
+    }
+  }
+}
+
+auto RandomToken(std::mt19937 &rng, size_t maxLen) -> std::string {
+  static const char TCHARS[] = "!#$%&'*+-.^_`|~0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+  std::string token(1 + rng() % maxLen, ' ');
+  for (char &ch : token) {
+    ch = TCHARS[rng() % (sizeof(TCHARS) - 1)];
+  }
+  return token;
+}
+
+// 类似浏览器请求的头部块，偶尔混入非法字节与非 ASCII 字节
+auto RandomHeaderBlock(std::mt19937 &rng) -> std::string {
+  std::string block = "GET /" + RandomToken(rng, 40) + " HTTP/1.1\r\n";
+  int headers = 1 + rng() % 12;
+  for (int i = 0; i < headers; i++) {
+    block += RandomToken(rng, 30) + ": ";
+    size_t len = rng() % 120;
+    for (size_t j = 0; j < len; j++) {
+      block += static_cast<char>(0x20 + rng() % 0x5f);
+    }
+    block += "\r\n";
+  }
+  block += "\r\n";
+  int noise = rng() % 4;
+  for (int i = 0; i < noise; i++) {
+    block[rng() % block.size()] = static_cast<char>(rng() % 256);
+  }
+  return block;
+}
+}  // namespace
+
+auto main() -> int {
+  std::vector<HttpScan::Kernels> kernels = HttpScan::Supported();
+  printf("selected: %s, supported:", HttpScan::Isa());
+  for (const HttpScan::Kernels &k : kernels) {
+    printf(" %s", k.isa);
+  }
+  printf("\n");
+
+  std::mt19937 rng(20240601);
+  std::vector<std::string> blocks;
+  for (int i = 0; i < 200; i++) {
+    blocks.push_back(RandomHeaderBlock(rng));
+  }
+  // 最后一组是标量实现本身
+  for (size_t i = 0; i + 1 < kernels.size(); i++) {
+    const HttpScan::Kernels &k = kernels[i];
+    long before = comparisons;
+    BoundaryCases(k);
+    for (const std::string &block : blocks) {
+      // 不同的起点使块内的 16/32 字节边界落在不同位置
+      CompareBlock(k, block, 32, rng);
+    }
+    printf("%-7s %ld comparisons\n", k.isa, comparisons - before);
+  }
+  if (failures > 0) {
+    printf("FAILED: %d mismatches\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
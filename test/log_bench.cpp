@@ -0,0 +1,76 @@
+// LOG_* 调用方的耗时(纳秒/次)：级别被过滤的调用，以及写入线程暂存队列的调用。
+// 每轮写入半个队列的记录(不会因队列满而丢弃)，写线程在计时之外取走；另外单独测量各步骤的开销作为对照。
+#include <sys/time.h>
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "log/log.h"
+
+namespace {
+constexpr int QUEUE_CAPACITY = 1024;
+constexpr int BURST = QUEUE_CAPACITY / 2;
+constexpr int ROUNDS = 200;
+
+// 每次调用的平均耗时，预热后取三次中最好的结果。每轮 BURST 次调用之后清空队列
+template <typename F>
+auto Measure(F &&f) -> double {
+  double best = 1e30;
+  for (int round = 0; round < 4; round++) {
+    std::chrono::duration<double, std::nano> used{0};
+    for (int i = 0; i < ROUNDS; i++) {
+      auto start = std::chrono::steady_clock::now();
+      for (int j = 0; j < BURST; j++) {
+        f(j);
+      }
+      used += std::chrono::steady_clock::now() - start;
+      Log::Instance()->Flush();
+    }
+    if (round > 0 && used.count() < best) {
+      best = used.count();
+    }
+  }
+  return best / ROUNDS / BURST;
+}
+
+char sink[Log::RECORD_SIZE];
+
+void Format(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void Format(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(sink, sizeof(sink), format, args);
+  va_end(args);
+}
+}  // namespace
+
+auto main() -> int {
+  char dir[] = "/tmp/log_bench.XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    printf("mkdtemp failed\n");
+    return EXIT_FAILURE;
+  }
+  Log::Instance()->Init(Log::INFO, dir, ".log", QUEUE_CAPACITY);
+  const char *ip = "192.168.100.200";
+
+  printf("ns/call, bursts of %d records\n", BURST);
+  printf("%-44s %8.1f\n", "LOG_DEBUG filtered (level INFO)",
+         Measure([&](int i) { LOG_DEBUG("Client[%d](%s:%d) in, userCount:%d", i, ip, 40000 + i, i); }));
+  printf("%-44s %8.1f\n", "LOG_INFO constant message",
+         Measure([&](int) { LOG_INFO("========== Server start =========="); }));
+  printf("%-44s %8.1f\n", "LOG_INFO Client[%d](%s:%d) in, userCount:%d",
+         Measure([&](int i) { LOG_INFO("Client[%d](%s:%d) in, userCount:%d", i, ip, 40000 + i, i); }));
+  printf("%-44s %8.1f\n", "LOG_WARN Bad request: %d", Measure([&](int i) { LOG_WARN("Bad request: %d", 400 + i); }));
+
+  printf("components\n");
+  struct timeval now = {0, 0};
+  printf("%-44s %8.1f\n", "gettimeofday", Measure([&](int) { gettimeofday(&now, nullptr); }));
+  printf("%-44s %8.1f\n", "vsnprintf Client[%d](%s:%d) in, userCount:%d",
+         Measure([&](int i) { Format("Client[%d](%s:%d) in, userCount:%d", i, ip, 40000 + i, i); }));
+
+  std::string cmd = std::string("rm -rf ") + dir;
+  return system(cmd.c_str()) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
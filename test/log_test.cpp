@@ -0,0 +1,96 @@
+// 日志记录的格式：LOG_* 写入文件的消息与 snprintf 的结果一致，
+// 包括直接格式化的常用转换、改用 vsnprintf 的其它写法，以及超长消息的截断；被过滤的级别不写入。
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "log/log.h"
+
+namespace {
+// "2026-10-17 12:00:00.123456 [info] : " 的长度
+constexpr size_t PREFIX_LEN = 36;
+
+int failures = 0;
+std::vector<std::string> expected;
+
+// 同时记下 snprintf 的结果，超出记录长度的部分截断
+#define CHECK_LOG(format, ...)                                                            \
+  do {                                                                                    \
+    char text[Log::RECORD_SIZE * 2];                                                      \
+    snprintf(text, sizeof(text), format, ##__VA_ARGS__);                                  \
+    expected.emplace_back(std::string(text).substr(0, Log::RECORD_SIZE - 1 - PREFIX_LEN)); \
+    LOG_INFO(format, ##__VA_ARGS__);                                                      \
+  } while (0)
+}  // namespace
+
+auto main() -> int {
+  char dir[] = "/tmp/log_test.XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    printf("FAILED: mkdtemp\n");
+    return EXIT_FAILURE;
+  }
+  Log::Instance()->Init(Log::INFO, dir, ".log", 1024);
+
+  std::string view = "GET /index.html HTTP/1.1";
+  std::string long_text(600, 'z');
+  CHECK_LOG("========== Server init ==========");
+  CHECK_LOG("%s", "");
+  CHECK_LOG("Client[%d](%s:%d) in, userCount:%d", 13, "127.0.0.1", 56537, 1);
+  CHECK_LOG("[%.*s], [%s]", 3, view.data(), "/index.html");
+  CHECK_LOG("%.*s|", 0, view.data());
+  CHECK_LOG("%d %d %d %d", 0, -1, INT_MAX, INT_MIN);
+  CHECK_LOG("%ld %lld %lld", LONG_MIN, LLONG_MAX, LLONG_MIN);
+  CHECK_LOG("%u %lu %llu %zu", UINT_MAX, ULONG_MAX, ULLONG_MAX, static_cast<size_t>(12345));
+  CHECK_LOG("%x %lx %llx %i %c%c", 0xdeadbeefU, 0xfUL, 0x1234567890abcdefULL, -42, 'o', 'k');
+  CHECK_LOG("100%% done, %s", "ok");
+  // 直接格式化不支持的写法，改用 vsnprintf
+  CHECK_LOG("%5d|%-5s|%05u|%.2f|%p", 42, "ab", 7U, 3.14159, static_cast<void *>(nullptr));
+  CHECK_LOG("%s and then %08x", "text", 0xbeefU);
+  // 超长消息截断，记录仍以换行结尾
+  CHECK_LOG("%s", long_text.c_str());
+  CHECK_LOG("%s %d", long_text.c_str(), 1);
+  CHECK_LOG("%s %5d", long_text.c_str(), 1);
+  // 级别低于 INFO 的调用不写入
+  LOG_DEBUG("filtered %d", 1);
+  Log::Instance()->Flush();
+
+  std::ifstream in(std::string(dir) + "/" + [] {
+    char name[32];
+    time_t timer = time(nullptr);
+    struct tm now {};
+    localtime_r(&timer, &now);
+    snprintf(name, sizeof(name), "%04d_%02d_%02d.log", now.tm_year + 1900, now.tm_mon + 1, now.tm_mday);
+    return std::string(name);
+  }());
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(in, line);) {
+    lines.push_back(line);
+  }
+  if (lines.size() != expected.size()) {
+    printf("  %zu lines written, expected %zu\n", lines.size(), expected.size());
+    failures++;
+  }
+  for (size_t i = 0; i < lines.size() && i < expected.size(); i++) {
+    std::string message = lines[i].size() >= PREFIX_LEN ? lines[i].substr(PREFIX_LEN) : lines[i];
+    if (lines[i].compare(PREFIX_LEN - 9, 9, "[info] : ") != 0 || message != expected[i]) {
+      printf("  line %zu: \"%s\"\n    expected \"%s\"\n", i, lines[i].c_str(), expected[i].c_str());
+      failures++;
+    }
+  }
+
+  std::string cmd = std::string("rm -rf ") + dir;
+  if (system(cmd.c_str()) != 0) {
+    printf("  cannot remove %s\n", dir);
+  }
+  if (failures > 0) {
+    printf("FAILED: %d checks\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("%zu records\n", expected.size());
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,8 @@
+#ifndef MYSQLSTUB_ERRMSG_H
+#define MYSQLSTUB_ERRMSG_H
+
+// 客户端错误码
+#define CR_SERVER_GONE_ERROR 2006
+#define CR_SERVER_LOST 2013
+
+#endif  // MYSQLSTUB_ERRMSG_H
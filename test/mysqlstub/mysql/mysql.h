@@ -0,0 +1,57 @@
+#ifndef MYSQLSTUB_MYSQL_H
+#define MYSQLSTUB_MYSQL_H
+
+// 测试用的 MySQL C API 替身：只声明服务器用到的部分，由 ../mysqlstub.cpp 在内存中实现。
+// 连接的结构与真实的库不同，依赖本头文件的源文件须针对它重新编译，不能与 libmysqlclient 混用
+
+#include <cstdint>
+
+extern "C" {
+
+#define CLIENT_MULTI_STATEMENTS (1UL << 16)
+
+struct NET {
+  // 执行器登记到 epoll 的套接字，替身中是始终可读的 eventfd
+  int fd;
+};
+
+struct MYSQL {
+  NET net;
+  // 替身内部的连接状态
+  void *stub;
+};
+
+struct MYSQL_RES;
+typedef char **MYSQL_ROW;
+
+enum mysql_option { MYSQL_OPT_CONNECT_TIMEOUT };
+
+enum net_async_status { NET_ASYNC_COMPLETE = 0, NET_ASYNC_NOT_READY, NET_ASYNC_ERROR, NET_ASYNC_COMPLETE_NO_MORE_RESULTS };
+
+auto mysql_init(MYSQL *mysql) -> MYSQL *;
+auto mysql_options(MYSQL *mysql, enum mysql_option option, const void *arg) -> int;
+auto mysql_real_connect(MYSQL *mysql, const char *host, const char *user, const char *passwd, const char *db,
+                        unsigned int port, const char *unixSocket, unsigned long clientFlag) -> MYSQL *;
+void mysql_close(MYSQL *mysql);
+void mysql_library_end();
+auto mysql_ping(MYSQL *mysql) -> int;
+
+auto mysql_errno(MYSQL *mysql) -> unsigned int;
+auto mysql_error(MYSQL *mysql) -> const char *;
+auto mysql_real_escape_string(MYSQL *mysql, char *to, const char *from, unsigned long length) -> unsigned long;
+
+auto mysql_real_query(MYSQL *mysql, const char *query, unsigned long length) -> int;
+auto mysql_use_result(MYSQL *mysql) -> MYSQL_RES *;
+auto mysql_fetch_row(MYSQL_RES *result) -> MYSQL_ROW;
+void mysql_free_result(MYSQL_RES *result);
+auto mysql_field_count(MYSQL *mysql) -> unsigned int;
+auto mysql_affected_rows(MYSQL *mysql) -> uint64_t;
+auto mysql_more_results(MYSQL *mysql) -> bool;
+
+auto mysql_real_query_nonblocking(MYSQL *mysql, const char *query, unsigned long length) -> enum net_async_status;
+auto mysql_next_result_nonblocking(MYSQL *mysql) -> enum net_async_status;
+auto mysql_store_result_nonblocking(MYSQL *mysql, MYSQL_RES **result) -> enum net_async_status;
+
+}  // extern "C"
+
+#endif  // MYSQLSTUB_MYSQL_H
@@ -0,0 +1,9 @@
+#ifndef MYSQLSTUB_MYSQLD_ERROR_H
+#define MYSQLSTUB_MYSQLD_ERROR_H
+
+// 服务端错误码
+#define ER_PARSE_ERROR 1064
+#define ER_LOCK_DEADLOCK 1213
+#define ER_UNKNOWN_STMT_HANDLER 1243
+
+#endif  // MYSQLSTUB_MYSQLD_ERROR_H
@@ -0,0 +1,414 @@
+#include "mysqlstub.h"
+
+#include <mysql/errmsg.h>
+#include <mysql/mysql.h>
+#include <mysql/mysqld_error.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct MYSQL_RES {
+  std::vector<std::string> rows;
+  size_t pos = 0;
+  char *row[1];
+};
+
+namespace {
+// 所有连接共享的数据库
+struct Database {
+  std::mutex mtx;
+  // 用户名 -> 密码
+  std::map<std::string, std::string> users;
+  int connects = 0;
+  int commits = 0;
+  int rollbacks = 0;
+  std::string fail_prefix;
+  unsigned int fail_err = 0;
+};
+
+auto GetDatabase() -> Database & {
+  static Database db;
+  return db;
+}
+
+// 一个连接的状态
+struct Session {
+  int fd = -1;
+  std::set<std::string> prepared;
+  // 用户变量 @p0 等
+  std::map<std::string, std::string> vars;
+  bool in_transaction = false;
+  // 事务中插入、尚未提交的行
+  std::vector<std::pair<std::string, std::string>> uncommitted;
+  // 当前请求的语句，next 为下一条要执行的
+  std::vector<std::string> stmts;
+  size_t next = 0;
+  // 最近一条语句的结果
+  unsigned int field_count = 0;
+  uint64_t affected = 0;
+  std::vector<std::string> rows;
+  // 非阻塞调用是否已经返回过一次 NOT_READY
+  bool query_started = false;
+  bool next_started = false;
+  bool store_started = false;
+  unsigned int err = 0;
+  std::string error;
+};
+
+auto GetSession(MYSQL *mysql) -> Session & { return *static_cast<Session *>(mysql->stub); }
+
+auto StartsWith(const std::string &s, const char *prefix) -> bool { return s.compare(0, strlen(prefix), prefix) == 0; }
+
+// 按分号切分请求，引号中的分号不算
+auto SplitStatements(const char *query, unsigned long length) -> std::vector<std::string> {
+  std::vector<std::string> stmts(1);
+  bool quoted = false;
+  for (unsigned long i = 0; i < length; i++) {
+    char ch = query[i];
+    if (quoted && ch == '\\' && i + 1 < length) {
+      stmts.back() += ch;
+      ch = query[++i];
+    } else if (ch == '\'') {
+      quoted = !quoted;
+    } else if (ch == ';' && !quoted) {
+      stmts.emplace_back();
+      continue;
+    }
+    stmts.back() += ch;
+  }
+  return stmts;
+}
+
+// 语句中所有单引号字符串的值(去掉转义)，按出现顺序
+auto QuotedValues(const std::string &stmt) -> std::vector<std::string> {
+  std::vector<std::string> values;
+  size_t i = 0;
+  while ((i = stmt.find('\'', i)) != std::string::npos) {
+    std::string value;
+    for (i++; i < stmt.size() && stmt[i] != '\''; i++) {
+      if (stmt[i] == '\\' && i + 1 < stmt.size()) {
+        i++;
+      }
+      value += stmt[i];
+    }
+    values.push_back(std::move(value));
+    i++;
+  }
+  return values;
+}
+
+// 以下在持有数据库的锁时调用
+auto Exists(const Database &db, const Session &session, const std::string &user) -> bool {
+  if (db.users.count(user) != 0) {
+    return true;
+  }
+  for (const auto &row : session.uncommitted) {
+    if (row.first == user) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto Insert(Database &db, Session &session, const std::string &user, const std::string &password) -> bool {
+  if (Exists(db, session, user)) {
+    return false;
+  }
+  if (session.in_transaction) {
+    session.uncommitted.emplace_back(user, password);
+  } else {
+    db.users.emplace(user, password);
+  }
+  return true;
+}
+
+auto Fail(Session &session, unsigned int err, std::string error) -> bool {
+  session.err = err;
+  session.error = std::move(error);
+  return false;
+}
+
+// 执行一条语句，结果记入 session
+auto Execute(Database &db, Session &session, const std::string &stmt) -> bool {
+  session.field_count = 0;
+  session.affected = 0;
+  session.rows.clear();
+  if (!db.fail_prefix.empty() && StartsWith(stmt, db.fail_prefix.c_str())) {
+    unsigned int err = db.fail_err;
+    db.fail_prefix.clear();
+    return Fail(session, err, "injected error");
+  }
+  if (StartsWith(stmt, "PREPARE ")) {
+    session.prepared.insert(stmt.substr(8, stmt.find(' ', 8) - 8));
+    return true;
+  }
+  if (StartsWith(stmt, "SET ")) {
+    std::vector<std::string> values = QuotedValues(stmt);
+    for (size_t i = 0; i < values.size(); i++) {
+      session.vars["@p" + std::to_string(i)] = values[i];
+    }
+    return true;
+  }
+  if (StartsWith(stmt, "EXECUTE ")) {
+    std::string name = stmt.substr(8, stmt.find(' ', 8) - 8);
+    if (session.prepared.count(name) == 0) {
+      return Fail(session, ER_UNKNOWN_STMT_HANDLER, "Unknown prepared statement handler (" + name + ")");
+    }
+    const std::string &user = session.vars["@p0"];
+    if (name == "login_stmt") {
+      session.field_count = 1;
+      auto it = db.users.find(user);
+      if (it != db.users.end()) {
+        session.rows.push_back(it->second);
+      }
+    } else if (name == "register_stmt") {
+      session.affected = Insert(db, session, user, session.vars["@p1"]) ? 1 : 0;
+    }
+    return true;
+  }
+  if (stmt == "START TRANSACTION") {
+    session.in_transaction = true;
+    return true;
+  }
+  if (StartsWith(stmt, "SELECT username FROM user WHERE username IN (")) {
+    session.field_count = 1;
+    for (const std::string &user : QuotedValues(stmt)) {
+      if (Exists(db, session, user)) {
+        session.rows.push_back(user);
+      }
+    }
+    return true;
+  }
+  if (stmt == "SELECT username FROM user") {
+    session.field_count = 1;
+    for (const auto &user : db.users) {
+      session.rows.push_back(user.first);
+    }
+    return true;
+  }
+  if (StartsWith(stmt, "INSERT INTO user(username, password) SELECT ")) {
+    // 依次为每行的用户名与密码
+    std::vector<std::string> values = QuotedValues(stmt);
+    for (size_t i = 0; i + 1 < values.size(); i += 2) {
+      session.affected += Insert(db, session, values[i], values[i + 1]) ? 1 : 0;
+    }
+    return true;
+  }
+  if (stmt == "COMMIT") {
+    for (auto &row : session.uncommitted) {
+      db.users.emplace(std::move(row.first), std::move(row.second));
+    }
+    session.uncommitted.clear();
+    session.in_transaction = false;
+    db.commits++;
+    return true;
+  }
+  return Fail(session, ER_PARSE_ERROR, "You have an error in your SQL syntax near '" + stmt + "'");
+}
+
+void StartQuery(Session &session, const char *query, unsigned long length) {
+  session.stmts = SplitStatements(query, length);
+  session.next = 0;
+  session.err = 0;
+  session.error.clear();
+}
+
+// 执行下一条语句；出错时请求中其余的语句不再执行
+auto ExecuteNext(Session &session) -> bool {
+  Database &db = GetDatabase();
+  std::lock_guard<std::mutex> locker(db.mtx);
+  if (!Execute(db, session, session.stmts[session.next++])) {
+    session.next = session.stmts.size();
+    return false;
+  }
+  return true;
+}
+
+auto NewResult(const Session &session) -> MYSQL_RES * {
+  if (session.field_count == 0) {
+    return nullptr;
+  }
+  auto *res = new MYSQL_RES;
+  res->rows = session.rows;
+  return res;
+}
+}  // namespace
+
+void MysqlStub::Reset() {
+  Database &db = GetDatabase();
+  std::lock_guard<std::mutex> locker(db.mtx);
+  db.users.clear();
+  db.connects = 0;
+  db.commits = 0;
+  db.rollbacks = 0;
+  db.fail_prefix.clear();
+}
+
+auto MysqlStub::FindUser(const std::string &user, std::string *password) -> bool {
+  Database &db = GetDatabase();
+  std::lock_guard<std::mutex> locker(db.mtx);
+  auto it = db.users.find(user);
+  if (it == db.users.end()) {
+    return false;
+  }
+  *password = it->second;
+  return true;
+}
+
+auto MysqlStub::UserCount() -> size_t {
+  Database &db = GetDatabase();
+  std::lock_guard<std::mutex> locker(db.mtx);
+  return db.users.size();
+}
+
+void MysqlStub::FailNext(const std::string &prefix, unsigned int err) {
+  Database &db = GetDatabase();
+  std::lock_guard<std::mutex> locker(db.mtx);
+  db.fail_prefix = prefix;
+  db.fail_err = err;
+}
+
+auto MysqlStub::Connects() -> int {
+  Database &db = GetDatabase();
+  std::lock_guard<std::mutex> locker(db.mtx);
+  return db.connects;
+}
+
+auto MysqlStub::Commits() -> int {
+  Database &db = GetDatabase();
+  std::lock_guard<std::mutex> locker(db.mtx);
+  return db.commits;
+}
+
+auto MysqlStub::Rollbacks() -> int {
+  Database &db = GetDatabase();
+  std::lock_guard<std::mutex> locker(db.mtx);
+  return db.rollbacks;
+}
+
+auto mysql_init(MYSQL *mysql) -> MYSQL * {
+  if (mysql == nullptr) {
+    mysql = new MYSQL;
+  }
+  mysql->net.fd = -1;
+  mysql->stub = new Session;
+  return mysql;
+}
+
+auto mysql_options(MYSQL *, enum mysql_option, const void *) -> int { return 0; }
+
+auto mysql_real_connect(MYSQL *mysql, const char *, const char *, const char *, const char *, unsigned int,
+                        const char *, unsigned long) -> MYSQL * {
+  Session &session = GetSession(mysql);
+  session.fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+  mysql->net.fd = session.fd;
+  Database &db = GetDatabase();
+  std::lock_guard<std::mutex> locker(db.mtx);
+  db.connects++;
+  return mysql;
+}
+
+void mysql_close(MYSQL *mysql) {
+  Session *session = static_cast<Session *>(mysql->stub);
+  {
+    Database &db = GetDatabase();
+    std::lock_guard<std::mutex> locker(db.mtx);
+    if (session->in_transaction) {
+      db.rollbacks++;
+    }
+  }
+  if (session->fd >= 0) {
+    close(session->fd);
+  }
+  delete session;
+  delete mysql;
+}
+
+void mysql_library_end() {}
+
+auto mysql_ping(MYSQL *mysql) -> int { return GetSession(mysql).fd >= 0 ? 0 : 1; }
+
+auto mysql_errno(MYSQL *mysql) -> unsigned int { return GetSession(mysql).err; }
+
+auto mysql_error(MYSQL *mysql) -> const char * { return GetSession(mysql).error.c_str(); }
+
+auto mysql_real_escape_string(MYSQL *, char *to, const char *from, unsigned long length) -> unsigned long {
+  char *out = to;
+  for (unsigned long i = 0; i < length; i++) {
+    if (from[i] == '\'' || from[i] == '\\') {
+      *out++ = '\\';
+    }
+    *out++ = from[i];
+  }
+  *out = '\0';
+  return out - to;
+}
+
+auto mysql_real_query(MYSQL *mysql, const char *query, unsigned long length) -> int {
+  Session &session = GetSession(mysql);
+  StartQuery(session, query, length);
+  return ExecuteNext(session) ? 0 : 1;
+}
+
+auto mysql_use_result(MYSQL *mysql) -> MYSQL_RES * { return NewResult(GetSession(mysql)); }
+
+auto mysql_fetch_row(MYSQL_RES *result) -> MYSQL_ROW {
+  if (result->pos == result->rows.size()) {
+    return nullptr;
+  }
+  result->row[0] = &result->rows[result->pos++][0];
+  return result->row;
+}
+
+void mysql_free_result(MYSQL_RES *result) { delete result; }
+
+auto mysql_field_count(MYSQL *mysql) -> unsigned int { return GetSession(mysql).field_count; }
+
+auto mysql_affected_rows(MYSQL *mysql) -> uint64_t { return GetSession(mysql).affected; }
+
+auto mysql_more_results(MYSQL *mysql) -> bool {
+  Session &session = GetSession(mysql);
+  return session.next < session.stmts.size();
+}
+
+auto mysql_real_query_nonblocking(MYSQL *mysql, const char *query, unsigned long length) -> enum net_async_status {
+  Session &session = GetSession(mysql);
+  if (!session.query_started) {
+    session.query_started = true;
+    StartQuery(session, query, length);
+    return NET_ASYNC_NOT_READY;
+  }
+  session.query_started = false;
+  return ExecuteNext(session) ? NET_ASYNC_COMPLETE : NET_ASYNC_ERROR;
+}
+
+auto mysql_next_result_nonblocking(MYSQL *mysql) -> enum net_async_status {
+  Session &session = GetSession(mysql);
+  if (session.next == session.stmts.size()) {
+    return NET_ASYNC_COMPLETE_NO_MORE_RESULTS;
+  }
+  if (!session.next_started) {
+    session.next_started = true;
+    return NET_ASYNC_NOT_READY;
+  }
+  session.next_started = false;
+  return ExecuteNext(session) ? NET_ASYNC_COMPLETE : NET_ASYNC_ERROR;
+}
+
+auto mysql_store_result_nonblocking(MYSQL *mysql, MYSQL_RES **result) -> enum net_async_status {
+  Session &session = GetSession(mysql);
+  if (!session.store_started) {
+    session.store_started = true;
+    return NET_ASYNC_NOT_READY;
+  }
+  session.store_started = false;
+  *result = NewResult(session);
+  return NET_ASYNC_COMPLETE;
+}
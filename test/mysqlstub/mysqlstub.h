@@ -0,0 +1,27 @@
+#ifndef MYSQLSTUB_H
+#define MYSQLSTUB_H
+
+#include <cstddef>
+#include <string>
+
+// 内存中的 MySQL 替身，供数据库相关的测试在没有服务端的环境中运行。
+// 只理解 SqlConn 与 UserCache 发出的语句：预处理、登录与注册的 EXECUTE、一批注册的事务，以及加载全部用户名。
+// 多语句请求逐条执行，每读取一条语句的结果才执行它；事务中插入的行在 COMMIT 时才写入，关闭连接时丢弃。
+// 非阻塞接口的每次调用先返回 NET_ASYNC_NOT_READY，再次调用才完成，连接的 fd 始终可读。
+// 这里是测试控制替身的接口
+class MysqlStub {
+ public:
+  // 清空用户表、计数与注入的错误
+  static void Reset();
+  // 已提交的用户及其密码
+  static auto FindUser(const std::string &user, std::string *password) -> bool;
+  static auto UserCount() -> size_t;
+  // 之后第一条以 prefix 开头的语句以错误码 err 失败，请求中其余的语句不再执行
+  static void FailNext(const std::string &prefix, unsigned int err);
+  // 建立的连接数，提交的事务数，关闭连接时回滚的事务数
+  static auto Connects() -> int;
+  static auto Commits() -> int;
+  static auto Rollbacks() -> int;
+};
+
+#endif  // MYSQLSTUB_H